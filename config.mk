@@ -42,7 +42,7 @@ UPDATE_METHOD = web
 # A list of the test programs you want compiled in from the user/progs
 # directory.
 #
-STUDENTTESTS =  introspective schizo introvert garrulous mimic zfod cooperative annoying coquettish coy cooperative_terminate merchant_terminate peon_terminate coolness_terminate coy_terminate regression epileptic rogue intrepid carpe_diem mutex polycephalic loquacious make_crash_on_steroids sleep_test_on_steroids exec_steroids forkwait_steroids loader1 loader2 print remove1 remove2 stack yield wild reuse_tid
+STUDENTTESTS =  introspective schizo introvert garrulous mimic zfod cooperative annoying coquettish coy cooperative_terminate merchant_terminate peon_terminate coolness_terminate coy_terminate regression epileptic rogue intrepid carpe_diem mutex polycephalic loquacious make_crash_on_steroids sleep_test_on_steroids exec_steroids forkwait_steroids loader1 loader2 print remove1 remove2 stack yield wild reuse_tid cow large_pages page_advice remap_pages shared_mem file_io exec_args sparse_span swap_roundtrip
 
 ###########################################################################
 # Data files provided by course staff to build into the RAM disk
@@ -76,7 +76,7 @@ THREAD_OBJS = malloc.o panic.o asm_thr.o thread.o tcb.o stack_alloc.o synch/atom
 ###########################################################################
 # Object files for your syscall wrappers
 ###########################################################################
-SYSCALL_OBJS = set_status.o vanish.o print.o fork.o exec.o wait.o task_vanish.o gettid.o yield.o deschedule.o make_runnable.o get_ticks.o sleep.o new_pages.o remove_pages.o get_cursor_pos.o getchar.o halt.o readfile.o readline.o set_cursor_pos.o set_term_color.o swexn.o misbehave.o
+SYSCALL_OBJS = set_status.o vanish.o print.o fork.o exec.o wait.o task_vanish.o gettid.o yield.o deschedule.o make_runnable.o get_ticks.o sleep.o new_pages.o remove_pages.o get_cursor_pos.o getchar.o halt.o readfile.o readline.o set_cursor_pos.o set_term_color.o swexn.o misbehave.o page_advise.o remap_pages.o shm_create.o shm_attach.o file_open.o file_pread.o file_close.o file_map.o
 
 ###########################################################################
 # Object files for your automatic stack handling
@@ -93,7 +93,7 @@ AUTOSTACK_OBJS = autostack.o
 #
 # Kernel object files you provide in from kern/
 #
-KERNEL_OBJS = kernel.o lib/cr_util.o lib/atomic.o lib/spin.o lib/cvar.o lib/mutex.o lib/cllist.o sched/process.o sched/asm_dispatch.o sched/sched.o sched/dispatch.o lib/malloc_wrappers.o vm/vm.o vm/mreg.o vm/asm_tlb.o vm/tlb.o vm/page_alloc.o vm/frame_alloc.o vm/pg_table.o loader/loader.o loader/usr_stack.o entry/drivers/keyboard.o entry/drivers/timer.o entry/idt.o entry/drivers/driver_wrappers.o entry/drivers/console.o entry/drivers/cursor.o entry/syscall/lifecycle.o entry/syscall/swexn.o entry/syscall/threadmgmt.o entry/syscall/mem_mgmt.o entry/syscall/misc_syscalls.o entry/syscall/console_io.o entry/syscall/sc_utils.o entry/syscall/syscall_wrappers.o entry/faults/faults.o entry/faults/fault_wrappers.o entry/drivers/drivers.o sched/thread.o
+KERNEL_OBJS = kernel.o lib/cr_util.o lib/atomic.o lib/spin.o lib/cvar.o lib/mutex.o lib/rwlock.o lib/cllist.o sched/process.o sched/asm_dispatch.o sched/sched.o sched/kstack.o sched/dispatch.o lib/malloc_wrappers.o lib/slab.o vm/vm.o vm/mreg.o vm/asm_tlb.o vm/tlb.o vm/page_alloc.o vm/frame_alloc.o vm/buddy.o vm/page_cache.o vm/zswap.o vm/shm.o lib/lz.o lib/tsc.o lib/uaccess.o vm/pg_table.o loader/loader.o loader/ramfs.o loader/usr_stack.o entry/drivers/keyboard.o entry/drivers/timer.o entry/idt.o entry/drivers/driver_wrappers.o entry/drivers/console.o entry/drivers/cursor.o entry/syscall/lifecycle.o entry/syscall/swexn.o entry/syscall/threadmgmt.o entry/syscall/mem_mgmt.o entry/syscall/file_io.o entry/syscall/misc_syscalls.o entry/syscall/console_io.o entry/syscall/sc_utils.o entry/syscall/syscall_wrappers.o entry/faults/faults.o entry/faults/fault_wrappers.o entry/drivers/drivers.o sched/thread.o
 
 ###########################################################################
 # WARNING: Do not put **test** programs into the REQPROGS variables.  Your
@@ -11,8 +11,10 @@
 
 /* Pebbles specific includes */
 #include <idt.h>
+#include <page_alloc.h>
 #include <sched.h>
 #include <sc_utils.h>
+#include <uaccess.h>
 #include <ureg.h>
 
 /* Libc specific includes */
@@ -205,6 +207,9 @@ int int_device_unavail(ureg_t *ureg)
 }
 
 /** @brief Handles double faults.
+ *
+ *  We run on the faulting thread's kernel stack, so a kernel stack overflow
+ *  never makes it here; see kstack.c.
  *
  *  @return Void.
  **/
@@ -282,7 +287,28 @@ int int_gen_prot(ureg_t *ureg)
   return -1;
 }
 
+/** @brief Finds where a faulting instruction should resume.
+ *
+ *  @param eip The faulting instruction.
+ *
+ *  @return Its fixup, or 0 if it isn't in the exception table.
+ **/
+static unsigned int ex_fixup(unsigned int eip)
+{
+  const ex_entry_s *e;
+
+  for (e = ex_table_start; e < ex_table_end; ++e) {
+    if (e->insn == eip) return e->fixup;
+  }
+
+  return 0;
+}
+
 /** @brief Handles page faults.
+ *
+ *  Faults the kernel takes in the uaccess primitives are resolved under the
+ *  map lock just like user faults; only if that fails, on a bad user
+ *  pointer, do we resume at the primitive's fixup.
  *
  *  @return 0 if the kernel handles the fault, else -1.
  **/
@@ -290,6 +316,7 @@ extern volatile int kernel_is_running;
 int int_page_fault(ureg_t *ureg)
 {
   void *cr2;
+  unsigned int fixup;
   int retval;
 
   /* Grab the faulting address and re-enable interrupts */
@@ -297,8 +324,16 @@ int int_page_fault(ureg_t *ureg)
   if (kernel_is_running) enable_interrupts();
 
   /* Try to handle the fault */
-  if ((retval = pg_page_fault_handler(cr2)))
+  if ((retval = pg_page_fault_handler(cr2, ureg->error_code)))
   {
+    /* Fail the copy, not the kernel */
+    if (!(ureg->error_code & PG_FAULT_USER)
+        && (fixup = ex_fixup(ureg->eip)))
+    {
+      ureg->eip = fixup;
+      return 0;
+    }
+
     ureg->cause = SWEXN_CAUSE_PAGEFAULT;
     ureg->cr2 = (unsigned int)cr2;
 
@@ -11,6 +11,7 @@
 /* Pebbles includes */
 #include <console.h>
 #include <keyboard.h>
+#include <sched.h>
 
 /* Libc includes */
 #include <malloc.h>
@@ -56,21 +57,20 @@ int sys_readline(int size, char *buf)
 {
   char *buf_k;
   int len;
-  
-  /* Get a line from the console */
-  buf_k = malloc(size * sizeof(char));
-  if (!buf_k) return -1;
 
+  if (size < 0) return -1;
+
+  /* Short lines are staged in the thread's scratch area */
+  if (size <= THR_SCRATCH_SIZE) buf_k = curr_thr->scratch;
+  else if (!(buf_k = malloc(size * sizeof(char)))) return -1;
+
+  /* Get a line from the console */
   len = kbd_getline(size, buf_k);
 
   /* Give it to the user */
-  if (copy_to_user(buf, buf_k, len)) {
-    free(buf_k);
-    return -1;
-  }
+  if (copy_to_user(buf, buf_k, len)) len = -1;
 
-  /* Free and return */
-  free(buf_k);
+  if (buf_k != curr_thr->scratch) free(buf_k);
   return len;
 }
 
@@ -78,7 +78,8 @@ int sys_readline(int size, char *buf)
  *
  *  If any part of buf is in invalid memory or the system cannot allocate
  *  memory to copy buf into kernel space, sys_print(...) will fail with an
- *  error code.
+ *  error code.  Only prints longer than the thread's scratch area need
+ *  any memory.
  *
  *  @param size The number of bytes to print.
  *  @param buf A pointer to the start of the bytes to print.
@@ -89,16 +90,19 @@ int sys_print(int size, char *buf)
 {
   char *buf_k;
 
-  /* Copy buf_k from user-space */
-  if (copy_from_user(&buf_k, buf, size)) {
-    free(buf_k);
-    return -1;
+  if (size < 0) return -1;
+
+  /* Copy buf from user-space */
+  if (size <= THR_SCRATCH_SIZE) {
+    buf_k = curr_thr->scratch;
+    if (copy_from_user_static(buf_k, buf, size)) return -1;
   }
+  else if (copy_from_user(&buf_k, buf, size)) return -1;
 
   /* Write to the console */
   putbytes(buf_k, size);
 
-  free(buf_k);
+  if (buf_k != curr_thr->scratch) free(buf_k);
   return 0;
 }
 
@@ -135,8 +139,8 @@ int sys_get_cursor_pos(int *row, int *col)
   get_cursor(&krow, &kcol);
 
   /* Copy coords to user */
-  if ( copy_to_user((char *)&krow, (char *)row, sizeof(int))
-       || copy_to_user((char *)&kcol, (char *)col, sizeof(int)) )
+  if ( copy_to_user((char *)row, (char *)&krow, sizeof(int))
+       || copy_to_user((char *)col, (char *)&kcol, sizeof(int)) )
   {
     return -1;
   }
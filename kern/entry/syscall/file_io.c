@@ -0,0 +1,154 @@
+/** @file file_io.c
+ *
+ *  @brief Implements our file system calls.
+ *
+ *  Files come from the RAM filesystem (see ramfs.h).  A task's descriptors
+ *  index its files[] table; since files are read-only and never go away,
+ *  a descriptor is just a pointer to one, and reads are positioned, so
+ *  there's no per-descriptor state to share or clean up.
+ *
+ *  @author Enrique Naudon (esn)
+ *  @author Marlies Ruck (mruck)
+ **/
+#include <simics.h>
+
+#include <mutex.h>
+#include <process.h>
+#include <ramfs.h>
+#include <sc_utils.h>
+#include <sched.h>
+#include <vm.h>
+
+#include <stddef.h>
+
+
+/*************************************************************************
+ *  Internal helper functions
+ *************************************************************************/
+
+/** @brief Finds the file behind one of our descriptors.
+ *
+ *  @param fd The descriptor.
+ *
+ *  @return The file, or NULL if fd isn't open.
+ **/
+static const ramfs_file_s *fd_file(int fd)
+{
+  const ramfs_file_s *file;
+
+  if (fd < 0 || fd >= RAMFS_MAX_FDS) return NULL;
+
+  mutex_lock(&curr_tsk->lock);
+  file = curr_tsk->files[fd];
+  mutex_unlock(&curr_tsk->lock);
+
+  return file;
+}
+
+/*************************************************************************
+ *  File system calls
+ *************************************************************************/
+
+/** @brief Opens a file.
+ *
+ *  Descriptors are inherited across fork(...) and kept across exec(...).
+ *
+ *  @param filename The file's name.
+ *
+ *  @return The lowest free descriptor on success, or a negative integer
+ *  error code on failure.
+ **/
+int sys_file_open(char *filename)
+{
+  const ramfs_file_s *file;
+  int fd;
+
+  if (copy_str_from_user_static(curr_thr->scratch, filename,
+                                THR_SCRATCH_SIZE) < 0)
+    return -1;
+  if (!(file = ramfs_lookup(curr_thr->scratch))) return -1;
+
+  mutex_lock(&curr_tsk->lock);
+  for (fd = 0; fd < RAMFS_MAX_FDS; ++fd) {
+    if (!curr_tsk->files[fd]) {
+      curr_tsk->files[fd] = file;
+      mutex_unlock(&curr_tsk->lock);
+      return fd;
+    }
+  }
+  mutex_unlock(&curr_tsk->lock);
+
+  return -2;
+}
+
+/** @brief Reads from an open file.
+ *
+ *  Reads count bytes from position offset straight into buf, stopping at
+ *  the end of the file.
+ *
+ *  @param fd The file's descriptor.
+ *  @param buf The buffer to read into.
+ *  @param count The most bytes to read.
+ *  @param offset Where in the file to start reading.
+ *
+ *  @return The number of bytes read (0 at the end of the file) on success,
+ *  or a negative integer error code on failure.
+ **/
+int sys_file_pread(int fd, char *buf, int count, int offset)
+{
+  const ramfs_file_s *file;
+
+  if (!(file = fd_file(fd))) return -1;
+  return ramfs_read(file, buf, count, offset);
+}
+
+/** @brief Closes a descriptor.
+ *
+ *  Mappings made through the descriptor stay put.
+ *
+ *  @param fd The descriptor.
+ *
+ *  @return 0 on success, or a negative integer error code on failure.
+ **/
+int sys_file_close(int fd)
+{
+  if (fd < 0 || fd >= RAMFS_MAX_FDS) return -1;
+
+  mutex_lock(&curr_tsk->lock);
+  if (!curr_tsk->files[fd]) {
+    mutex_unlock(&curr_tsk->lock);
+    return -1;
+  }
+  curr_tsk->files[fd] = NULL;
+  mutex_unlock(&curr_tsk->lock);
+
+  return 0;
+}
+
+/** @brief Maps an open file read-only.
+ *
+ *  The whole file is mapped at addr, with the last page zero-filled past
+ *  its end.  The mapping's pages are shared with every other task mapping
+ *  the file, and are read in as they're touched.  Free the mapping with
+ *  sys_remove_pages(...).
+ *
+ *  @param fd The file's descriptor.
+ *  @param addr Where to map the file.
+ *
+ *  @return The file's length in bytes on success, or a negative integer
+ *  error code on failure.
+ **/
+int sys_file_map(int fd, void *addr)
+{
+  const ramfs_file_s *file;
+  void *start;
+
+  if ((unsigned int) addr % PAGE_SIZE) return -1;
+  if (!(file = fd_file(fd))) return -1;
+
+  mutex_lock(&curr_tsk->lock);
+  start = vm_map_file(&curr_tsk->vmi, addr, file);
+  mutex_unlock(&curr_tsk->lock);
+
+  return start ? file->execlen : -1;
+}
@@ -16,6 +16,7 @@
 #include <loader.h>
 #include <mutex.h>
 #include <process.h>
+#include <ramfs.h>
 #include <sched.h>
 #include <thread.h>
 #include <tlb.h>
@@ -112,12 +113,16 @@ int sys_fork(unsigned int esp)
 
   /* Copy address space */
   if (vm_copy(&ctask->vmi, &parent->vmi)) {
-    free(ctask->mini_pcb);
+    task_free_mini(ctask->mini_pcb);
     task_free(ctask);
     task_final(ctask);
     return -1;
   }
 
+  /* The child inherits our open files and shared memory grants */
+  memcpy(ctask->files, parent->files, sizeof(ctask->files));
+  memcpy(ctask->shm_grants, parent->shm_grants, sizeof(ctask->shm_grants));
+
   /* Register the parent's swexn with the child */
   if(curr_thr->swexn.eip) 
     cthread->swexn = curr_thr->swexn;
@@ -175,9 +180,10 @@ int sys_thread_fork(unsigned int esp)
 
 /** @brief Execute a new executable.
  *
- *  Memory for copying user execname and argvec is dynamically allocated,
- *  so there is specific limit on their size.  The request will fail if the
- *  kernel does not have resources.
+ *  The execname is copied into the thread's scratch area, and argvec
+ *  straight into what will be the top page of the new stack (see
+ *  usr_stack_stage(...)), so exec doesn't touch the heap.  The arguments
+ *  have to fit in that page.
  *
  *  @param execname The name of the new executable.
  *  @param argvec A NULL-terminated array of NULL-terminated string
@@ -187,10 +193,11 @@ int sys_thread_fork(unsigned int esp)
  **/
 int sys_exec(char *execname, char *argvec[])
 {
-  char *execname_k, **argvec_k;
+  const ramfs_file_s *file;
+  char *execname_k = curr_thr->scratch;
   void *entry, *stack;
+  usr_stage_s stage;
   simple_elf_t se;
-  int argcnt, i;
   int thr_count;
 
   /* Only single threaded tasks can exec */
@@ -201,46 +208,35 @@ int sys_exec(char *execname, char *argvec[])
     return -2;
 
   /* Copy the execname from the user */
-  if (copy_str_from_user(&execname_k, execname) < 0)
+  if (copy_str_from_user_static(execname_k, execname, THR_SCRATCH_SIZE) < 0)
     return -1;
 
   /* Make sure it exists */
-  if (validate_file(&se, execname_k) < 0) {
-    free(execname_k);
+  if (validate_file(&se, execname_k) < 0)
     return -1;
-  }
+  file = ramfs_lookup(execname_k);
 
-  /* Copy the argument vector from user */
-  argcnt = copy_argv_from_user(&argvec_k, argvec);
-  if (argcnt < 0) {
-    free(execname_k);
+  /* Stage the argument vector from the user */
+  if (usr_stack_stage(&stage, argvec) < 0)
     return -1;
-  }
 
   /* Destroy the old address space; setup the new */
   vm_final(&curr_tsk->vmi);
   entry = load_file(&curr_tsk->vmi, execname_k);
-  stack = usr_stack_init(&curr_tsk->vmi, argcnt, argvec_k);
-  if (!entry || !stack) {
-    for (i = 0; i < argcnt; ++i) free(argvec_k[i]);
-    free(argvec_k);
-    free(execname_k);
+  if (!entry) {
+    usr_stack_unstage(&stage);
     return -1;
   }
+  stack = usr_stack_init(&curr_tsk->vmi, &stage);
+  if (!stack) return -1;
 
-  sim_reg_process(&curr_tsk->cr3, execname_k);
+  /* Keep the new execname for debugging; the file's copy never goes away */
+  curr_tsk->execname = (char *)file->execname;
+  sim_reg_process(&curr_tsk->cr3, curr_tsk->execname);
 
   /* Zero the status */
   TASK_STATUS(curr_tsk) = 0;
 
-  /* Free copied parameters*/
-  for (i = 0; i < argcnt; ++i) free(argvec_k[i]);
-  free(argvec_k);
-
-  /* Keep the new execname for debugging */
-  curr_tsk->execname = execname_k;
-  /* MEMORY LEAK */
-
   /* Execute the new program (should not return) */
   half_dispatch(entry, stack);
   assert(0);
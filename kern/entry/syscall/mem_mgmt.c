@@ -8,9 +8,12 @@
 #include <simics.h>
 
 #include <sched.h>
+#include <sc_utils.h>
 #include <vm.h>
 #include <mutex.h>
 
+#include <malloc.h>
+
 
 /*************************************************************************
  *  Memory management system calls
@@ -27,6 +30,9 @@
  *  allocation will fail if the system does not have enough resources to
  *  satisfy the request.
  *
+ *  If len has NEW_PAGES_LARGE set, the region is backed by 4MB pages; addr
+ *  and len must then be multiples of LARGE_PAGE_SIZE.
+ *
  *  @param addr The starting address of the allocation.
  *  @param len The lenght of the allocaiton.
  *
@@ -34,14 +40,23 @@
  **/
 int sys_new_pages(void *addr, int len)
 {
+  unsigned int attrs = VM_ATTR_RDWR|VM_ATTR_USER|VM_ATTR_NEWPG;
+
+  /* Large pages are requested in len's low bits */
+  if (len & NEW_PAGES_LARGE) {
+    len &= ~NEW_PAGES_LARGE;
+    attrs |= VM_ATTR_LARGE;
+    if ((unsigned int) addr % LARGE_PAGE_SIZE) return -1;
+    if (len % LARGE_PAGE_SIZE) return -1;
+  }
+
   /* Parameter checking */
   if ((unsigned int) addr % PAGE_SIZE) return -1;
   if (len < 0 || len % PAGE_SIZE) return -1;
 
   mutex_lock(&curr_tsk->lock);
 
-  if (!vm_alloc(&curr_tsk->vmi, addr, len,
-                VM_ATTR_RDWR|VM_ATTR_USER|VM_ATTR_NEWPG))
+  if (!vm_alloc(&curr_tsk->vmi, addr, len, attrs))
   {
     mutex_unlock(&curr_tsk->lock);
     return -1;
@@ -81,3 +96,150 @@ int sys_remove_pages(void *addr)
   return 0;
 }
 
+/** @brief Resizes or moves memory allocated with sys_new_pages(...).
+ *
+ *  The region at addr grows or shrinks to len bytes.  If new_addr is NULL
+ *  (or addr), it stays put, and growing requires the memory above it to be
+ *  free.  Otherwise it moves to new_addr, which must not overlap any
+ *  allocation (including the region itself); its pages move with it
+ *  rather than being copied.
+ *
+ *  Regions of large pages can't be remapped.
+ *
+ *  @param addr The region's starting address.
+ *  @param len The region's new length; a multiple of PAGE_SIZE.
+ *  @param new_addr Where the region should start, or NULL.
+ *
+ *  @return 0 on success, or a negative integer error code on failure.
+ **/
+int sys_remap_pages(void *addr, int len, void *new_addr)
+{
+  void *start;
+
+  /* Parameter checking */
+  if ((unsigned int) addr % PAGE_SIZE) return -1;
+  if (len <= 0 || len % PAGE_SIZE) return -1;
+
+  mutex_lock(&curr_tsk->lock);
+  start = vm_remap(&curr_tsk->vmi, addr, len, new_addr);
+  mutex_unlock(&curr_tsk->lock);
+
+  return start ? 0 : -1;
+}
+
+/** @brief Advises the kernel about part of a region.
+ *
+ *  Lets allocators give back the frames of a free chunk (VM_ADV_DONTNEED),
+ *  or fault a chunk in ahead of use (VM_ADV_WILLNEED), without touching the
+ *  region itself.  VM_ADV_RESIDENT writes a bitmap to vec, one bit per page
+ *  (least significant first), saying which pages have frames.
+ *
+ *  @param addr The (page-aligned) start of the range.
+ *  @param len The length of the range; a multiple of PAGE_SIZE.
+ *  @param advice One of the VM_ADV_* values.
+ *  @param vec For VM_ADV_RESIDENT, where to write the bitmap.
+ *
+ *  @return 0 on success, or a negative integer error code on failure.
+ **/
+int sys_page_advise(void *addr, int len, int advice, char *vec)
+{
+  unsigned char *bits = NULL;
+  int nbytes = 0, err;
+
+  /* Parameter checking */
+  if ((unsigned int) addr % PAGE_SIZE) return -1;
+  if (len <= 0 || len % PAGE_SIZE) return -1;
+
+  /* Residency is gathered here, then copied out */
+  if (advice == VM_ADV_RESIDENT) {
+    nbytes = (len/PAGE_SIZE + 7) / 8;
+    bits = malloc(nbytes);
+    if (!bits) return -2;
+  }
+
+  mutex_lock(&curr_tsk->lock);
+  err = vm_advise(&curr_tsk->vmi, addr, len, advice, bits);
+  mutex_unlock(&curr_tsk->lock);
+
+  if (bits) {
+    if (!err && copy_to_user(vec, (char *)bits, nbytes)) err = -1;
+    free(bits);
+  }
+
+  return err;
+}
+
+/** @brief Creates a shared memory object and maps it.
+ *
+ *  The object is len bytes of zeroes, mapped read/write at addr.  Forked
+ *  children inherit the mapping, along with the right to map the object
+ *  again with sys_shm_attach(...); either way, every mapper sees the same
+ *  memory.  No other task may attach the object.  Mappings are
+ *  freed with sys_remove_pages(...), and the object goes away with its
+ *  last mapping.
+ *
+ *  @param addr Where to map the object.
+ *  @param len The object's size; a multiple of PAGE_SIZE.
+ *
+ *  @return The object's handle (a positive integer) on success, or a
+ *  negative integer error code on failure.
+ **/
+int sys_shm_create(void *addr, int len)
+{
+  shm_s *shm;
+  int handle;
+
+  /* Parameter checking */
+  if ((unsigned int) addr % PAGE_SIZE) return -1;
+  if (len <= 0 || len % PAGE_SIZE) return -1;
+
+  shm = shm_create(len / PAGE_SIZE);
+  if (!shm) return -2;
+  handle = shm->handle;
+
+  mutex_lock(&curr_tsk->lock);
+
+  if (!vm_alloc_shared(&curr_tsk->vmi, addr, shm))
+  {
+    mutex_unlock(&curr_tsk->lock);
+    shm_put(shm);
+    return -1;
+  }
+  curr_tsk->shm_grants[shm_slot(shm)] = handle;
+
+  mutex_unlock(&curr_tsk->lock);
+  return handle;
+}
+
+/** @brief Maps an existing shared memory object.
+ *
+ *  Only the object's creator and its descendants may attach it.
+ *
+ *  @param handle The object's handle, from sys_shm_create(...).
+ *  @param addr Where to map the object.
+ *
+ *  @return 0 on success, or a negative integer error code on failure.
+ **/
+int sys_shm_attach(int handle, void *addr)
+{
+  shm_s *shm;
+
+  if ((unsigned int) addr % PAGE_SIZE) return -1;
+
+  shm = shm_lookup(handle);
+  if (!shm) return -1;
+
+  mutex_lock(&curr_tsk->lock);
+
+  /* The handle has to have been granted to us */
+  if (curr_tsk->shm_grants[shm_slot(shm)] != handle
+      || !vm_alloc_shared(&curr_tsk->vmi, addr, shm))
+  {
+    mutex_unlock(&curr_tsk->lock);
+    shm_put(shm);
+    return -1;
+  }
+
+  mutex_unlock(&curr_tsk->lock);
+  return 0;
+}
@@ -11,6 +11,7 @@
 #include <dispatch.h>
 #include <loader.h>
 #include <mutex.h>
+#include <ramfs.h>
 #include <sc_utils.h>
 #include <sched.h>
 #include <ureg.h>
@@ -67,6 +68,9 @@ void sys_halt()
  *  The number of bytes read into buf is returned.  If buf is in invaid
  *  memory, or if file does not exist, an error code is returned.
  *
+ *  The bytes are copied straight from the RAM filesystem into buf; see
+ *  sys_file_pread(...) to avoid looking the file up on every read.
+ *
  *  @param filename The name of the file to read from.
  *  @param buf The buffer to copy file data into.
  *  @param count The number of bytes to copy.
@@ -74,33 +78,15 @@ void sys_halt()
  **/
 int sys_readfile(char *filename, char *buf, int count, int offset)
 {
-  char *filename_k, *buf_k;
-  int copied;
-
-  /* Allocate kernel memory for user arguments */
-  buf_k = malloc(count * sizeof(char));
-  if (!buf_k) return -1;
-
-  /* Copy user arguments */
-  if (copy_from_user(&filename_k, filename, strlen(filename) + 1))
-  {
-    free(buf_k);
-    free(filename_k);
-    return -1;
-  }
+  const ramfs_file_s *file;
 
-  copied = getbytes(filename_k, offset, count, buf_k);
-
-  /* Give it to the user */
-  if (copy_to_user(buf, buf_k, copied)) {
-    free(buf_k);
-    free(filename_k);
+  /* Copy in the name and look the file up */
+  if (copy_str_from_user_static(curr_thr->scratch, filename,
+                                THR_SCRATCH_SIZE) < 0)
     return -1;
-  }
+  if (!(file = ramfs_lookup(curr_thr->scratch))) return -1;
 
-  free(buf_k);
-  free(filename_k);
-  return copied;
+  return ramfs_read(file, buf, count, offset);
 }
 
 /** @brief Register/deregister software exception handlers, and set
@@ -14,7 +14,9 @@
 #include <dispatch.h>
 #include <idt.h>
 #include <sched.h>
+#include <syscall_ext.h>
 #include <syscall_int.h>
+#include <uaccess.h>
 #include <ureg.h>
 #include <util.h>
 #include <vm.h>
@@ -187,9 +189,8 @@ int validate_pc(void *pc)
 
 /** @brief Safely copy data from user-space.
  *
- *  We malloc in order to avoid imposing an artificial restriction on the number
- *  of arguments a user can pass to exec or a filename.  If there is not enough
- *  space, then malloc will fail.
+ *  For copies too big for the running thread's scratch area; if there is
+ *  not enough space, then malloc will fail.
  *
  *  @param dst The destionation pointer.
  *  @param src The (user-space) source pointer.
@@ -199,19 +200,16 @@ int validate_pc(void *pc)
  **/
 int copy_from_user(char **dst, const char *src, size_t bytes)
 {
-  mutex_lock(&curr_tsk->lock);
-
-  if (!vm_find(&curr_tsk->vmi, (void *)src)) {
-    mutex_unlock(&curr_tsk->lock);
-    return -1;
-  }
+  if (!UACCESS_OK(src, bytes)) return -1;
 
   *dst = malloc(bytes);
   if (!*dst) return -1;
 
-  memcpy(*dst, src, bytes);
+  if (uaccess_copy(*dst, src, bytes)) {
+    free(*dst);
+    return -1;
+  }
 
-  mutex_unlock(&curr_tsk->lock);
   return 0;
 }
 
@@ -225,47 +223,33 @@ int copy_from_user(char **dst, const char *src, size_t bytes)
  **/
 int copy_from_user_static(void *dst, void *src, size_t bytes)
 {
-  mutex_lock(&curr_tsk->lock);
-
-  if (!vm_find(&curr_tsk->vmi, src)) {
-    mutex_unlock(&curr_tsk->lock);
-    return -1;
-  }
+  if (!UACCESS_OK(src, bytes)) return -1;
 
-  memcpy(dst, src, bytes);
-
-  mutex_unlock(&curr_tsk->lock);
-
-  return 0;
+  return uaccess_copy(dst, src, bytes) ? -1 : 0;
 }
+
 /** @brief Safely copy data to user-space.
  *
- *  @param dst The destionation pointer.
- *  @param src The (user-space) source pointer.
+ *  Read-only destinations fault (the kernel runs with CR0.WP set), so
+ *  they're caught like unmapped ones.
+ *
+ *  @param dst The (user-space) destionation pointer.
+ *  @param src The source pointer.
  *  @param bytes The number of bytes to copy.
  *
  *  @return 0 on success; a negative integer error code on failure.
  **/
 int copy_to_user(char *dst, const char *src, size_t bytes)
 {
-  unsigned int attrs;
-
-  mutex_lock(&curr_tsk->lock);
+  if (!UACCESS_OK(dst, bytes)) return -1;
 
-  if (vm_get_attrs(&curr_tsk->vmi, dst, &attrs)
-      || !(attrs & VM_ATTR_RDWR))
-  {
-    mutex_unlock(&curr_tsk->lock);
-    return -1;
-  }
-
-  memcpy(dst, src, bytes);
-
-  mutex_unlock(&curr_tsk->lock);
-  return 0;
+  return uaccess_copy(dst, src, bytes) ? -1 : 0;
 }
 
 /** @brief Safely copy a string from user-space.
+ *
+ *  The copy is always NUL-terminated, even if another thread shortens the
+ *  string while we're copying it.
  *
  *  @param dst The destionation pointer.
  *  @param src The (user-space) string pointer.
@@ -275,69 +259,56 @@ int copy_to_user(char *dst, const char *src, size_t bytes)
  **/
 int copy_str_from_user(char **dst, const char *src)
 {
-  size_t len;
+  int len;
 
-  mutex_lock(&curr_tsk->lock);
+  if (!UACCESS_OK(src, 0)) return -1;
 
-  if (!vm_find(&curr_tsk->vmi, (void *)src)) {
-    mutex_unlock(&curr_tsk->lock);
-    return -1;
-  }
+  /* Measure the string; it can't run out of user-space */
+  len = uaccess_strnlen(src, UACCESS_LIMIT - (unsigned int)src);
+  if (len < 0 || (unsigned int)src + len >= UACCESS_LIMIT) return -1;
+  len += 1;
 
-  len = strlen(src) + 1;
   *dst = malloc(len);
   if (!*dst) return -1;
 
-  memcpy(*dst, src, len);
+  if (uaccess_copy(*dst, src, len)) {
+    free(*dst);
+    return -1;
+  }
+  (*dst)[len - 1] = '\0';
 
-  mutex_unlock(&curr_tsk->lock);
   return len;
 }
 
-/** @brief Safely copy a NULL-terminated character array from user-space.
+/** @brief Safely copy a string from user-space into a fixed buffer.
+ *
+ *  Meant for the running thread's scratch area, so short strings like file
+ *  names are copied without touching the heap.
  *
- *  @param dst The destionation array.
- *  @param src The (user-space) array.
+ *  @param dst The destionation buffer.
+ *  @param src The (user-space) string pointer.
+ *  @param max The size of dst.
  *
- *  @return The number of array entries on success; a negative integer
- *  error code on failure.
+ *  @return The length of the string on success; a negative integer error
+ *  code on failure, including if the string doesn't fit in dst.
  **/
-int copy_argv_from_user(char **dst[], char *src[])
+int copy_str_from_user_static(char *dst, const char *src, size_t max)
 {
-  int argc;
-  char **argv;
-  int i, j;
+  size_t lim;
+  int len;
 
-  /* Safely calculate arg vector length */
-  mutex_lock(&curr_tsk->lock);
-  if (!vm_find(&curr_tsk->vmi, (void *)src)) {
-    mutex_unlock(&curr_tsk->lock);
-    return -1;
-  }
-  for (argc = 0; src[argc] != NULL; ++argc) continue;
-  mutex_unlock(&curr_tsk->lock);
+  if (!UACCESS_OK(src, 0)) return -1;
 
-  /* Allocate kernel mem for kernel-side arg vector */
-  argv = malloc((argc + 1) * sizeof(char *));
-  if (!argv) return -1;
-
-  /* Copy each arg from user-space */
-  for (i = 0; i < argc; ++i)
-  {
-    if (copy_str_from_user(&argv[i], src[i]) < 0)
-    {
-      for (j = 0; j < i; ++j) free(argv[j]);
-      free(argv);
-      return -1;
-    }
-  }
+  /* Measure the string; it has to fit, NUL and all */
+  lim = MIN(max, UACCESS_LIMIT - (unsigned int)src);
+  len = uaccess_strnlen(src, lim);
+  if (len < 0 || (size_t)len >= lim) return -1;
+  len += 1;
 
-  /* Null terminate */
-  argv[argc] = NULL;
+  if (uaccess_copy(dst, src, len)) return -1;
+  dst[len - 1] = '\0';
 
-  /* Return kernel argv and argc */
-  *dst = argv;
-  return argc;
+  return len;
 }
 
 /** @brief Installs our system calls.
@@ -361,6 +332,10 @@ void install_sys_handlers(void)
   install_trap_gate(SLEEP_INT , asm_sys_sleep, IDT_USER_DPL);
   install_trap_gate(NEW_PAGES_INT, asm_sys_new_pages, IDT_USER_DPL);
   install_trap_gate(REMOVE_PAGES_INT, asm_sys_remove_pages, IDT_USER_DPL);
+  install_trap_gate(REMAP_PAGES_INT, asm_sys_remap_pages, IDT_USER_DPL);
+  install_trap_gate(PAGE_ADVISE_INT, asm_sys_page_advise, IDT_USER_DPL);
+  install_trap_gate(SHM_CREATE_INT, asm_sys_shm_create, IDT_USER_DPL);
+  install_trap_gate(SHM_ATTACH_INT, asm_sys_shm_attach, IDT_USER_DPL);
   install_trap_gate(GETCHAR_INT, asm_sys_getchar, IDT_USER_DPL);
   install_trap_gate(READLINE_INT, asm_sys_readline, IDT_USER_DPL);
   install_trap_gate(PRINT_INT, asm_sys_print, IDT_USER_DPL);
@@ -369,6 +344,10 @@ void install_sys_handlers(void)
   install_trap_gate(GET_CURSOR_POS_INT, asm_sys_get_cursor_pos, IDT_USER_DPL);
   install_trap_gate(HALT_INT, asm_sys_halt, IDT_USER_DPL);
   install_trap_gate(READFILE_INT, asm_sys_readfile, IDT_USER_DPL);
+  install_trap_gate(FILE_OPEN_INT, asm_sys_file_open, IDT_USER_DPL);
+  install_trap_gate(FILE_PREAD_INT, asm_sys_file_pread, IDT_USER_DPL);
+  install_trap_gate(FILE_CLOSE_INT, asm_sys_file_close, IDT_USER_DPL);
+  install_trap_gate(FILE_MAP_INT, asm_sys_file_map, IDT_USER_DPL);
   install_trap_gate(SWEXN_INT, asm_sys_swexn, IDT_USER_DPL);
   install_trap_gate(MISBEHAVE_INT, asm_sys_misbehave, IDT_USER_DPL);
 
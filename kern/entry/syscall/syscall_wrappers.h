@@ -23,6 +23,10 @@ unsigned int asm_sys_get_ticks(void);
 void asm_sys_sleep(void);
 int asm_sys_new_pages(void);
 int asm_sys_remove_pages(void);
+int asm_sys_remap_pages(void);
+int asm_sys_page_advise(void);
+int asm_sys_shm_create(void);
+int asm_sys_shm_attach(void);
 char asm_sys_getchar(void);
 int asm_sys_readline(void);
 int asm_sys_print(void);
@@ -31,6 +35,10 @@ int asm_sys_set_cursor_pos(void);
 int asm_sys_get_cursor_pos(void);
 void asm_sys_halt(void);
 int asm_sys_readfile(void);
+int asm_sys_file_open(void);
+int asm_sys_file_pread(void);
+int asm_sys_file_close(void);
+int asm_sys_file_map(void);
 void asm_sys_swexn(void);
 void asm_sys_misbehave(void);
 int asm_sys_deschedule(void);
@@ -0,0 +1,46 @@
+/** @file buddy.h
+ *
+ *  @brief Declares the buddy allocator API.
+ *
+ *  @author Enrique Naudon (esn)
+ *  @author Marlies Ruck (mruck)
+ **/
+#ifndef __BUDDY_H__
+#define __BUDDY_H__
+
+#include <x86/page.h>
+
+
+/* Block orders: order n is 2^n contiguous frames */
+#define BUDDY_MAX_ORDER     10
+#define BUDDY_ORDERS        ( BUDDY_MAX_ORDER + 1 )
+#define BUDDY_BLOCK_FRAMES  ( 1 << BUDDY_MAX_ORDER )
+#define BUDDY_BLOCK_SIZE    ( BUDDY_BLOCK_FRAMES * PAGE_SIZE )
+
+/* Fraction of user memory set aside for the buddy allocator; the frame
+ * allocator borrows single frames back from it when it runs dry
+ */
+#define BUDDY_POOL_DIVISOR  4
+
+/** @struct buddy_stats
+ *  @brief Buddy allocator statistics.
+ **/
+struct buddy_stats {
+  unsigned int allocs;                /**< Successful allocations **/
+  unsigned int fails;                 /**< Failed allocations **/
+  unsigned int frees;                 /**< Frees **/
+  unsigned int splits;                /**< Blocks split in two **/
+  unsigned int coalesces;             /**< Buddies merged back together **/
+  unsigned int free_blocks[BUDDY_ORDERS]; /**< Free blocks of each order **/
+};
+typedef struct buddy_stats buddy_stats_s;
+
+
+int buddy_init(void *start, void *limit);
+void *buddy_alloc(int order);
+void buddy_free(void *block, int order);
+void buddy_get_stats(buddy_stats_s *stats);
+void buddy_dump_stats(void);
+
+
+#endif /* __BUDDY_H__ */
@@ -13,5 +13,7 @@ int interrupts_enabled(void);
 void enable_write_protect(void);
 void enable_paging(void);
 void disable_paging(void);
+void enable_pse(void);
+void enable_global_pages(void);
 
 #endif /* __CR_UTIL_H__ */
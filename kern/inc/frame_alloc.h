@@ -8,6 +8,7 @@
 #ifndef __FRAME_ALLOC_H__
 #define __FRAME_ALLOC_H__
 
+#include <cllist.h>
 #include <mutex.h>
 #include <x86/page.h>
 
@@ -16,16 +17,76 @@
 typedef char frame_t[PAGE_SIZE];
 extern const frame_t *frames;
 
+/* Frame magazine sizes */
+#define FR_MAG_SIZE   32
+#define FR_MAG_BATCH  ( FR_MAG_SIZE/2 )
+
+/* Most frames zeroed per pass of the idle loop */
+#define FR_IDLE_BUDGET  4
+
+/** @brief A small cache of free frames in front of the frame allocator.
+ *
+ *  Each thread owns one, so allocating or freeing a frame only takes the
+ *  frame allocator lock when the magazine runs empty or full.  The lock is
+ *  only contended when another thread runs out of memory and pulls the
+ *  magazine's frames back.
+ **/
+struct fr_magazine {
+  int count;                    /**< Number of cached zeroed frames **/
+  void *frames[FR_MAG_SIZE];    /**< The cached zeroed frames **/
+  int ndirty;                   /**< Number of cached dirty frames **/
+  void *dirty[FR_MAG_SIZE];     /**< Freed frames awaiting zeroing **/
+  mutex_s lock;                 /**< Guards the above **/
+  cll_node node;                /**< Link in the list of magazines **/
+};
+typedef struct fr_magazine fr_mag_s;
+
+/** @struct fr_stats
+ *  @brief Frame allocator statistics.
+ **/
+struct fr_stats {
+  unsigned int zeroed;        /**< Frames in the pre-zeroed pool **/
+  unsigned int dirty;         /**< Frames in the dirty pool **/
+  unsigned int zero_hits;     /**< Allocations served pre-zeroed **/
+  unsigned int zero_misses;   /**< Allocations we had to zero on the spot **/
+  unsigned int bg_zeroed;     /**< Frames zeroed while idle **/
+  unsigned int borrowed;      /**< Frames on loan from the buddy pool **/
+};
+typedef struct fr_stats fr_stats_s;
+
 /* Serialize access to the frame allocator */
 extern mutex_s frame_allocator_lock;
 
-/* Number of available free frames */
+/* Number of free frames, including those cached in magazines */
 extern int fr_avail;
 
 /* Frame allocator API */
 void fr_init_allocator(void);
-void *fr_retrieve_head(void);
-void fr_update_head(void *frame);
+
+/* Frame reference counting */
+void fr_ref(void *frame);
+int fr_unref(void *frame);
+int fr_refcnt(void *frame);
+
+/* Batched allocation */
+int fr_alloc_batch(void **frames, int n);
+void fr_free_batch(void **frames, int n, int zeroed);
+
+/* Contiguous blocks */
+void *fr_alloc_block(int order);
+void fr_free_block(void *block, int order);
+
+/* Background zeroing */
+int fr_zero_idle(int budget);
+void fr_get_stats(fr_stats_s *dst);
+void fr_dump_stats(void);
+
+/* Frame magazines */
+void fr_mag_init(fr_mag_s *mag);
+void fr_mag_drain(fr_mag_s *mag);
+void fr_mag_final(fr_mag_s *mag);
+void *fr_alloc(fr_mag_s *mag);
+void fr_free(fr_mag_s *mag, void *frame);
 
 
 #endif /* __FRAME_ALLOC_H__ */
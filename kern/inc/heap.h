@@ -0,0 +1,55 @@
+/** @file heap.h
+ *
+ *  @brief Declares the kernel heap's tunables and statistics.
+ *
+ *  The allocation entry points themselves are the usual ones in malloc.h.
+ *
+ *  @author Enrique Naudon (esn)
+ *  @author Marlies Ruck (mruck)
+ **/
+#ifndef __HEAP_H__
+#define __HEAP_H__
+
+
+/* Size classes run from HEAP_MIN_CLASS to HEAP_MAX_CLASS bytes, doubling;
+ * anything bigger goes to the general allocator */
+#define HEAP_MIN_SHIFT  4
+#define HEAP_MIN_CLASS  ( 1 << HEAP_MIN_SHIFT )
+#define HEAP_MAX_CLASS  2048
+#define HEAP_NCLASSES   8
+
+/* Most pages a class may carve up, since class pages are never given
+ * back; past this, the class's requests go to the general allocator */
+#define HEAP_CLASS_MAX_PAGES  64
+
+/** @struct heap_class_stats
+ *  @brief Statistics for one size class.
+ **/
+struct heap_class_stats {
+  unsigned int size;        /**< Object size **/
+  unsigned int pages;       /**< Pages carved into objects **/
+  unsigned int inuse;       /**< Objects currently allocated **/
+  unsigned int peak;        /**< Most objects ever allocated at once **/
+  unsigned int allocs;      /**< Objects handed out **/
+  unsigned long long req_bytes; /**< Bytes asked for by those allocs **/
+  unsigned int spills;      /**< Requests sent on to the general allocator **/
+};
+typedef struct heap_class_stats heap_class_stats_s;
+
+/** @struct heap_stats
+ *  @brief Kernel heap statistics.
+ **/
+struct heap_stats {
+  heap_class_stats_s classes[HEAP_NCLASSES];  /**< Per-class counters **/
+  unsigned int large;       /**< Large blocks currently allocated **/
+  unsigned int large_peak;  /**< Most large blocks allocated at once **/
+  unsigned int large_allocs;  /**< Large blocks handed out **/
+};
+typedef struct heap_stats heap_stats_s;
+
+
+void heap_get_stats(heap_stats_s *stats);
+void heap_dump_stats(void);
+
+
+#endif /* __HEAP_H__ */
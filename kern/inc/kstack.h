@@ -0,0 +1,50 @@
+/** @file kstack.h
+ *
+ *  @brief Declares the kernel stack pool API.
+ *
+ *  @author Enrique Naudon (esn)
+ *  @author Marlies Ruck (mruck)
+ **/
+#ifndef __KSTACK_H__
+#define __KSTACK_H__
+
+#include <x86/page.h>
+
+
+/* Pages per kernel stack */
+#define KSTACK_PAGES  2
+#define KSTACK_SIZE   ( KSTACK_PAGES * PAGE_SIZE )
+
+/* Stacks with an unmapped guard page below them, reserved at boot; once
+ * they're all in use, further stacks come from the heap unguarded */
+#define KSTACK_GUARDED  64
+
+/* Most freed heap stacks we keep around for reuse */
+#define KSTACK_POOL_HWM 16
+
+/* Written at the bottom of every stack, and checked when it's freed */
+#define KSTACK_CANARY 0x57ACC0DE
+
+/** @struct kstack_stats
+ *  @brief Kernel stack pool statistics.
+ **/
+struct kstack_stats {
+  unsigned int inuse;       /**< Stacks currently allocated **/
+  unsigned int peak;        /**< Most stacks ever allocated at once **/
+  unsigned int allocs;      /**< Stacks handed out **/
+  unsigned int recycled;    /**< ...of which were reused from the pool **/
+  unsigned int heap;        /**< ...of which came fresh from the heap **/
+  unsigned int carved;      /**< Guarded stacks set up so far **/
+  unsigned int pooled;      /**< Heap stacks currently pooled **/
+};
+typedef struct kstack_stats kstack_stats_s;
+
+
+void kstack_init(void);
+char *kstack_alloc(void);
+void kstack_free(char *kstack);
+void kstack_get_stats(kstack_stats_s *stats);
+void kstack_dump_stats(void);
+
+
+#endif /* __KSTACK_H__ */
@@ -0,0 +1,29 @@
+/** @file lz.h
+ *
+ *  @brief Declares a small LZ77 codec.
+ *
+ *  @author Enrique Naudon (esn)
+ *  @author Marlies Ruck (mruck)
+ **/
+#ifndef __LZ_H__
+#define __LZ_H__
+
+/* Hash table entries (and so bytes / 2) of compression workspace */
+#define LZ_HASH_BITS  12
+#define LZ_HASH_SIZE  ( 1 << LZ_HASH_BITS )
+#define LZ_WORK_SIZE  ( LZ_HASH_SIZE * sizeof(unsigned short) )
+
+/* Matches are 3 to 18 bytes long, at most 4095 bytes back */
+#define LZ_MIN_MATCH  3
+#define LZ_MAX_MATCH  ( LZ_MIN_MATCH + 15 )
+#define LZ_MAX_OFFSET 4095
+
+/* Longest input we'll compress (positions are kept in shorts) */
+#define LZ_MAX_INPUT  65535
+
+int lz_compress(const unsigned char *src, int len, unsigned char *dst,
+                int cap, void *work);
+int lz_decompress(const unsigned char *src, int len, unsigned char *dst,
+                  int cap);
+
+#endif /* __LZ_H__ */
@@ -9,8 +9,21 @@
 #define __MREG_H__
 
 #include <cllist.h>
+#include <exec2obj.h>
 #include <page_alloc.h>
 
+/* Most file extents one region maps (text and rodata share a region) */
+#define MREG_FILE_EXTENTS 2
+
+/** @struct file_extent
+ *  @brief A run of a region's bytes that come from its file.
+ **/
+struct file_extent {
+  void *start;          /**< Where the bytes go **/
+  int off;              /**< Where they come from in the file **/
+  int len;              /**< How many bytes there are **/
+};
+typedef struct file_extent file_extent_s;
 
 /** @struct mem_region
  *  @brief A contiguous region in memory.
@@ -20,17 +33,46 @@ struct mem_region {
   void *limit;          /**< The last byte in the region **/
   unsigned int attrs;   /**< Attributes for the region **/
   cll_node node;
+  struct mem_region *left;    /**< Regions below us in the map's tree **/
+  struct mem_region *right;   /**< Regions above us in the map's tree **/
+  int height;                 /**< Height of our subtree **/
+  const exec2obj_userapp_TOC_entry *file; /**< Backing file, if any **/
+  int nexts;                              /**< Extents in use **/
+  file_extent_s exts[MREG_FILE_EXTENTS];  /**< Parts backed by the file **/
+  struct shm *shm;      /**< Shared memory object mapped, if any **/
+  void *fa_next;        /**< Where a sequential walk faults next **/
+  int fa_window;        /**< Pages the last fault filled in **/
 };
 typedef struct mem_region mem_region_s;
 
+/** @struct mem_map
+ *  @brief A task's memory map.
+ *
+ *  Regions never overlap, so an AVL tree keyed on each region's start
+ *  address answers both point and range queries.  The regions are also
+ *  kept on a list in address order, for traversal and for finding a
+ *  region's neighbors.
+ **/
+struct mem_map {
+  cll_list list;                /**< Regions in address order **/
+  mem_region_s *root;           /**< Root of the region tree **/
+  mem_region_s *volatile hint;  /**< The last region looked up **/
+};
+typedef struct mem_map mem_map_s;
+
 
+mem_region_s *mreg_alloc(void);
+void mreg_free(mem_region_s *mreg);
 void mreg_init(mem_region_s *mreg, void *start, void *limit, unsigned int attrs);
-int mreg_insert(cll_list *map, mem_region_s *new);
-mem_region_s *mreg_lookup(cll_list *map, mem_region_s *targ);
-mem_region_s *mreg_prev(cll_list *map, mem_region_s *targ);
-mem_region_s *mreg_next(cll_list *map, mem_region_s *targ);
-mem_region_s *mreg_extract(cll_list *map, mem_region_s *targ);
+void mreg_map_init(mem_map_s *map);
+int mreg_insert(mem_map_s *map, mem_region_s *new);
+mem_region_s *mreg_lookup(mem_map_s *map, mem_region_s *targ);
+mem_region_s *mreg_find(mem_map_s *map, void *addr);
+mem_region_s *mreg_prev(mem_map_s *map, mem_region_s *targ);
+mem_region_s *mreg_next(mem_map_s *map, mem_region_s *targ);
+mem_region_s *mreg_extract(mem_map_s *map, mem_region_s *targ);
+mem_region_s *mreg_coalesce(mem_map_s *map, mem_region_s *mreg,
+                            unsigned int nomerge);
 
 
 #endif /* __MREG_H__ */
-
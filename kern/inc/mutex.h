@@ -49,6 +49,7 @@ typedef struct mutex mutex_s;
 int mutex_init(mutex_s *mp);
 void mutex_final(mutex_s *mp);
 void mutex_lock(mutex_s *mp);
+int mutex_trylock(mutex_s *mp);
 void mutex_unlock(mutex_s *mp);
 void mutex_unlock_and_block(mutex_s *mp);
 
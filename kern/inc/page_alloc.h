@@ -10,6 +10,9 @@
 
 #include <pg_table.h>
 
+struct tlb_batch;
+struct mem_region;
+
 
 /** @struct page_info
  *  @brief Information used by the page allocator.
@@ -20,14 +23,42 @@ struct page_info {
 };
 typedef struct page_info pg_info_s;
 
+/* Page fault error code bits set for writes, and for faults in user mode */
+#define PG_FAULT_WRITE 0x002
+#define PG_FAULT_USER  0x004
+
+/* Most freed page tables we keep around for reuse */
+#define PG_TBL_CACHE_HWM 64
+
 int pg_init_allocator(void);
 
 /* Page stuff */
 void *pg_alloc(pg_info_s *pgi, void *vaddr, unsigned int attrs);
-void pg_free(pg_info_s *pgi, void *vaddr);
-int pg_set_attrs(pg_info_s *pgi, void *vaddr, unsigned int attrs);
-int pg_copy(pg_info_s *dst, pg_info_s *src, void *vaddr, void *buf);
-int pg_page_fault_handler(void *addr);
+void pg_free(pg_info_s *pgi, void *vaddr, struct tlb_batch *tlb);
+int pg_set_attrs(pg_info_s *pgi, void *vaddr, unsigned int attrs,
+                 struct tlb_batch *tlb);
+int pg_copy(pg_info_s *dst, pg_info_s *src, void *vaddr,
+            struct tlb_batch *tlb);
+int pg_move(pg_info_s *pgi, void *dst, void *src, struct tlb_batch *tlb);
+int pg_present(pg_info_s *pgi, void *vaddr);
+int pg_resident(pg_info_s *pgi, void *vaddr);
+int pg_swapped(pg_info_s *pgi, void *vaddr);
+int pg_swap_out(pg_info_s *pgi, void *vaddr, struct tlb_batch *tlb);
+int pg_swap_in(pg_info_s *pgi, void *vaddr, unsigned int attrs);
+int pg_back_zfod(pg_info_s *pgi, void *vaddr, int npages,
+                 unsigned int attrs);
+void *pg_page_in(pg_info_s *pgi, void *vaddr, const struct mem_region *mreg);
+void *pg_map_frame(pg_info_s *pgi, void *vaddr, void *frame,
+                   unsigned int attrs);
+int pg_page_fault_handler(void *addr, unsigned int error_code);
+
+/* Large page stuff */
+void *pg_alloc_large(pg_info_s *pgi, void *vaddr, unsigned int attrs);
+void pg_free_large(pg_info_s *pgi, void *vaddr);
+int pg_copy_large(pg_info_s *dst, pg_info_s *src, void *vaddr);
+
+/* Frame stuff */
+void free_frame(void *frame);
 
 /* Page table stuff */
 void pg_free_table(pg_info_s *pgi, void *vaddr);
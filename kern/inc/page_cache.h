@@ -0,0 +1,49 @@
+/** @file page_cache.h
+ *
+ *  @brief Declares the executable page cache API.
+ *
+ *  @author Enrique Naudon (esn)
+ *  @author Marlies Ruck (mruck)
+ **/
+#ifndef __PAGE_CACHE_H__
+#define __PAGE_CACHE_H__
+
+#include <exec2obj.h>
+
+
+/* Hash buckets in each of the cache's two tables */
+#define PC_BUCKETS 256
+
+/** @struct pc_entry
+ *  @brief A read-only executable page shared by every task running it.
+ **/
+struct pc_entry {
+  const exec2obj_userapp_TOC_entry *file;   /**< The executable **/
+  void *vaddr;                              /**< The page's address **/
+  void *frame;                              /**< The frame backing it **/
+  struct pc_entry *key_next;    /**< Next entry in our key bucket **/
+  struct pc_entry *frame_next;  /**< Next entry in our frame bucket **/
+};
+typedef struct pc_entry pc_entry_s;
+
+/** @struct pc_stats
+ *  @brief Page cache statistics.
+ **/
+struct pc_stats {
+  unsigned int entries;     /**< Pages currently cached **/
+  unsigned int hits;        /**< Page-ins satisfied by the cache **/
+  unsigned int misses;      /**< Page-ins that read the file **/
+  unsigned int evictions;   /**< Pages dropped with their last mapping **/
+};
+typedef struct pc_stats pc_stats_s;
+
+
+void *pc_get(const exec2obj_userapp_TOC_entry *file, void *vaddr);
+void *pc_insert(const exec2obj_userapp_TOC_entry *file, void *vaddr,
+                void *frame);
+int pc_put(void *frame);
+void pc_get_stats(pc_stats_s *stats);
+void pc_dump_stats(void);
+
+
+#endif /* __PAGE_CACHE_H__ */
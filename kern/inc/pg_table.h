@@ -7,6 +7,7 @@
 #define __PG_TABLE_H__
 
 #include <common_kern.h>
+#include <stddef.h>
 #include <x86/page.h>
 
 
@@ -24,8 +25,20 @@
 #define PG_TBL_ACCESSED 0x020   /**< Set by HW on reference **/
 #define PG_TBL_DIRTY    0x040   /**< Set by HW on write **/
 #define PG_TBL_ATTR     0x080   /**< No idea; should be unset **/
+#define PG_DIR_PSE      0x080   /**< In a PDE, set maps a 4MB page **/
 #define PG_TBL_GLOBAL   0x100   /**< Set stops TLB flush on ctx switch **/
 #define PG_TBL_ZFOD     0x200   /**< Set indicates ZFOD pages **/
+#define PG_TBL_COW      0x400   /**< Set indicates copy-on-write pages **/
+#define PG_TBL_CACHED   0x800   /**< Set indicates page cache frames **/
+
+/* A not-present PTE with PG_TBL_SWAPPED set holds a compressed page's slot
+ * in its address bits instead of a frame
+ */
+#define PG_TBL_SWAPPED  0x800   /**< Set in swapped-out PTEs **/
+#define SWAP_PTE(slot)  ( ((pte_t)(slot) << PG_TBL_SHIFT) | PG_TBL_SWAPPED )
+#define IS_SWAP_PTE(pte)  \
+  ( !((pte) & PG_TBL_PRESENT) && ((pte) & PG_TBL_SWAPPED) )
+#define SWAP_SLOT(pte)  ( (int)((pte) >> PG_TBL_SHIFT) )
 #define PG_TBL_AVAIL    0xE00   /**< Available for programmer use **/
 
 /* Page table masks */
@@ -85,6 +98,7 @@
 
 #define KERN_PD_ENTRIES PG_DIR_INDEX(USER_MEM_START)
 #define KERN_PTE_ATTRS ( PG_TBL_PRESENT | PG_TBL_WRITABLE | PG_TBL_GLOBAL )
+#define KERN_PSE_ATTRS ( KERN_PTE_ATTRS | PG_DIR_PSE )
 
 typedef unsigned int pte_t;
 
@@ -104,11 +118,33 @@ extern tome_t *tomes;
 #define PG_SELFREF_INDEX (PG_TBL_ENTRIES - 1)
 #define PG_TBL_ADDR ( (pt_t *)tomes[PG_SELFREF_INDEX] )
 
+/** @enum kern_window
+ *  @brief Kernel pages that can be pointed at arbitrary frames.
+ *
+ *  Each window belongs to one user, who is responsible for serializing
+ *  access to it.
+ **/
+enum kern_window {
+  KWIN_FRAME_ALLOC,   /**< Zeroing free frames; under frame_allocator_lock **/
+  KWIN_COPY,          /**< Copying/zeroing frames in the page allocator **/
+  KWIN_ZSWAP,         /**< Compressing/decompressing frames; under zs_lock **/
+  KWIN_STAGE,         /**< Staging exec(...) arguments; under stage_lock **/
+  KWIN_COUNT,
+};
+typedef enum kern_window kwin_e;
+
 /* Stuff that shouldn't be here */
+void *kern_reserve_fine(size_t len);
 void init_kern_pt(void);
+void kern_unmap_page(void *vaddr);
+void *kwin_map(kwin_e win, void *frame);
+
+/* Most freed page directories we keep around for reuse */
+#define PG_DIR_CACHE_HWM 16
 
 /* Page directory operations */
 pte_t *pd_init(void);
+void pd_free(pte_t *pd);
 int get_pde(pte_t *pd, void *addr, pte_t *dst);
 void set_pde(pte_t *pd, void *addr, pte_t *pt);
 
@@ -116,7 +152,21 @@ void set_pde(pte_t *pd, void *addr, pte_t *pt);
 void init_pt(pte_t *pt);
 void init_pte(pte_t *pte, void *frame);
 int get_pte(pte_t *pd, pt_t *pt, void *addr, pte_t *dst);
+int peek_pte(pte_t *pd, pt_t *pt, void *addr, pte_t *dst);
 int set_pte(pte_t *pd, pt_t *pt, void *addr, pte_t *pte);
 
+/** @brief Called by walk_ptes(...) with each run of in-use entries.
+ *
+ *  @param addr The run's first page.
+ *  @param npages The number of pages in the run.
+ *  @param arg The walker's argument.
+ *
+ *  @return 0 to keep walking; anything else stops the walk.
+ **/
+typedef int (*pte_run_fn)(void *addr, int npages, void *arg);
+
+int walk_ptes(pte_t *pd, pt_t *pt, void *lo, void *hi, pte_run_fn fn,
+              void *arg);
+
 #endif /* __PG_TABLE_H__ */
 
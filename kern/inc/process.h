@@ -17,6 +17,7 @@
 #include <cllist.h>
 #include <mutex.h>
 #include <cvar.h>
+#include <ramfs.h>
 
 /* Libc specific includes */
 #include <stdint.h>
@@ -44,6 +45,8 @@ struct task {
                              wait should block */
   mutex_s  lock;          /* Hold this lock when modifying the task struct */
   char *execname;          /* For simics and debugging in general */
+  const ramfs_file_s *files[RAMFS_MAX_FDS]; /* Open files, by descriptor */
+  int shm_grants[SHM_MAX]; /* Handles we may attach, by object slot */
 };
 typedef struct task task_t;
 
@@ -95,6 +98,7 @@ void task_del_child(task_t *parent, task_t *child);
 void task_free(task_t *task);
 void task_final(task_t *victim);
 int task_reap(task_t *task, int *status);
+void task_free_mini(mini_pcb_s *mini);
 
 /* Task list manipulation routines */
 void tasklist_add(task_t *t);
@@ -0,0 +1,31 @@
+/** @file ramfs.h
+ *
+ *  @brief Declares the RAM filesystem API.
+ *
+ *  The filesystem is the table of contents exec2obj builds into the kernel
+ *  image, so files are read-only and live forever.
+ *
+ *  @author Enrique Naudon (esn)
+ *  @author Marlies Ruck (mruck)
+ **/
+#ifndef __RAMFS_H__
+#define __RAMFS_H__
+
+#include <exec2obj.h>
+
+
+/* Buckets in the name index */
+#define RAMFS_BUCKETS   64
+
+/* Files a task may have open at once */
+#define RAMFS_MAX_FDS   16
+
+typedef exec2obj_userapp_TOC_entry ramfs_file_s;
+
+
+void ramfs_init(void);
+const ramfs_file_s *ramfs_lookup(const char *name);
+int ramfs_read(const ramfs_file_s *file, char *buf, int count, int offset);
+
+
+#endif /* __RAMFS_H__ */
@@ -0,0 +1,48 @@
+/** @file rwlock.h
+ *
+ *  @brief This file defines the type for readers/writer locks.
+ *
+ *  @author Enrique Naudon (esn)
+ *  @author Marlies Ruck (mruck)
+ *
+ *  @bug No known bugs
+ */
+
+#ifndef __RWLOCK_H__
+#define __RWLOCK_H__
+
+#include <cvar.h>
+#include <mutex.h>
+
+/** @enum rwlock_mode
+ *  @brief The ways a readers/writer lock can be held.
+ **/
+enum rwlock_mode {
+  RWLOCK_READ,        /**< Shared with other readers **/
+  RWLOCK_WRITE,       /**< Exclusive **/
+};
+typedef enum rwlock_mode rwlock_mode_e;
+
+/** @struct rwlock
+ *  @brief A readers/writer lock.
+ *
+ *  Writers are preferred: once one is waiting, new readers wait behind it.
+ *  So a reader must never try to take the lock again while it holds it.
+ **/
+struct rwlock {
+  mutex_s lock;       /**< Protects the fields below **/
+  cvar_s readers;     /**< Where readers wait for writers **/
+  cvar_s writers;     /**< Where writers wait for everyone **/
+  int nreaders;       /**< Number of readers holding the lock **/
+  int nwriters;       /**< Number of writers waiting for the lock **/
+  int writer;         /**< TID of the writer holding the lock (-1 = none) **/
+};
+typedef struct rwlock rwlock_s;
+
+/* Readers/writer lock operations */
+int rwlock_init(rwlock_s *rw);
+void rwlock_final(rwlock_s *rw);
+void rwlock_lock(rwlock_s *rw, rwlock_mode_e mode);
+void rwlock_unlock(rwlock_s *rw);
+
+#endif /* __RWLOCK_H__ */
@@ -65,7 +65,7 @@ int copy_from_user(char **dst, const char *src, size_t bytes);
 int copy_to_user(char *dst, const char *src, size_t bytes);
 int copy_from_user_static(void *dst, void *src, size_t bytes);
 int copy_str_from_user(char **dst, const char *src);
-int copy_argv_from_user(char **dst[], char *src[]);
+int copy_str_from_user_static(char *dst, const char *src, size_t max);
 void install_sys_handlers(void);
 int sc_validate_argp(void *argp, int arity);
 
@@ -17,6 +17,9 @@
 thread_t *curr_thr;
 task_t *curr_tsk;
 
+/* The idle thread */
+thread_t *idle_thr;
+
 /* Scheduling API */
 void sched_unblock(thread_t *thr);
 void sched_block(thread_t *thr);
@@ -0,0 +1,55 @@
+/** @file shm.h
+ *
+ *  @brief Declares the shared memory object API.
+ *
+ *  @author Enrique Naudon (esn)
+ *  @author Marlies Ruck (mruck)
+ **/
+#ifndef __SHM_H__
+#define __SHM_H__
+
+
+/* Most objects that may exist at once, and most pages in each */
+#define SHM_MAX         64
+#define SHM_MAX_PAGES   1024
+
+/** @struct shm
+ *  @brief A shared memory object.
+ *
+ *  Each mapping of the object holds a reference to it, so it lives until
+ *  its last region is freed.  Frames are allocated as the object's pages
+ *  are first touched, and the object holds a frame reference of its own
+ *  on each, on top of those held by the PTEs mapping it.
+ **/
+struct shm {
+  int handle;           /**< What user-space calls it; 0 if the slot's free **/
+  int refs;             /**< Regions mapping the object **/
+  int npages;           /**< The object's size **/
+  void **frames;        /**< Each page's frame, or NULL if untouched **/
+};
+typedef struct shm shm_s;
+
+/** @struct shm_stats
+ *  @brief Shared memory statistics.
+ **/
+struct shm_stats {
+  unsigned int objects;     /**< Objects currently alive **/
+  unsigned int peak;        /**< Most objects ever alive at once **/
+  unsigned int frames;      /**< Frames currently held by objects **/
+  unsigned int creates;     /**< Objects created **/
+  unsigned int attaches;    /**< Objects looked up by handle **/
+};
+typedef struct shm_stats shm_stats_s;
+
+
+shm_s *shm_create(int npages);
+shm_s *shm_lookup(int handle);
+int shm_slot(const shm_s *shm);
+void shm_ref(shm_s *shm);
+void shm_put(shm_s *shm);
+void *shm_frame(shm_s *shm, int idx);
+void shm_get_stats(shm_stats_s *stats);
+void shm_dump_stats(void);
+
+
+#endif /* __SHM_H__ */
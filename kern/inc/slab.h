@@ -0,0 +1,86 @@
+/** @file slab.h
+ *
+ *  @brief Declares the slab allocator API.
+ *
+ *  @author Enrique Naudon (esn)
+ *  @author Marlies Ruck (mruck)
+ **/
+#ifndef __SLAB_H__
+#define __SLAB_H__
+
+#include <cllist.h>
+#include <mutex.h>
+#include <stddef.h>
+
+
+/* We grow slabs (by doubling, up to SLAB_MAX_PAGES pages) until they hold
+ * at least SLAB_MIN_OBJS objects */
+#define SLAB_MIN_OBJS   8
+#define SLAB_MAX_PAGES  4
+
+/* Empty slabs a cache keeps around rather than handing back to the heap */
+#define SLAB_MAX_EMPTY  1
+
+/** @struct slab_stats
+ *  @brief Per-cache statistics.
+ **/
+struct slab_stats {
+  unsigned int active;    /**< Objects currently allocated **/
+  unsigned int slabs;     /**< Slabs currently held **/
+  unsigned int allocs;    /**< Objects handed out **/
+  unsigned int frees;     /**< Objects handed back **/
+  unsigned int grows;     /**< Slabs taken from the heap **/
+  unsigned int shrinks;   /**< Slabs given back to the heap **/
+  unsigned int ctors;     /**< Constructor calls **/
+};
+typedef struct slab_stats slab_stats_s;
+
+/** @struct slab_cache
+ *  @brief A cache of same-sized objects.
+ *
+ *  Objects are carved out of slabs, page-aligned chunks of the kernel heap,
+ *  and only the slabs themselves go through malloc's lock.  The constructor
+ *  (if any) runs once per object, when its slab is carved; objects must be
+ *  handed back to slab_free(...) in their constructed state.
+ **/
+struct slab_cache {
+  const char *name;             /**< For the stats dump **/
+  size_t size;                  /**< Object size **/
+  void (*ctor)(void *obj);      /**< Object constructor, or NULL **/
+  size_t slab_size;             /**< Bytes per slab (0 until first grow) **/
+  unsigned int per_slab;        /**< Objects per slab **/
+  mutex_s lock;                 /**< Protects the fields below **/
+  cll_list partial;             /**< Slabs with free objects **/
+  unsigned int nempty;          /**< Slabs with no objects in use **/
+  slab_stats_s stats;           /**< Counters **/
+};
+typedef struct slab_cache slab_cache_s;
+
+/** @brief Statically initialize a slab cache.
+ *
+ *  @param var The name you've given the cache variable.
+ *  @param tp The type of the cache's objects.
+ *  @param ctor_fn The object constructor, or NULL.
+ *
+ *  @return A slab cache.
+ **/
+#define SLAB_CACHE_INITIALIZER(var,tp,ctor_fn) {      \
+  .name = #var,                                       \
+  .size = sizeof(tp),                                 \
+  .ctor = (ctor_fn),                                  \
+  .slab_size = 0,                                     \
+  .per_slab = 0,                                      \
+  .lock = MUTEX_INITIALIZER(var.lock),                \
+  .partial = CLL_LIST_INITIALIZER(var.partial),       \
+  .nempty = 0,                                        \
+  .stats = { 0 }                                      \
+}
+
+
+void *slab_alloc(slab_cache_s *cache);
+void slab_free(slab_cache_s *cache, void *obj);
+void slab_get_stats(slab_cache_s *cache, slab_stats_s *stats);
+void slab_dump_stats(slab_cache_s *cache);
+
+
+#endif /* __SLAB_H__ */
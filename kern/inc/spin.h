@@ -37,6 +37,7 @@ typedef struct spin_lock spin_s;
 /* Spinlock operations */
 inline void spin_init(spin_s *sp);
 inline void spin_lock(spin_s *sp);
+inline int spin_trylock(spin_s *sp);
 inline void spin_unlock(spin_s *sp);
 inline void spin_unlock_and_block(spin_s *sp);
 
@@ -12,6 +12,8 @@
 
 /* Pebble includes */
 #include <cllist.h>
+#include <frame_alloc.h>
+#include <kstack.h>
 #include <mutex.h>
 #include <process.h>
 #include <queue.h>
@@ -23,8 +25,8 @@
 #include <stdint.h>
 
 
-#define KSTACK_SIZE   PAGE_SIZE
-#define KSTACK_ALIGN  4
+/* Bytes of per-thread scratch space for staging syscall arguments */
+#define THR_SCRATCH_SIZE 512
 
 /** @enum thread_state
  *  @brief Flag values for thread state.
@@ -60,6 +62,9 @@ struct thread {
   void *pc;
   swexn_t swexn;
   char *kstack;
+  fr_mag_s frmag; /* Frames cached in front of the frame allocator */
+  char scratch[THR_SCRATCH_SIZE]; /* Syscall argument staging; a thread
+                                   * is only ever in one syscall at once */
 };
 typedef struct thread thread_t;
 
@@ -13,9 +13,67 @@
 
 #include <page_alloc.h>
 
+/* Queued pages past which we reload CR3 instead of issuing invlpg's */
+#define TLB_FLUSH_THRESHOLD 32
+
+/* Disjoint ranges and deferred frames a batch holds */
+#define TLB_BATCH_RANGES 8
+#define TLB_BATCH_FRAMES 32
+
+/** @struct tlb_range
+ *  @brief A run of contiguous pages awaiting invalidation.
+ **/
+struct tlb_range {
+  void *start;              /**< First page in the run **/
+  int npages;               /**< Pages in the run **/
+};
+typedef struct tlb_range tlb_range_s;
+
+/** @struct tlb_batch
+ *  @brief Invalidations (and the frames waiting on them) to be done at once.
+ *
+ *  Frames unmapped under a batch aren't freed until the batch commits;
+ *  until then a stale TLB entry might still point at them.
+ **/
+struct tlb_batch {
+  int npages;                             /**< Pages queued **/
+  int nranges;                            /**< Ranges in use **/
+  int overflow;                           /**< Ran out of ranges **/
+  tlb_range_s ranges[TLB_BATCH_RANGES];   /**< Queued ranges **/
+  int nframes;                            /**< Frames deferred **/
+  void *frames[TLB_BATCH_FRAMES];         /**< Frames to free on commit **/
+};
+typedef struct tlb_batch tlb_batch_s;
+
+/** @struct tlb_stats
+ *  @brief TLB invalidation counters.
+ **/
+struct tlb_stats {
+  unsigned int commits;       /**< Batches committed **/
+  unsigned int invlpgs;       /**< Single-page invalidations issued **/
+  unsigned int full_flushes;  /**< CR3 reloads issued **/
+  unsigned int saved;         /**< invlpg's avoided by full flushes **/
+};
+typedef struct tlb_stats tlb_stats_s;
+
+/* Tunable; defaults to TLB_FLUSH_THRESHOLD */
+extern int tlb_flush_threshold;
+
 void tlb_inval_page(void *pg);
+void tlb_flush_all(void);
 void tlb_inval_tome(void *pt);
 void tlb_inval_pde(pg_info_s *pgi, void *vaddr);
 
+/* Batches */
+void tlb_batch_init(tlb_batch_s *batch);
+void tlb_batch_page(tlb_batch_s *batch, void *vaddr);
+void tlb_batch_range(tlb_batch_s *batch, void *start, int npages);
+void tlb_batch_defer_free(tlb_batch_s *batch, void *frame);
+void tlb_batch_commit(tlb_batch_s *batch);
+
+/* Stats */
+void tlb_get_stats(tlb_stats_s *stats);
+void tlb_dump_stats(void);
+
 
 #endif /* __TLB_H__ */
@@ -0,0 +1,13 @@
+/** @file tsc.h
+ *
+ *  @brief Provides a C declaration for reading the time stamp counter.
+ *
+ *  @author Enrique Naudon (esn)
+ *  @author Marlies Ruck (mruck)
+ **/
+#ifndef __TSC_H__
+#define __TSC_H__
+
+unsigned long long read_tsc(void);
+
+#endif /* __TSC_H__ */
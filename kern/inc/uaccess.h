@@ -0,0 +1,59 @@
+/** @file uaccess.h
+ *
+ *  @brief Declares the user memory access primitives.
+ *
+ *  The primitives touch user memory directly, without checking that it's
+ *  mapped; if they fault on an address no region covers, the page fault
+ *  handler resumes them at a fixup listed in the exception table, and
+ *  they report failure.  So all a caller has to check up front is that
+ *  the range is in user-space, which UACCESS_OK(...) does.
+ *
+ *  Their faults are handled like user faults, under the map lock (see
+ *  pg_page_fault_handler(...)), so the primitives may not be used while it
+ *  is held.  Other locks, like the task lock, are fine.
+ *
+ *  @author Enrique Naudon (esn)
+ *  @author Marlies Ruck (mruck)
+ **/
+#ifndef __UACCESS_H__
+#define __UACCESS_H__
+
+#include <common_kern.h>
+#include <pg_table.h>
+#include <stddef.h>
+
+
+/* User-space ends where the top of the user stack does */
+#define UACCESS_LIMIT ( (unsigned int)tomes[PG_TBL_ENTRIES - 2] )
+
+/** @brief Checks that a range lies entirely within user-space.
+ *
+ *  @param addr The range's start.
+ *  @param len The range's length in bytes.
+ *
+ *  @return Nonzero if it does; 0 otherwise.
+ **/
+#define UACCESS_OK(addr,len)                                        \
+  ( (unsigned int)(addr) >= USER_MEM_START                          \
+    && (unsigned int)(addr) <= UACCESS_LIMIT                        \
+    && (size_t)(len) <= UACCESS_LIMIT - (unsigned int)(addr) )
+
+/** @struct ex_entry
+ *  @brief An exception table entry.
+ **/
+struct ex_entry {
+  unsigned int insn;      /**< An instruction that may fault **/
+  unsigned int fixup;     /**< Where to resume if it does **/
+};
+typedef struct ex_entry ex_entry_s;
+
+/* The exception table's bounds (see uaccess.S) */
+extern const ex_entry_s ex_table_start[];
+extern const ex_entry_s ex_table_end[];
+
+
+size_t uaccess_copy(void *dst, const void *src, size_t len);
+int uaccess_strnlen(const char *str, size_t max);
+
+
+#endif /* __UACCESS_H__ */
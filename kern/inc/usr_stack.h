@@ -19,7 +19,21 @@
 #define USR_STACK_SIZE ( PAGE_SIZE * PG_TBL_ENTRIES )
 #define USR_SP_HI ( (void *)tomes[PG_TBL_ENTRIES - 2] )
 
-void *usr_stack_init(vm_info_s *vmi, int arg_cnt, char **arg_vec);
+/** @struct usr_stage
+ *  @brief A new stack's top page, with the program's arguments staged in it.
+ *
+ *  Addresses are where things will be once the page is mapped.
+ **/
+struct usr_stage {
+  void *frame;        /**< The page's frame, referenced for its mapping **/
+  char *sp;           /**< The lowest staged byte **/
+  char **argv;        /**< The staged argument vector **/
+  int argc;           /**< The number of arguments **/
+};
+typedef struct usr_stage usr_stage_s;
 
-#endif /* _USR_STACK_H */
+int usr_stack_stage(usr_stage_s *st, char *argvec[]);
+void usr_stack_unstage(usr_stage_s *st);
+void *usr_stack_init(vm_info_s *vmi, usr_stage_s *st);
 
+#endif /* _USR_STACK_H */
@@ -16,6 +16,9 @@
 #define FLOOR(val,align)  \
   ( ((unsigned int) (val)) & ~((align) - 1))
 
+#define MIN(a,b)  ( ((a) < (b)) ? (a) : (b) )
+#define MAX(a,b)  ( ((a) > (b)) ? (a) : (b) )
+
 typedef unsigned int esp_t;
 
 /** @brief Decrements a esp_t.
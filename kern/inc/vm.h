@@ -9,7 +9,11 @@
 #define __VM_H__
 
 #include <cllist.h>
+#include <mreg.h>
 #include <page_alloc.h>
+#include <rwlock.h>
+#include <shm.h>
+#include <syscall_ext.h>
 
 
 /* Memory region attribute flags */
@@ -17,13 +21,41 @@
 #define VM_ATTR_USER  0x002    /* 0: priviledged; 1: user-accessible */
 #define VM_ATTR_ZFOD  0x200    /* 0: page is note ZFOD; 1: page is ZFOD */
 #define VM_ATTR_NEWPG  0x004
+#define VM_ATTR_LARGE 0x008    /* 0: 4KB pages; 1: 4MB pages */
+
+/* Large pages cover a whole page table's worth of memory */
+#define LARGE_PAGE_SIZE TOME_SIZE
+
+/* Advice for vm_advise(...); the page_advise(...) system call's values */
+#define VM_ADV_DONTNEED PAGE_DONTNEED   /* Free the pages' frames */
+#define VM_ADV_WILLNEED PAGE_WILLNEED   /* Fault the pages in now */
+#define VM_ADV_RESIDENT PAGE_RESIDENT   /* Report which pages have frames */
+
+/* Fault-around windows double on sequential faults, up to this many pages */
+#define VM_FA_MAX_PAGES 16
+
+/** @struct vm_fa_stats
+ *  @brief Fault-around counters.
+ **/
+struct vm_fa_stats {
+  unsigned int faults;    /**< ZFOD and file-backed faults taken **/
+  unsigned int pages;     /**< Pages those faults filled in **/
+  unsigned int grows;     /**< Faults that found sequential access **/
+  unsigned int resets;    /**< Faults that found random access **/
+};
+typedef struct vm_fa_stats vm_fa_stats_s;
+
+/* Tunable; at most VM_FA_MAX_PAGES */
+extern int vm_fa_max_pages;
 
 /** @struct vm_info
  *  @brief Information used by the VM sub-system.
  **/
 struct vm_info {
   pg_info_s pg_info;  /**< Information for the page allocator **/
-  cll_list mmap;      /**< A list of currently allocated regions **/
+  mem_map_s mmap;     /**< The currently allocated regions **/
+  void *zs_hand;      /**< Where the reclaimer's sweep resumes **/
+  rwlock_s lock;      /**< The map lock (see vm.c) **/
 };
 typedef struct vm_info vm_info_s;
 
@@ -31,9 +63,23 @@ void vm_init_allocator(void);
 void vm_init(vm_info_s *vmi);
 void *vm_alloc(vm_info_s *vmi, void *va_start, size_t len,
                unsigned int attrs);
+void *vm_alloc_file(vm_info_s *vmi, void *va_start, size_t len,
+                    unsigned int attrs, const exec2obj_userapp_TOC_entry *file,
+                    const file_extent_s *exts, int nexts);
+void *vm_map_file(vm_info_s *vmi, void *va_start,
+                  const exec2obj_userapp_TOC_entry *file);
+void *vm_alloc_shared(vm_info_s *vmi, void *va_start, shm_s *shm);
+int vm_page_in(vm_info_s *vmi, void *vaddr, int write);
+int vm_fault_zfod(vm_info_s *vmi, void *vaddr);
+int vm_reclaim(vm_info_s *vmi, int target);
+void vm_fa_get_stats(vm_fa_stats_s *stats);
+void vm_fa_dump_stats(void);
 void vm_free(vm_info_s *vmi, void *va_start);
+void *vm_remap(vm_info_s *vmi, void *va_start, size_t len, void *new_start);
 int vm_set_attrs(vm_info_s *vmi, void *va_start, unsigned int attrs);
 int vm_get_attrs(vm_info_s *vmi, void *va_start, unsigned int *dst);
+int vm_advise(vm_info_s *vmi, void *va_start, size_t len, int advice,
+              unsigned char *vec);
 int vm_copy(vm_info_s *dst, vm_info_s *src);
 void vm_final(vm_info_s *vmi);
 void *vm_find(vm_info_s *vmi, void *addr);
@@ -0,0 +1,59 @@
+/** @file zswap.h
+ *
+ *  @brief Declares the compressed page pool API.
+ *
+ *  @author Enrique Naudon (esn)
+ *  @author Marlies Ruck (mruck)
+ **/
+#ifndef __ZSWAP_H__
+#define __ZSWAP_H__
+
+#include <x86/page.h>
+
+
+/* Most compressed pages we hold */
+#define ZS_SLOTS        4096
+
+/* Most kernel heap (in bytes) the pool may use */
+#define ZS_POOL_LIMIT   ( 2 * 1024 * 1024 )
+
+/* Pages that don't compress below this many bytes aren't worth storing */
+#define ZS_MAX_CLEN     ( PAGE_SIZE * 3 / 4 )
+
+/* Pages each reclaim tries to free, and the most it will look at */
+#define ZS_RECLAIM_BATCH  16
+#define ZS_SCAN_LIMIT     2048
+
+/* What pg_swap_out(...) did with a page, besides failing with ZS_EFULL */
+#define ZS_SKIPPED  0     /* Not a candidate */
+#define ZS_SWAPPED  1     /* Compressed, and its frame freed */
+#define ZS_AGED     2     /* Recently used; its accessed bit was cleared */
+
+/* zs_store(...) errors */
+#define ZS_EINCOMP  -1    /* The page doesn't compress well enough */
+#define ZS_EFULL    -2    /* The pool is out of slots or space */
+
+/** @struct zs_stats
+ *  @brief Compressed pool statistics.
+ **/
+struct zs_stats {
+  unsigned int stored;          /**< Pages currently in the pool **/
+  unsigned int pool_bytes;      /**< Compressed bytes currently held **/
+  unsigned int stores;          /**< Pages compressed into the pool **/
+  unsigned int rejects;         /**< Pages that didn't compress well **/
+  unsigned int full;            /**< Stores refused for lack of room **/
+  unsigned int loads;           /**< Pages faulted back in **/
+  unsigned long long load_cycles; /**< Total cycles spent faulting in **/
+  unsigned int load_max;          /**< Slowest fault-in, in cycles **/
+};
+typedef struct zs_stats zs_stats_s;
+
+
+int zs_store(void *frame);
+int zs_load(int slot, void *frame);
+void zs_drop(int slot);
+void zs_get_stats(zs_stats_s *stats);
+void zs_dump_stats(void);
+
+
+#endif /* __ZSWAP_H__ */
@@ -35,10 +35,13 @@
 
 /* Pebbles includes */
 #include <console.h>
+#include <cr_util.h>
 #include <idt.h>
 #include <frame_alloc.h>
+#include <kstack.h>
 #include <loader.h>
 #include <process.h>
+#include <ramfs.h>
 #include <sched.h>
 #include <sc_utils.h>
 #include <thread.h>
@@ -52,6 +55,7 @@
 void init_kdata_structures(void);
 void *raw_init_pd(void);
 void init_stack(thread_t *thr);
+void idle_loop(void);
 thread_t *hand_load_task(const char *fname);
 
 int kernel_is_running = 0;
@@ -72,9 +76,11 @@ int kernel_main(mbinfo_t *mbinfo, int argc, char **argv, char **envp)
   init_kdata_structures();
   enable_write_protect();
 
-  /* Hand load idle */
-  thread_t *idle = hand_load_task("idle");
-  init_stack(idle);
+  /* Hand load idle; it gets a task like everyone else, but it runs
+   * idle_loop() rather than the program
+   */
+  idle_thr = hand_load_task("idle");
+  init_stack(idle_thr);
 
   /* Hand load init */
   hand_load_task("init");
@@ -111,10 +117,16 @@ void init_kdata_structures(void)
   install_sys_handlers(); 
   clear_console();
 
+  /* Reserve guarded kernel stacks before the kernel page tables go up */
+  kstack_init();
+
   /* Initalize memory modules...starts with virtual memory and peels away each
    * layer of abstraction until reaching the frame allocator */
   vm_init_allocator();
 
+  /* Index the files built into the image */
+  ramfs_init();
+
   return;
 }
 
@@ -128,16 +140,21 @@ void init_kdata_structures(void)
 thread_t *hand_load_task(const char *fname)
 {
   thread_t *thread = task_init();
+  usr_stage_s stage;
+
   curr_thr = thread;
   curr_tsk = thread->task_info;
 
-  /* Enable paging */
+  /* Enable paging; the kernel is mapped with global 4MB pages */
   set_cr3(curr_tsk->cr3);
+  enable_pse();
   enable_paging();
+  enable_global_pages();
 
   /* Prepare to drop into user mode */
   thread->pc = load_file(&curr_tsk->vmi, fname);
-  thread->sp = usr_stack_init(&curr_tsk->vmi, 0, NULL);
+  assert(!usr_stack_stage(&stage, NULL));
+  thread->sp = usr_stack_init(&curr_tsk->vmi, &stage);
 
   /* Add the task to the runnable queue */
   rq_add(thread);
@@ -147,11 +164,10 @@ thread_t *hand_load_task(const char *fname)
 }
 
 
-/** @brief Prepare the kernel stack for half_dispatch().
+/** @brief Prepare idle's kernel stack to run idle_loop().
  *
- *  This is only used for making idle a valid scheduleable unit, but it can be
- *  called for any other thread that needs to initialize its kernel stack in
- *  preparation for a mode switch.
+ *  This is only used for making idle a valid scheduleable unit; idle never
+ *  drops to user mode, so the program it was loaded with never runs.
  *
  *  @param thr Thread to prepare.
  *
@@ -159,16 +175,30 @@ thread_t *hand_load_task(const char *fname)
  **/
 void init_stack(thread_t *thr)
 {
-  /* Push the arguments on the kernel stack */
+  /* idle_loop() doesn't return, but give it somewhere to return to */
   void *esp = &thr->kstack[KSTACK_SIZE];
-  PUSH(esp, thr->sp);
-  PUSH(esp, thr->pc);
   PUSH(esp, 0);
 
   /* Set the correct program counter and stack pointer */
-  thr->pc = half_dispatch;
+  thr->pc = idle_loop;
   thr->sp = esp;
 
   return;
 }
 
+/** @brief The idle thread's body.
+ *
+ *  Idle puts otherwise wasted time to use zeroing dirty frames.  It runs
+ *  with interrupts enabled, so it can be preempted mid-frame like any other
+ *  thread; fr_zero_idle(...) never blocks, so idle is always runnable.
+ *
+ *  @return Does not return.
+ **/
+void idle_loop(void)
+{
+  /* We were switched to from wherever, maybe with interrupts off */
+  enable_interrupts();
+
+  while (1) fr_zero_idle(FR_IDLE_BUDGET);
+}
+
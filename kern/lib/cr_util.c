@@ -55,3 +55,33 @@ void disable_paging(void)
 
   return;
 }
+
+/** @brief Allow 4MB pages in the page directory.
+ *
+ *  @return Void.
+ **/
+void enable_pse(void)
+{
+  uint32_t cr4;
+
+  cr4 = get_cr4();
+  cr4 |= CR4_PSE;
+  set_cr4(cr4);
+
+  return;
+}
+
+/** @brief Keep global pages in the TLB across CR3 reloads.
+ *
+ *  @return Void.
+ **/
+void enable_global_pages(void)
+{
+  uint32_t cr4;
+
+  cr4 = get_cr4();
+  cr4 |= CR4_PGE;
+  set_cr4(cr4);
+
+  return;
+}
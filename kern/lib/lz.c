@@ -0,0 +1,159 @@
+/** @file lz.c
+ *
+ *  @brief Implements a small LZ77 codec.
+ *
+ *  The format is LZRW1's: the output is a series of groups, each a 16-bit
+ *  control word (least significant byte first) followed by up to sixteen
+ *  items.  Bit i of the control word says whether item i is a literal byte
+ *  (0) or a two-byte match (1).  A match's first byte holds the match
+ *  length less three in its high nibble and the high nibble of the offset
+ *  in its low nibble; its second byte holds the low byte of the offset.
+ *
+ *  Compression finds matches with a single hash probe per position, so it
+ *  is quick rather than thorough.
+ *
+ *  @author Enrique Naudon (esn)
+ *  @author Marlies Ruck (mruck)
+ **/
+#include <lz.h>
+
+/* Libc includes */
+#include <string.h>
+
+
+/* Items per group, and the most bytes a group can take */
+#define LZ_GROUP_ITEMS  16
+#define LZ_GROUP_MAX    ( 2 + 2*LZ_GROUP_ITEMS )
+
+/** @brief Hashes the three bytes at p.
+ *
+ *  @param p The bytes.
+ *
+ *  @return A hash table index.
+ **/
+#define LZ_HASH(p)                                                    \
+  ( ((((unsigned int)(p)[0] << 8) ^ ((unsigned int)(p)[1] << 4)       \
+      ^ (p)[2]) * 40543u >> 4) & (LZ_HASH_SIZE - 1) )
+
+/** @brief Compresses a buffer.
+ *
+ *  @param src The bytes to compress.
+ *  @param len The number of bytes (at most LZ_MAX_INPUT).
+ *  @param dst Where to write the compressed bytes.
+ *  @param cap The size of dst.
+ *  @param work LZ_WORK_SIZE bytes of scratch space.
+ *
+ *  @return The compressed length, or -1 if it wouldn't fit in cap bytes.
+ **/
+int lz_compress(const unsigned char *src, int len, unsigned char *dst,
+                int cap, void *work)
+{
+  unsigned short *tbl = work;
+  const unsigned char *ip, *ref, *end;
+  unsigned char *op, *ctrl_p;
+  unsigned int ctrl, h, off;
+  int bit, n;
+
+  if (len > LZ_MAX_INPUT) return -1;
+
+  /* Table entries are positions plus one; zero means empty */
+  memset(tbl, 0, LZ_WORK_SIZE);
+
+  ip = src;
+  end = src + len;
+  op = dst;
+
+  while (ip < end)
+  {
+    /* Don't start a group we might not have room to finish */
+    if (op + LZ_GROUP_MAX > dst + cap) return -1;
+    ctrl_p = op;
+    op += 2;
+    ctrl = 0;
+
+    for (bit = 0; bit < LZ_GROUP_ITEMS && ip < end; ++bit)
+    {
+      /* Look for a match */
+      if (end - ip >= LZ_MIN_MATCH) {
+        h = LZ_HASH(ip);
+        ref = tbl[h] ? src + tbl[h] - 1 : NULL;
+        tbl[h] = ip - src + 1;
+        off = ref ? ip - ref : 0;
+
+        if (ref && off <= LZ_MAX_OFFSET
+            && ref[0] == ip[0] && ref[1] == ip[1] && ref[2] == ip[2])
+        {
+          for (n = LZ_MIN_MATCH;
+               n < LZ_MAX_MATCH && ip + n < end && ref[n] == ip[n]; ++n)
+            continue;
+
+          *op++ = ((n - LZ_MIN_MATCH) << 4) | (off >> 8);
+          *op++ = off & 0xFF;
+          ctrl |= 1 << bit;
+          ip += n;
+          continue;
+        }
+      }
+
+      /* No luck; emit a literal */
+      *op++ = *ip++;
+    }
+
+    ctrl_p[0] = ctrl & 0xFF;
+    ctrl_p[1] = ctrl >> 8;
+  }
+
+  return op - dst;
+}
+
+/** @brief Decompresses a buffer.
+ *
+ *  @param src The compressed bytes.
+ *  @param len The number of compressed bytes.
+ *  @param dst Where to write the decompressed bytes.
+ *  @param cap The size of dst.
+ *
+ *  @return The decompressed length, or -1 if the input is corrupt or would
+ *  overflow dst.
+ **/
+int lz_decompress(const unsigned char *src, int len, unsigned char *dst,
+                  int cap)
+{
+  const unsigned char *ip, *end;
+  unsigned char *op, *op_end;
+  unsigned int ctrl, off;
+  int bit, n;
+
+  ip = src;
+  end = src + len;
+  op = dst;
+  op_end = dst + cap;
+
+  while (ip < end)
+  {
+    if (end - ip < 2) return -1;
+    ctrl = ip[0] | (ip[1] << 8);
+    ip += 2;
+
+    for (bit = 0; bit < LZ_GROUP_ITEMS && ip < end; ++bit)
+    {
+      /* Literal */
+      if (!(ctrl & (1 << bit))) {
+        if (op >= op_end) return -1;
+        *op++ = *ip++;
+        continue;
+      }
+
+      /* Match; it may overlap what it produces, so copy bytewise */
+      if (end - ip < 2) return -1;
+      n = (ip[0] >> 4) + LZ_MIN_MATCH;
+      off = ((ip[0] & 0x0F) << 8) | ip[1];
+      ip += 2;
+      if (off == 0 || off > (unsigned int)(op - dst) || op + n > op_end)
+        return -1;
+      for ( ; n > 0; --n, ++op) *op = *(op - off);
+    }
+  }
+
+  return op - dst;
+}
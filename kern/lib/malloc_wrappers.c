@@ -1,73 +1,423 @@
+/** @file malloc_wrappers.c
+ *
+ *  @brief Implements the kernel heap.
+ *
+ *  Small requests (up to HEAP_MAX_CLASS bytes) come from segregated free
+ *  lists, one per power-of-two size class, each behind its own lock.  A
+ *  class refills a page at a time from the general allocator (410's _malloc
+ *  and friends), which sits behind allocator_lock and also serves the large
+ *  requests.  So allocator_lock is only contended by large requests and
+ *  refills, not by every copy_from_user buffer and readline.
+ *
+ *  Class pages are never given back, so a class carves up at most
+ *  HEAP_CLASS_MAX_PAGES of them; once it's out of objects at the cap, its
+ *  requests spill over to the general allocator, which does take memory
+ *  back.  page_class[] maps each kernel page to its class, or to 0 for
+ *  pages owned by the general allocator, so free(...) can route a buffer
+ *  (spilled or not) without being told its size.  Since pages
+ *  are page-aligned and class sizes are powers of two, every object is
+ *  aligned to its size, which is what lets memalign(...) use the classes.
+ *
+ *  @author Enrique Naudon (esn)
+ *  @author Marlies Ruck (mruck)
+ **/
+#include <simics.h>
+
+#include <heap.h>
+
+/* Pebbles includes */
+#include <common_kern.h>
+#include <mutex.h>
+#include <util.h>
+#include <x86/page.h>
+
+/* Libc includes */
+#include <assert.h>
 #include <stddef.h>
 #include <malloc.h>
 #include <malloc/malloc_internal.h>
-#include <mutex.h>
+#include <string.h>
+
+
+/** @struct heap_class
+ *  @brief A size class.
+ **/
+struct heap_class {
+  mutex_s lock;               /**< Protects the fields below **/
+  void *free;                 /**< Free objects, chained by first word **/
+  heap_class_stats_s stats;   /**< Counters **/
+};
+typedef struct heap_class heap_class_s;
+
+/** @brief Statically initialize a size class.
+ *
+ *  @param i The class's index.
+ *
+ *  @return A size class.
+ **/
+#define CLASS_INITIALIZER(i) {                      \
+  .lock = MUTEX_INITIALIZER(classes[i].lock),       \
+  .free = NULL,                                     \
+  .stats = { .size = HEAP_MIN_CLASS << (i) }        \
+}
+
+static heap_class_s classes[HEAP_NCLASSES] = {
+  CLASS_INITIALIZER(0), CLASS_INITIALIZER(1), CLASS_INITIALIZER(2),
+  CLASS_INITIALIZER(3), CLASS_INITIALIZER(4), CLASS_INITIALIZER(5),
+  CLASS_INITIALIZER(6), CLASS_INITIALIZER(7),
+};
+
+/* Each kernel page's class plus one, or 0 if it isn't a class page */
+static unsigned char page_class[USER_MEM_START / PAGE_SIZE];
 
+/** @brief Gets a kernel page's entry in page_class[].
+ *
+ *  @param addr An address in the page.
+ *
+ *  @return The entry, as an lvalue.
+ **/
+#define PAGE_CLASS(addr)  ( page_class[(unsigned int)(addr) / PAGE_SIZE] )
+
+/* Protects the general allocator and the large block counters */
 static mutex_s allocator_lock = MUTEX_INITIALIZER(allocator_lock);
+static unsigned int large, large_peak, large_allocs;
+
+/*************************************************************************
+ *  Size classes
+ *************************************************************************/
+
+/** @brief Finds the smallest class that fits a request.
+ *
+ *  @param size The request size.
+ *
+ *  @return The class's index, or -1 if the request is too big for any.
+ **/
+static int size_class(size_t size)
+{
+  int i;
+
+  if (size > HEAP_MAX_CLASS) return -1;
+  for (i = 0; (size_t)(HEAP_MIN_CLASS << i) < size; ++i)
+    continue;
+
+  return i;
+}
+
+/** @brief Carves a fresh page into a class's objects.  Call with the class
+ *         locked.
+ *
+ *  @param i The class's index.
+ *
+ *  @return 0 on success; a negative integer error code if the class is at
+ *          its cap or we're out of memory.
+ **/
+static int refill(int i)
+{
+  heap_class_s *hc = &classes[i];
+  char *page, *obj;
+
+  if (hc->stats.pages >= HEAP_CLASS_MAX_PAGES) return -1;
+
+  mutex_lock(&allocator_lock);
+  page = _smemalign(PAGE_SIZE, PAGE_SIZE);
+  mutex_unlock(&allocator_lock);
+  if (!page) return -1;
+
+  assert((unsigned int)page < USER_MEM_START);
+  PAGE_CLASS(page) = i + 1;
+
+  /* Chain the objects lowest first */
+  for (obj = page + PAGE_SIZE - hc->stats.size; obj >= page;
+       obj -= hc->stats.size) {
+    *(void **)obj = hc->free;
+    hc->free = obj;
+  }
+  hc->stats.pages++;
+
+  return 0;
+}
+
+/** @brief Allocates an object from a class.
+ *
+ *  @param i The class's index.
+ *  @param size The request size, for the stats.
+ *
+ *  @return The object, or NULL if the class can't grow; the caller should
+ *          then try the general allocator.
+ **/
+static void *class_alloc(int i, size_t size)
+{
+  heap_class_s *hc = &classes[i];
+  void *obj;
+
+  mutex_lock(&hc->lock);
+
+  if (!hc->free && refill(i)) {
+    hc->stats.spills++;
+    mutex_unlock(&hc->lock);
+    return NULL;
+  }
+  obj = hc->free;
+  hc->free = *(void **)obj;
+
+  hc->stats.allocs++;
+  hc->stats.req_bytes += size;
+  if (++hc->stats.inuse > hc->stats.peak) hc->stats.peak = hc->stats.inuse;
+
+  mutex_unlock(&hc->lock);
+  return obj;
+}
+
+/** @brief Returns an object to its class.
+ *
+ *  @param buf The object.
+ *
+ *  @return Void.
+ **/
+static void class_free(void *buf)
+{
+  heap_class_s *hc = &classes[PAGE_CLASS(buf) - 1];
+
+  assert(((unsigned int)buf & (hc->stats.size - 1)) == 0);
+
+  mutex_lock(&hc->lock);
+  *(void **)buf = hc->free;
+  hc->free = buf;
+  hc->stats.inuse--;
+  mutex_unlock(&hc->lock);
+
+  return;
+}
+
+/** @brief Counts a large block.  Call with allocator_lock held.
+ *
+ *  @param addr The block, or NULL if the allocation failed.
+ *
+ *  @return addr.
+ **/
+static void *large_alloced(void *addr)
+{
+  if (addr) {
+    large_allocs++;
+    if (++large > large_peak) large_peak = large;
+  }
+  return addr;
+}
+
+/** @brief Tells whether a buffer came from a size class.
+ *
+ *  @param buf The buffer.
+ *
+ *  @return Nonzero if it did; 0 otherwise.
+ **/
+#define IS_CLASS_BUF(buf) \
+  ( (unsigned int)(buf) < USER_MEM_START && PAGE_CLASS(buf) )
+
+/** @brief Computes a percentage without 64-bit division.
+ *
+ *  @param part The part.
+ *  @param whole The whole.
+ *
+ *  @return part as a percentage of whole.
+ **/
+static unsigned int percent(unsigned long long part,
+                            unsigned long long whole)
+{
+  while (whole >> 25) {
+    part >>= 1;
+    whole >>= 1;
+  }
+  return whole ? (unsigned int)part * 100 / (unsigned int)whole : 0;
+}
+
+/*************************************************************************
+ *  Exported API
+ *************************************************************************/
+
+/* Thread-safe versions of the malloc functions */
 
-/* safe versions of malloc functions */
 void *malloc(size_t size)
 {
+  void *addr;
+  int i;
+
+  if ((i = size_class(size)) >= 0 && (addr = class_alloc(i, size)))
+    return addr;
+
   mutex_lock(&allocator_lock);
-  void *addr = _malloc(size); 
+  addr = large_alloced(_malloc(size));
   mutex_unlock(&allocator_lock);
   return addr;
 }
 
 void *memalign(size_t alignment, size_t size)
 {
+  void *addr;
+  int i;
+
+  /* Class objects are aligned to their size */
+  if ((alignment & (alignment - 1)) == 0
+      && (i = size_class(MAX(size, alignment))) >= 0
+      && (addr = class_alloc(i, size)))
+    return addr;
+
   mutex_lock(&allocator_lock);
-  void *addr = _memalign(alignment,size);
+  addr = large_alloced(_memalign(alignment, size));
   mutex_unlock(&allocator_lock);
   return addr;
 }
 
 void *calloc(size_t nelt, size_t eltsize)
 {
-  mutex_lock(&allocator_lock);
-  void *addr = _calloc(nelt,eltsize);
-  mutex_unlock(&allocator_lock);
+  void *addr;
+
+  if (eltsize && nelt > ((size_t)-1) / eltsize) return NULL;
+
+  addr = malloc(nelt * eltsize);
+  if (addr) memset(addr, 0, nelt * eltsize);
   return addr;
 }
 
 void *realloc(void *buf, size_t new_size)
 {
+  void *addr;
+  size_t old_size;
+
+  if (!buf) return malloc(new_size);
+
+  /* Class objects stay put if they're still big enough */
+  if (IS_CLASS_BUF(buf)) {
+    old_size = classes[PAGE_CLASS(buf) - 1].stats.size;
+    if (new_size <= old_size) return buf;
+
+    if (!(addr = malloc(new_size))) return NULL;
+    memcpy(addr, buf, old_size);
+    class_free(buf);
+    return addr;
+  }
+
   mutex_lock(&allocator_lock);
-  void *addr = _realloc(buf,new_size);
+  addr = _realloc(buf, new_size);
   mutex_unlock(&allocator_lock);
   return addr;
 }
 
 void free(void *buf)
 {
+  if (!buf) return;
+  if (IS_CLASS_BUF(buf)) {
+    class_free(buf);
+    return;
+  }
+
   mutex_lock(&allocator_lock);
   _free(buf);
+  large--;
   mutex_unlock(&allocator_lock);
   return;
 }
 
 void *smalloc(size_t size)
 {
+  void *addr;
+  int i;
+
+  if ((i = size_class(size)) >= 0 && (addr = class_alloc(i, size)))
+    return addr;
+
   mutex_lock(&allocator_lock);
-  void *addr = _smalloc(size);
+  addr = large_alloced(_smalloc(size));
   mutex_unlock(&allocator_lock);
   return addr;
 }
 
 void *smemalign(size_t alignment, size_t size)
 {
+  void *addr;
+  int i;
+
+  if ((alignment & (alignment - 1)) == 0
+      && (i = size_class(MAX(size, alignment))) >= 0
+      && (addr = class_alloc(i, size)))
+    return addr;
+
   mutex_lock(&allocator_lock);
-  void *addr = _smemalign(alignment,size);
+  addr = large_alloced(_smemalign(alignment, size));
   mutex_unlock(&allocator_lock);
   return addr;
 }
 
 void sfree(void *buf, size_t size)
 {
+  if (!buf) return;
+  if (IS_CLASS_BUF(buf)) {
+    class_free(buf);
+    return;
+  }
+
   mutex_lock(&allocator_lock);
-  _sfree(buf,size);
+  _sfree(buf, size);
+  large--;
   mutex_unlock(&allocator_lock);
   return;
 }
 
+/** @brief Reads the heap's counters.
+ *
+ *  @param dst Where to write the counters.
+ *
+ *  @return Void.
+ **/
+void heap_get_stats(heap_stats_s *dst)
+{
+  int i;
+
+  for (i = 0; i < HEAP_NCLASSES; ++i) {
+    mutex_lock(&classes[i].lock);
+    dst->classes[i] = classes[i].stats;
+    mutex_unlock(&classes[i].lock);
+  }
+
+  mutex_lock(&allocator_lock);
+  dst->large = large;
+  dst->large_peak = large_peak;
+  dst->large_allocs = large_allocs;
+  mutex_unlock(&allocator_lock);
 
+  return;
+}
+
+/** @brief Prints the heap's counters to the simics console.
+ *
+ *  For each class, waste is internal fragmentation: the share of the bytes
+ *  handed out that weren't asked for.  Idle bytes are external: carved but
+ *  currently free.
+ *
+ *  @return Void.
+ **/
+void heap_dump_stats(void)
+{
+  heap_stats_s s;
+  heap_class_stats_s *c;
+  unsigned int idle, idle_total = 0, pages = 0;
+  int i;
+
+  heap_get_stats(&s);
+
+  for (i = 0; i < HEAP_NCLASSES; ++i) {
+    c = &s.classes[i];
+    idle = c->pages * PAGE_SIZE - c->inuse * c->size;
+    idle_total += idle;
+    pages += c->pages;
+
+    lprintf("heap %4u: %u in use (peak %u) in %u pages, %u allocs, "
+            "%u%% waste, %u bytes idle, %u spills", c->size, c->inuse,
+            c->peak, c->pages, c->allocs, 100 - percent(c->req_bytes,
+            (unsigned long long)c->allocs * c->size), idle, c->spills);
+  }
+
+  lprintf("heap: %u class pages, %u bytes idle; %u large in use (peak %u), "
+          "%u large allocs", pages, idle_total, s.large, s.large_peak,
+          s.large_allocs);
+  return;
+}
@@ -176,6 +176,35 @@ void mutex_lock(mutex_s *mp)
   return;
 }
 
+/** @brief Try to lock a mutex without blocking.
+ *
+ *  This never blocks or spins: if anyone holds the mutex, or is in the
+ *  middle of manipulating it, we give up rather than wait.
+ *
+ *  @param mp The mutex to lock.
+ *
+ *  @return 0 if we got the mutex; a negative integer error code otherwise.
+ **/
+int mutex_trylock(mutex_s *mp)
+{
+  assert(mp);
+
+  /* Someone is fiddling with the waiting list */
+  if (spin_trylock(&mp->lock)) return -1;
+
+  /* Somebody beat us to it */
+  if (mp->state == MUTEX_LOCKED) {
+    spin_unlock(&mp->lock);
+    return -1;
+  }
+
+  mp->state = MUTEX_LOCKED;
+  mp->owner = curr_thr->tid;
+  spin_unlock(&mp->lock);
+
+  return 0;
+}
+
 /** @brief Unlock a mutex.
  *
  *  @param mp The mutex to unlock.
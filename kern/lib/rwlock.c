@@ -0,0 +1,126 @@
+/** @file rwlock.c
+ *
+ *  @brief This file implements our readers/writer locks.
+ *
+ *  @author Enrique Naudon (esn)
+ *  @author Marlies Ruck (mruck)
+ *
+ *  @bug No known bugs
+ */
+
+/* Readers/writer lock includes */
+#include <rwlock.h>
+
+/* Pebbles includes */
+#include <assert.h>
+#include <cvar.h>
+#include <mutex.h>
+#include <sched.h>
+
+
+/** @brief Initialize a readers/writer lock.
+ *
+ *  The lock is initially unlocked.
+ *
+ *  @param rw The lock to initialize.
+ *
+ *  @return 0 on success, or a negative integer error code on failure.
+ **/
+int rwlock_init(rwlock_s *rw)
+{
+  if (rw == NULL) return -1;
+
+  mutex_init(&rw->lock);
+  cvar_init(&rw->readers);
+  cvar_init(&rw->writers);
+  rw->nreaders = 0;
+  rw->nwriters = 0;
+  rw->writer = -1;
+
+  return 0;
+}
+
+/** @brief Finalize a readers/writer lock.
+ *
+ *  It is illegal to finalize a lock that's held or waited on.
+ *
+ *  @param rw The lock to finalize.
+ *
+ *  @return Void.
+ **/
+void rwlock_final(rwlock_s *rw)
+{
+  assert(rw);
+  assert(!rw->nreaders && !rw->nwriters && rw->writer == -1);
+
+  cvar_final(&rw->readers);
+  cvar_final(&rw->writers);
+  mutex_final(&rw->lock);
+  return;
+}
+
+/** @brief Lock a readers/writer lock.
+ *
+ *  This may block.
+ *
+ *  @param rw The lock to lock.
+ *  @param mode RWLOCK_READ for shared access; RWLOCK_WRITE for exclusive.
+ *
+ *  @return Void.
+ **/
+void rwlock_lock(rwlock_s *rw, rwlock_mode_e mode)
+{
+  assert(rw);
+
+  mutex_lock(&rw->lock);
+
+  if (mode == RWLOCK_READ) {
+    /* Let waiting writers go first, so readers can't starve them */
+    while (rw->writer != -1 || rw->nwriters)
+      cvar_wait(&rw->readers, &rw->lock);
+    rw->nreaders++;
+  }
+  else {
+    rw->nwriters++;
+    while (rw->writer != -1 || rw->nreaders)
+      cvar_wait(&rw->writers, &rw->lock);
+    rw->nwriters--;
+    rw->writer = curr_thr->tid;
+  }
+
+  mutex_unlock(&rw->lock);
+  return;
+}
+
+/** @brief Unlock a readers/writer lock.
+ *
+ *  The last holder out hands the lock to a waiting writer if there is one,
+ *  and to every waiting reader otherwise.
+ *
+ *  @param rw The lock to unlock.
+ *
+ *  @return Void.
+ **/
+void rwlock_unlock(rwlock_s *rw)
+{
+  assert(rw);
+
+  mutex_lock(&rw->lock);
+
+  if (rw->writer != -1) {
+    assert(rw->writer == curr_thr->tid);
+    rw->writer = -1;
+  }
+  else {
+    assert(rw->nreaders > 0);
+    rw->nreaders--;
+  }
+
+  if (!rw->nreaders) {
+    if (rw->nwriters) cvar_signal(&rw->writers);
+    else cvar_broadcast(&rw->readers);
+  }
+
+  mutex_unlock(&rw->lock);
+  return;
+}
@@ -0,0 +1,243 @@
+/** @file slab.c
+ *
+ *  @brief Implements the slab allocator.
+ *
+ *  A slab is a power-of-two number of pages, aligned to its own size, with
+ *  a header at the front and objects packed in after it.  Aligning slabs
+ *  lets slab_free(...) find an object's slab by masking its address.
+ *
+ *  Free objects are chained through a link word just past each object, not
+ *  through the object itself, so freed objects keep their constructed state
+ *  and the constructor only runs when a slab is first carved up.
+ *
+ *  @author Enrique Naudon (esn)
+ *  @author Marlies Ruck (mruck)
+ **/
+#include <simics.h>
+
+#include <slab.h>
+
+/* Pebbles includes */
+#include <util.h>
+#include <x86/page.h>
+
+/* Libc includes */
+#include <assert.h>
+#include <malloc.h>
+
+
+/** @struct slab
+ *  @brief The header at the front of each slab.
+ **/
+struct slab {
+  cll_node node;          /**< Our entry in the cache's partial list **/
+  slab_cache_s *cache;    /**< The cache we belong to **/
+  void *free;             /**< Free objects, chained by their links **/
+  unsigned int inuse;     /**< Objects currently allocated **/
+};
+typedef struct slab slab_s;
+
+/* Objects start after the header, word aligned */
+#define SLAB_HDR_SIZE   CEILING(sizeof(slab_s), sizeof(void *))
+
+/** @brief Gets the size of an object plus its free list link.
+ *
+ *  @param c The cache.
+ *
+ *  @return The distance between objects in a slab.
+ **/
+#define SLAB_STRIDE(c) \
+  ( CEILING((c)->size, sizeof(void *)) + sizeof(void *) )
+
+/** @brief Gets an object's free list link.
+ *
+ *  @param c The cache.
+ *  @param obj The object.
+ *
+ *  @return The link, as an lvalue.
+ **/
+#define SLAB_LINK(c,obj) \
+  ( *(void **)((char *)(obj) + CEILING((c)->size, sizeof(void *))) )
+
+/*************************************************************************
+ *  Helper functions
+ *************************************************************************/
+
+/** @brief Picks a cache's slab size.  Call with the cache locked.
+ *
+ *  @param c The cache.
+ *
+ *  @return Void.
+ **/
+static void size_slabs(slab_cache_s *c)
+{
+  size_t size;
+
+  for (size = PAGE_SIZE; size < SLAB_MAX_PAGES * PAGE_SIZE; size <<= 1) {
+    if ((size - SLAB_HDR_SIZE) / SLAB_STRIDE(c) >= SLAB_MIN_OBJS) break;
+  }
+
+  c->slab_size = size;
+  c->per_slab = (size - SLAB_HDR_SIZE) / SLAB_STRIDE(c);
+  assert(c->per_slab > 0);
+
+  return;
+}
+
+/** @brief Adds a slab to a cache.  Call with the cache locked.
+ *
+ *  @param c The cache.
+ *
+ *  @return 0 on success; a negative integer error code on failure.
+ **/
+static int grow(slab_cache_s *c)
+{
+  slab_s *s;
+  char *obj;
+  unsigned int i;
+
+  if (!c->slab_size) size_slabs(c);
+
+  s = smemalign(c->slab_size, c->slab_size);
+  if (!s) return -1;
+
+  s->cache = c;
+  s->inuse = 0;
+  s->free = NULL;
+
+  /* Carve and construct the objects, chaining them lowest first */
+  obj = (char *)s + SLAB_HDR_SIZE + (c->per_slab - 1) * SLAB_STRIDE(c);
+  for (i = 0; i < c->per_slab; ++i, obj -= SLAB_STRIDE(c)) {
+    if (c->ctor) {
+      c->ctor(obj);
+      c->stats.ctors++;
+    }
+    SLAB_LINK(c, obj) = s->free;
+    s->free = obj;
+  }
+
+  cll_init_node(&s->node, s);
+  cll_insert(c->partial.next, &s->node);
+  c->nempty++;
+  c->stats.slabs++;
+  c->stats.grows++;
+
+  return 0;
+}
+
+/*************************************************************************
+ *  Exported API
+ *************************************************************************/
+
+/** @brief Allocates an object.
+ *
+ *  @param cache The cache to allocate from.
+ *
+ *  @return The (constructed) object, or NULL if we're out of memory.
+ **/
+void *slab_alloc(slab_cache_s *cache)
+{
+  slab_s *s;
+  void *obj;
+
+  mutex_lock(&cache->lock);
+
+  if (cll_empty(&cache->partial) && grow(cache)) {
+    mutex_unlock(&cache->lock);
+    return NULL;
+  }
+
+  /* Take from the most recently used slab */
+  s = cll_entry(slab_s *, cache->partial.next);
+  obj = s->free;
+  assert(obj);
+  s->free = SLAB_LINK(cache, obj);
+
+  if (s->inuse++ == 0) cache->nempty--;
+  if (!s->free) cll_extract(&cache->partial, &s->node);
+
+  cache->stats.active++;
+  cache->stats.allocs++;
+
+  mutex_unlock(&cache->lock);
+  return obj;
+}
+
+/** @brief Frees an object.
+ *
+ *  If this empties the object's slab and we already have enough empty
+ *  slabs, the slab goes back to the heap.
+ *
+ *  @param cache The cache the object came from.
+ *  @param obj The object, in its constructed state.
+ *
+ *  @return Void.
+ **/
+void slab_free(slab_cache_s *cache, void *obj)
+{
+  slab_s *s, *victim = NULL;
+
+  assert(obj);
+  s = (slab_s *)FLOOR(obj, cache->slab_size);
+  assert(s->cache == cache);
+
+  mutex_lock(&cache->lock);
+
+  /* Full slabs aren't on any list */
+  if (!s->free) cll_insert(cache->partial.next, &s->node);
+
+  SLAB_LINK(cache, obj) = s->free;
+  s->free = obj;
+
+  if (--s->inuse == 0) {
+    if (cache->nempty < SLAB_MAX_EMPTY) cache->nempty++;
+    else {
+      cll_extract(&cache->partial, &s->node);
+      cache->stats.slabs--;
+      cache->stats.shrinks++;
+      victim = s;
+    }
+  }
+
+  cache->stats.active--;
+  cache->stats.frees++;
+
+  mutex_unlock(&cache->lock);
+
+  if (victim) sfree(victim, cache->slab_size);
+  return;
+}
+
+/** @brief Reads a cache's counters.
+ *
+ *  @param cache The cache.
+ *  @param dst Where to write the counters.
+ *
+ *  @return Void.
+ **/
+void slab_get_stats(slab_cache_s *cache, slab_stats_s *dst)
+{
+  mutex_lock(&cache->lock);
+  *dst = cache->stats;
+  mutex_unlock(&cache->lock);
+  return;
+}
+
+/** @brief Prints a cache's counters to the simics console.
+ *
+ *  @param cache The cache.
+ *
+ *  @return Void.
+ **/
+void slab_dump_stats(slab_cache_s *cache)
+{
+  slab_stats_s s;
+
+  slab_get_stats(cache, &s);
+  lprintf("slab %s: %u active in %u slabs (%u per %u bytes), %u allocs, "
+          "%u frees", cache->name, s.active, s.slabs, cache->per_slab,
+          cache->slab_size, s.allocs, s.frees);
+  lprintf("slab %s: %u grows, %u shrinks, %u ctors", cache->name, s.grows,
+          s.shrinks, s.ctors);
+  return;
+}
@@ -53,6 +53,24 @@ inline void spin_lock(spin_s *sp)
   return;
 }
 
+/** @brief Try to lock a spinlock without spinning.
+ *
+ *  We only take a ticket if it would be served immediately, so a failed
+ *  attempt leaves the lock untouched.
+ *
+ *  @param sp The spinlock to lock.
+ *
+ *  @return 0 if we got the lock; a negative integer error code otherwise.
+ **/
+inline int spin_trylock(spin_s *sp)
+{
+  unsigned int turn;
+  turn = sp->turn;
+  if (compare_and_swap(&(sp->ticket), turn, turn + 1) != turn) return -1;
+  sp->owner = curr_thr->tid;
+  return 0;
+}
+
 /** @brief Unlock a spinlock.
  *
  *  @param sp The spinlock to unlock.
@@ -7,8 +7,8 @@
  *  large character array per executable.  This loader relies on
  *  410kern/elf/load_helper.c for elf_check_header() to verify the ELF header
  *  and elf_load_helper() for populate a "simplied elf" struct.  We then
- *  allocate frames, copy the segments, and map them to the requested virtual
- *  addresses in the user's page directory.
+ *  create file-backed regions at the requested virtual addresses; each page
+ *  is read in from the image the first time the program touches it.
  *
  *  @author Marlies Ruck (mruck)
  *  @author Enrique Naudon (esn)
@@ -20,6 +20,7 @@
 #include <exec2obj.h>
 #include <loader.h>
 #include <elf_410.h>
+#include <ramfs.h>
 
 #include <pg_table.h>
 #include <frame_alloc.h>
@@ -43,23 +44,19 @@ void load_segment(const char* filename, int offset, size_t len,
  */
 int getbytes(const char* filename, int offset, int size, char *buf )
 {
-  void *src;
-  int i, amt;
+  const ramfs_file_s *file;
+  const void *src;
+  int amt;
 
-  /* Search table of contents for file */
-  for(i = 0; i < exec2obj_userapp_count; i++) {
-    if (0 == strcmp(filename,exec2obj_userapp_TOC[i].execname))
-      break;
-  }
-
-  /* Error if we didn't find the file */
-  if (i >= exec2obj_userapp_count)
+  /* Error if we don't find the file */
+  if (!(file = ramfs_lookup(filename)) || offset < 0)
     return -1;
 
   /* Calculate source address and amount to copy */
-  amt = exec2obj_userapp_TOC[i].execlen - offset;
+  amt = file->execlen - offset;
   amt = ( amt < size ) ? amt : size;
-  src = (void *)&exec2obj_userapp_TOC[i].execbytes[offset];
+  if (amt <= 0) return 0;
+  src = &file->execbytes[offset];
 
   /* Copy size bytes from file starting at offset */
   memcpy(buf, src, amt);
@@ -79,27 +76,47 @@ int getbytes(const char* filename, int offset, int size, char *buf )
  */
 int validate_file(simple_elf_t *se, const char* filename)
 {
-  int i;
+  const ramfs_file_s *file;
+
   /* Validate header and populate elf struct */
   if((elf_check_header(filename) == ELF_NOTELF) || 
       (elf_load_helper(se,filename) == ELF_NOTELF)){
       return -1;
   }
 
-  /* Search table of contents for file */
-  for(i = 0; i < exec2obj_userapp_count; i++){
-    if (0 == strcmp(filename,exec2obj_userapp_TOC[i].execname))
-      break;
-  }
-
-  /* Error if we didn't find the file */
-  if (i >= exec2obj_userapp_count)
+  /* Error if we don't find the file */
+  if (!(file = ramfs_lookup(filename)))
     return -1;
 
-  return 0;
+  return file - exec2obj_userapp_TOC;
 
 }
 
+/** @brief Describes a segment's bytes in the file.
+ *
+ *  Segments running off the end of the file are truncated, as getbytes(...)
+ *  would.
+ *
+ *  @param ext The extent to fill in.
+ *  @param file The file.
+ *  @param start Where the segment goes.
+ *  @param off Where the segment starts in the file.
+ *  @param len The segment's length.
+ *
+ *  @return Void.
+ **/
+static void init_extent(file_extent_s *ext,
+                        const exec2obj_userapp_TOC_entry *file,
+                        unsigned long start, int off, int len)
+{
+  ext->start = (void *)start;
+  ext->off = off;
+  ext->len = (file->execlen - off < len) ? file->execlen - off : len;
+  if (ext->len < 0) ext->len = 0;
+
+  return;
+}
+
 /** @brief Loads file into memory 
  *
  *  Assumes page directory has already been initialized with 4 entries for
@@ -116,27 +133,25 @@ int validate_file(simple_elf_t *se, const char* filename)
 void *load_file(vm_info_s *vmi, const char* filename)
 {
   simple_elf_t se;
+  const exec2obj_userapp_TOC_entry *file;
+  file_extent_s exts[MREG_FILE_EXTENTS];
   void *ret, *start;
   unsigned int len;
+  int toc;
 
   /* Validate file and populate elf struct */
-  if(validate_file(&se,filename) < 0)
+  if((toc = validate_file(&se,filename)) < 0)
     return NULL;
+  file = &exec2obj_userapp_TOC[toc];
 
-          /*** --- Allocate and load read/execute memory --- ***/
+          /*** --- Map read/execute memory --- ***/
 
   /* ELF contains only text */
+  init_extent(&exts[0], file, se.e_txtstart, se.e_txtoff, se.e_txtlen);
   if(se.e_rodatlen == 0){
-    ret = vm_alloc(vmi, (void *)se.e_txtstart, se.e_txtlen, 
-                   VM_ATTR_RDWR | VM_ATTR_USER);
+    ret = vm_alloc_file(vmi, (void *)se.e_txtstart, se.e_txtlen,
+                        VM_ATTR_USER, file, exts, 1);
     assert(ret != NULL);
-
-    /* Load text */
-    if(0 > getbytes(filename, se.e_txtoff, se.e_txtlen, (void *)se.e_txtstart))
-      return NULL;
-
-    /* Update attributes */
-    vm_set_attrs(vmi, (void *)se.e_txtstart, VM_ATTR_USER);
   }
   /* ELF contains text and rodata */
   else{
@@ -149,24 +164,13 @@ void *load_file(vm_info_s *vmi, const char* filename)
       start = (void *)(se.e_rodatstart);
       len =  (se.e_txtstart - se.e_rodatstart) + se.e_txtlen;
     }
-    ret = vm_alloc(vmi, start, len, VM_ATTR_RDWR | VM_ATTR_USER);
+    init_extent(&exts[1], file, se.e_rodatstart, se.e_rodatoff,
+                se.e_rodatlen);
+    ret = vm_alloc_file(vmi, start, len, VM_ATTR_USER, file, exts, 2);
     assert(ret != NULL);
-
-    /* Load text */
-    if(0 > getbytes(filename, se.e_txtoff, se.e_txtlen, (void *)se.e_txtstart))
-      return NULL;
-
-    /* Load rodata */
-   if(0 > getbytes(filename, se.e_rodatoff, se.e_rodatlen, 
-          (void *)se.e_rodatstart)){
-      return NULL;
-    }
-
-    /* Update attributes */
-    vm_set_attrs(vmi, (void *)se.e_txtstart, VM_ATTR_USER);
   }
 
-            /*** --- Allocate and load read/write memory --- ***/
+            /*** --- Map read/write memory --- ***/
 
   /* ELF contains both data and bss */
   if((se.e_bsslen > 0) && (se.e_datlen > 0)){
@@ -180,18 +184,17 @@ void *load_file(vm_info_s *vmi, const char* filename)
       start = (void *)(se.e_bssstart);
       len = se.e_datstart - se.e_bssstart + se.e_datlen;
     }
-    ret = vm_alloc(vmi, start, len, VM_ATTR_USER | VM_ATTR_RDWR);
+    init_extent(&exts[0], file, se.e_datstart, se.e_datoff, se.e_datlen);
+    ret = vm_alloc_file(vmi, start, len, VM_ATTR_USER | VM_ATTR_RDWR,
+                        file, exts, 1);
     assert(ret != NULL);
-    if(0 > getbytes(filename, se.e_datoff, se.e_datlen, (void *)se.e_datstart))
-      return NULL;
   }
   /* ELF contains only data */
   else if((se.e_bsslen == 0) && (se.e_datlen > 0)){
-    ret = vm_alloc(vmi, (void *)se.e_datstart, se.e_datlen,
-                    VM_ATTR_USER | VM_ATTR_RDWR);
+    init_extent(&exts[0], file, se.e_datstart, se.e_datoff, se.e_datlen);
+    ret = vm_alloc_file(vmi, (void *)se.e_datstart, se.e_datlen,
+                        VM_ATTR_USER | VM_ATTR_RDWR, file, exts, 1);
     assert(ret != NULL);
-    if(0 > getbytes(filename, se.e_datoff, se.e_datlen, (void *)se.e_datstart))
-      return NULL;
   }
   /* ELF contains only bss */
   else if((se.e_bsslen > 0) && (se.e_datlen == 0)){
@@ -201,4 +204,3 @@ void *load_file(vm_info_s *vmi, const char* filename)
   }
   return (void *)(se.e_entry);
 }
-
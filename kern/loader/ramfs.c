@@ -0,0 +1,122 @@
+/** @file ramfs.c
+ *
+ *  @brief Implements the RAM filesystem.
+ *
+ *  Names are looked up through a hash index over exec2obj's table of
+ *  contents, built once at boot.  Since the files sit in kernel memory
+ *  already, reads copy straight from the image to the reader's buffer.
+ *
+ *  @author Enrique Naudon (esn)
+ *  @author Marlies Ruck (mruck)
+ **/
+#include <simics.h>
+
+#include <ramfs.h>
+
+/* Pebbles includes */
+#include <sc_utils.h>
+
+/* Libc includes */
+#include <assert.h>
+#include <malloc.h>
+#include <stddef.h>
+#include <string.h>
+
+
+/* Each bucket's first file, and each file's successor in its bucket, as
+ * indices into the table of contents (-1 ends a chain) */
+static int buckets[RAMFS_BUCKETS];
+static int *chain;
+
+/** @brief Hashes a file name.
+ *
+ *  @param name The name.
+ *
+ *  @return The name's bucket.
+ **/
+static unsigned int hash_name(const char *name)
+{
+  unsigned int h = 5381;
+
+  while (*name) h = (h * 33) ^ (unsigned char)*name++;
+  return h % RAMFS_BUCKETS;
+}
+
+/*************************************************************************
+ *  Exported API
+ *************************************************************************/
+
+/** @brief Builds the name index.
+ *
+ *  Files are chained in table order, so if two share a name, the first
+ *  wins, as it did with a linear search.
+ *
+ *  @return Void.
+ **/
+void ramfs_init(void)
+{
+  int i, *tail[RAMFS_BUCKETS];
+  unsigned int b;
+
+  chain = malloc(exec2obj_userapp_count * sizeof(int));
+  assert(chain || !exec2obj_userapp_count);
+
+  for (b = 0; b < RAMFS_BUCKETS; ++b) {
+    buckets[b] = -1;
+    tail[b] = &buckets[b];
+  }
+
+  for (i = 0; i < exec2obj_userapp_count; ++i) {
+    b = hash_name(exec2obj_userapp_TOC[i].execname);
+    chain[i] = -1;
+    *tail[b] = i;
+    tail[b] = &chain[i];
+  }
+
+  return;
+}
+
+/** @brief Finds a file by name.
+ *
+ *  @param name The file's name.
+ *
+ *  @return The file, or NULL if there's no such file.
+ **/
+const ramfs_file_s *ramfs_lookup(const char *name)
+{
+  int i;
+
+  for (i = buckets[hash_name(name)]; i >= 0; i = chain[i]) {
+    if (!strcmp(name, exec2obj_userapp_TOC[i].execname))
+      return &exec2obj_userapp_TOC[i];
+  }
+
+  return NULL;
+}
+
+/** @brief Reads from a file into a user buffer.
+ *
+ *  Reads stop at the end of the file.  The bytes are copied directly from
+ *  the image; there's no kernel buffer in between.
+ *
+ *  @param file The file.
+ *  @param buf The (user-space) buffer.
+ *  @param count The most bytes to read.
+ *  @param offset Where in the file to start reading.
+ *
+ *  @return The number of bytes read on success; a negative integer error
+ *  code on failure.
+ **/
+int ramfs_read(const ramfs_file_s *file, char *buf, int count, int offset)
+{
+  int amt;
+
+  if (count < 0 || offset < 0) return -1;
+  if (offset >= file->execlen || !count) return 0;
+
+  amt = file->execlen - offset;
+  if (amt > count) amt = count;
+
+  if (copy_to_user(buf, file->execbytes + offset, amt)) return -1;
+  return amt;
+}
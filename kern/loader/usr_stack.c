@@ -1,58 +1,167 @@
-/** @file usr_stack
+/** @file usr_stack.c
+ *
+ *  @brief Builds new user stacks.
+ *
+ *  exec(...)'s arguments are copied straight out of the old address space
+ *  into a fresh frame, laid out as the top page of the new stack; once the
+ *  new address space is set up, that frame is simply mapped in.  So each
+ *  argument is copied exactly once, and nothing but the frame is allocated.
+ *
+ *  From the top down, the page holds argv, the argument strings, and then
+ *  _main(...)'s arguments.  Arguments that don't fit in the page are
+ *  refused.
+ *
+ *  @author Enrique Naudon (esn)
+ *  @author Marlies Ruck (mruck)
  **/
 #include <simics.h>
 
 #include <usr_stack.h>
 
-#include <vm.h>
+#include <frame_alloc.h>
+#include <mutex.h>
+#include <page_alloc.h>
+#include <sc_utils.h>
+#include <sched.h>
+#include <uaccess.h>
 #include <util.h>
+#include <vm.h>
+
+#include <stddef.h>
 
-#include <malloc.h>
-#include <string.h>
-#include <x86/cr.h>
 
+/* Where the staged page ends up */
+#define STAGE_PAGE ( (char *)USR_SP_HI - PAGE_SIZE )
 
-void *usr_stack_init(vm_info_s *vmi, int arg_cnt, char **arg_vec)
+/* Room for _main(...)'s arguments and "return address" */
+#define MAIN_ARGS_SIZE ( 5 * sizeof(unsigned int) )
+
+/** @brief Finds where a staged address currently is in the stage window.
+ *
+ *  @param win The stage window.
+ *  @param addr The address in the staged page.
+ *
+ *  @return The address in the window.
+ **/
+#define STAGED(win,addr) ( (char *)(win) + ((char *)(addr) - STAGE_PAGE) )
+
+/* Serializes use of the stage window */
+static mutex_s stage_lock = MUTEX_INITIALIZER(stage_lock);
+
+/** @brief Stages a new stack's arguments.
+ *
+ *  The vector is read twice, once to count it and once to copy it, so it
+ *  may change in between; if it got shorter, we fail.
+ *
+ *  @param st The stage to fill in.
+ *  @param argvec The (user-space) argument vector, or NULL for none.
+ *
+ *  @return 0 on success; a negative integer error code on failure.
+ **/
+int usr_stack_stage(usr_stage_s *st, char *argvec[])
 {
-  void *base, *sp;
-  char **argv = NULL;
-  int argv_len;
-  int i;
+  char *win, *sp, *arg;
+  size_t room, lim;
+  int argc, len, i;
 
-  /* Allocate user's stack */
-  base = USR_SP_HI - USR_STACK_SIZE;
-  vm_alloc(vmi, base, USR_STACK_SIZE, VM_ATTR_USER | VM_ATTR_RDWR);
-  sp = USR_SP_HI;
+  /* Count the arguments; argv alone has to leave room for _main(...) */
+  for (argc = 0; argvec; ++argc) {
+    if (copy_from_user_static(&arg, &argvec[argc], sizeof(char *)))
+      return -1;
+    if (!arg) break;
+    if ((argc + 2) * sizeof(char *) > PAGE_SIZE - MAIN_ARGS_SIZE) return -1;
+  }
+
+  /* The frame comes zeroed, so argv is already NULL-terminated */
+  if (!(st->frame = fr_alloc(&curr_thr->frmag))) return -1;
+  fr_ref(st->frame);
+
+  st->argc = argc;
+  st->argv = (char **)USR_SP_HI - (argc + 1);
+  sp = (char *)st->argv;
 
-  /* Calculate argc and malloc argv */
-  argv_len = arg_cnt + 1;
-  argv = malloc(argv_len * sizeof(char *) * sizeof(char *));
-  if (!argv) return NULL;
+  mutex_lock(&stage_lock);
+  win = kwin_map(KWIN_STAGE, st->frame);
 
-  /* Copy each arg string onto the user stack */
-  for (i = 0; i < argv_len; ++i)
+  /* Copy each string below the last */
+  for (i = 0; i < argc; ++i)
   {
-    sp = sp - CEILING(strlen(arg_vec[i]) + 1, sizeof(unsigned int));
-    strcpy(sp, arg_vec[i]);
-    argv[i] = sp;
+    if (copy_from_user_static(&arg, &argvec[i], sizeof(char *))
+        || !arg || !UACCESS_OK(arg, 0))
+      break;
+
+    room = sp - STAGE_PAGE - MAIN_ARGS_SIZE;
+    lim = MIN(room, UACCESS_LIMIT - (unsigned int)arg);
+    len = uaccess_strnlen(arg, lim);
+    if (len < 0 || (size_t)len >= lim) break;
+
+    sp -= CEILING(len + 1, sizeof(unsigned int));
+    if (uaccess_copy(STAGED(win, sp), arg, len)) break;
+    STAGED(win, sp)[len] = '\0';
+
+    ((char **)STAGED(win, st->argv))[i] = sp;
+  }
+
+  mutex_unlock(&stage_lock);
+
+  if (i < argc) {
+    usr_stack_unstage(st);
+    return -1;
   }
-  argv[i] = NULL;
 
-  /* Copy argv into the user stack */
-  sp = sp - CEILING(argv_len * sizeof(char *), sizeof(unsigned int));
-  memcpy(sp, argv, argv_len * sizeof(char *));
+  st->sp = sp;
+  return 0;
+}
 
-  /* Free up argv and point it to the stack */
-  free(argv);
-  argv = sp;
+/** @brief Throws away a stage that won't be used.
+ *
+ *  @param st The stage.
+ *
+ *  @return Void.
+ **/
+void usr_stack_unstage(usr_stage_s *st)
+{
+  if (!fr_unref(st->frame)) free_frame(st->frame);
+  st->frame = NULL;
+  return;
+}
+
+/** @brief Sets up a new user stack on top of a staged page.
+ *
+ *  The stage is used up either way.
+ *
+ *  @param vmi The new address space; it must be the one we're running in.
+ *  @param st The stage.
+ *
+ *  @return The new stack pointer, or NULL if we're out of memory.
+ **/
+void *usr_stack_init(vm_info_s *vmi, usr_stage_s *st)
+{
+  void *base, *sp, *frame;
+
+  /* Allocate user's stack */
+  base = USR_SP_HI - USR_STACK_SIZE;
+  if (!vm_alloc(vmi, base, USR_STACK_SIZE, VM_ATTR_USER | VM_ATTR_RDWR)) {
+    usr_stack_unstage(st);
+    return NULL;
+  }
+
+  /* Map the staged page in as its top */
+  frame = st->frame;
+  st->frame = NULL;
+  if (!pg_map_frame(&vmi->pg_info, STAGE_PAGE, frame,
+                    VM_ATTR_USER | VM_ATTR_RDWR))
+  {
+    return NULL;
+  }
+  sp = st->sp;
 
   /* Push _main(...)'s arguments */
   PUSH(sp,base);        /* stack_low */
   PUSH(sp,USR_SP_HI);   /* stack_high */
-  PUSH(sp,argv);        /* argv */
-  PUSH(sp,arg_cnt);     /* argc */
+  PUSH(sp,st->argv);    /* argv */
+  PUSH(sp,st->argc);    /* argc */
   PUSH(sp,0);           /* "return address" */
 
   return sp;
 }
-
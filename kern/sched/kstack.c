@@ -0,0 +1,203 @@
+/** @file kstack.c
+ *
+ *  @brief Implements the kernel stack pool.
+ *
+ *  At boot we reserve an arena of KSTACK_GUARDED stacks, each sitting on
+ *  top of a guard page.  Stacks are carved out of the arena (and their
+ *  guard pages unmapped) as they're first needed, and go back on a free
+ *  list when their thread dies, so a kernel stack overflow faults instead
+ *  of quietly trashing the heap.  Once the arena is spoken for, stacks come
+ *  from the heap; up to KSTACK_POOL_HWM of those are kept for reuse.
+ *
+ *  Free stacks are chained through their top word.  Every stack also has a
+ *  canary at its bottom, which we check on the way back in.
+ *
+ *  The guard page only turns an overflow into a fault; it doesn't make it
+ *  survivable.  The page fault handler runs on the stack that overflowed,
+ *  so pushing its frame faults again, and so does the double fault
+ *  handler's; the third fault resets the machine without a word about
+ *  which thread did it.  Reporting it would take a #DF task gate with a
+ *  stack of its own, and the GDT, which the 410 boot code owns, has room
+ *  for just the one TSS.  So a triple fault with a kernel %esp just above
+ *  a guard page (arena + n * SLOT_SIZE) is a stack overflow; that stack's
+ *  thread is the culprit.  Heap stacks have no guard at all, only the
+ *  canary.
+ *
+ *  @author Enrique Naudon (esn)
+ *  @author Marlies Ruck (mruck)
+ **/
+#include <simics.h>
+
+#include <kstack.h>
+
+/* Pebbles includes */
+#include <mutex.h>
+#include <pg_table.h>
+
+/* Libc includes */
+#include <assert.h>
+#include <malloc.h>
+#include <stddef.h>
+#include <stdlib.h>
+
+
+/* A guarded stack's slot in the arena: the guard page, then the stack */
+#define SLOT_SIZE ( (KSTACK_PAGES + 1) * PAGE_SIZE )
+
+/** @brief Gets a free stack's free list link.
+ *
+ *  @param ks The stack.
+ *
+ *  @return The link, as an lvalue.
+ **/
+#define KSTACK_LINK(ks) \
+  ( *(char **)((ks) + KSTACK_SIZE - sizeof(char *)) )
+
+/* The guarded arena, and how much of it we've carved */
+static char *arena;
+static int carved = 0;
+
+/* Free guarded and heap stacks */
+static char *guarded_free = NULL;
+static char *heap_free = NULL;
+
+/* Protects everything above and the stats */
+static mutex_s ks_lock = MUTEX_INITIALIZER(ks_lock);
+static kstack_stats_s stats;
+
+/** @brief Tells whether a stack came from the guarded arena.
+ *
+ *  @param ks The stack.
+ *
+ *  @return Nonzero if it did; 0 otherwise.
+ **/
+#define IS_GUARDED(ks) \
+  ( arena && arena <= (ks) && (ks) < arena + KSTACK_GUARDED * SLOT_SIZE )
+
+/*************************************************************************
+ *  Exported API
+ *************************************************************************/
+
+/** @brief Reserves the guarded stack arena.
+ *
+ *  Must be called before the kernel page tables are built (see
+ *  kern_reserve_fine(...)).  If we can't get the arena, every stack comes
+ *  from the heap.
+ *
+ *  @return Void.
+ **/
+void kstack_init(void)
+{
+  arena = kern_reserve_fine(KSTACK_GUARDED * SLOT_SIZE);
+  return;
+}
+
+/** @brief Allocates a kernel stack.
+ *
+ *  @return The stack's lowest address, or NULL if we're out of memory.
+ **/
+char *kstack_alloc(void)
+{
+  char *ks;
+
+  mutex_lock(&ks_lock);
+
+  /* Prefer recycled stacks, then fresh guarded ones */
+  if ((ks = guarded_free)) {
+    guarded_free = KSTACK_LINK(ks);
+    stats.recycled++;
+  }
+  else if (arena && carved < KSTACK_GUARDED) {
+    kern_unmap_page(arena + carved * SLOT_SIZE);
+    ks = arena + carved * SLOT_SIZE + PAGE_SIZE;
+    stats.carved = ++carved;
+  }
+  else if ((ks = heap_free)) {
+    heap_free = KSTACK_LINK(ks);
+    stats.pooled--;
+    stats.recycled++;
+  }
+
+  if (ks) {
+    stats.allocs++;
+    if (++stats.inuse > stats.peak) stats.peak = stats.inuse;
+  }
+  mutex_unlock(&ks_lock);
+
+  /* Last resort, the heap */
+  if (!ks) {
+    if (!(ks = smemalign(PAGE_SIZE, KSTACK_SIZE))) return NULL;
+
+    mutex_lock(&ks_lock);
+    stats.heap++;
+    stats.allocs++;
+    if (++stats.inuse > stats.peak) stats.peak = stats.inuse;
+    mutex_unlock(&ks_lock);
+  }
+
+  *(unsigned int *)ks = KSTACK_CANARY;
+  return ks;
+}
+
+/** @brief Returns a kernel stack to the pool.
+ *
+ *  @param ks The stack.
+ *
+ *  @return Void.
+ **/
+void kstack_free(char *ks)
+{
+  if (*(unsigned int *)ks != KSTACK_CANARY)
+    panic("Kernel stack %p overflowed", ks);
+
+  mutex_lock(&ks_lock);
+  stats.inuse--;
+
+  if (IS_GUARDED(ks)) {
+    KSTACK_LINK(ks) = guarded_free;
+    guarded_free = ks;
+  }
+  else if (stats.pooled < KSTACK_POOL_HWM) {
+    KSTACK_LINK(ks) = heap_free;
+    heap_free = ks;
+    stats.pooled++;
+  }
+  else {
+    mutex_unlock(&ks_lock);
+    sfree(ks, KSTACK_SIZE);
+    return;
+  }
+
+  mutex_unlock(&ks_lock);
+  return;
+}
+
+/** @brief Reads the kernel stack pool's counters.
+ *
+ *  @param dst Where to write the counters.
+ *
+ *  @return Void.
+ **/
+void kstack_get_stats(kstack_stats_s *dst)
+{
+  mutex_lock(&ks_lock);
+  *dst = stats;
+  mutex_unlock(&ks_lock);
+  return;
+}
+
+/** @brief Prints the kernel stack pool's counters to the simics console.
+ *
+ *  @return Void.
+ **/
+void kstack_dump_stats(void)
+{
+  kstack_stats_s s;
+
+  kstack_get_stats(&s);
+  lprintf("kstack: %u in use (peak %u), %u allocs, %u recycled, %u from "
+          "heap, %u/%u guarded carved, %u heap stacks pooled", s.inuse,
+          s.peak, s.allocs, s.recycled, s.heap, s.carved, KSTACK_GUARDED,
+          s.pooled);
+  return;
+}
@@ -10,14 +10,23 @@
 #include <cllist.h>
 #include <process.h>
 #include <sched.h>
+#include <slab.h>
 #include <thread.h>
 
 /* Libc specific includes */
 #include <assert.h>
 #include <malloc.h>
 #include <stdlib.h>
+#include <string.h>
 
 
+/* PCBs and the mini PCBs that outlive them get their own caches, since
+ * every fork needs one of each */
+static slab_cache_s task_cache = SLAB_CACHE_INITIALIZER(task_cache, task_t,
+                                                        NULL);
+static slab_cache_s mini_cache = SLAB_CACHE_INITIALIZER(mini_cache,
+                                                        mini_pcb_s, NULL);
+
 /*************************************************************************
  *  Task manipulation
  *************************************************************************/
@@ -30,7 +39,7 @@
 thread_t *task_init(void)
 {
   /* Allocate a PCB */
-  task_t *task = malloc(sizeof(task_t));
+  task_t *task = slab_alloc(&task_cache);
   if(!task) return NULL;
 
   /* Initialize vm */
@@ -49,6 +58,10 @@ thread_t *task_init(void)
 
   task->parent_tid = TASK_TID(curr_tsk);
 
+  /* No open files or shared memory grants */
+  memset(task->files, 0, sizeof(task->files));
+  memset(task->shm_grants, 0, sizeof(task->shm_grants));
+
   /* Initialize the task struct lock */
   mutex_init(&task->lock);
 
@@ -56,19 +69,19 @@ thread_t *task_init(void)
   thread_t *thread = thread_init(task);
   if(!thread) {
     vm_final(&task->vmi);
-    sfree((void *)(task->cr3), PAGE_SIZE);
-    free(task);
+    pd_free((pte_t *)(task->cr3));
+    slab_free(&task_cache, task);
     return NULL;
   }
   task_add_thread(task);
 
   /* Allocate and initialize the mini PCB */
-  task->mini_pcb = malloc(sizeof(mini_pcb_s));
+  task->mini_pcb = slab_alloc(&mini_cache);
   if (!task->mini_pcb) {
     thr_free(thread);
     vm_final(&task->vmi);
-    sfree((void *)(task->cr3), PAGE_SIZE);
-    free(task);
+    pd_free((pte_t *)(task->cr3));
+    slab_free(&task_cache, task);
     return NULL;
   }
   TASK_STATUS(task) = 0;
@@ -215,7 +228,7 @@ void task_free(task_t *task)
   while(!queue_empty(&task->dead_children)){
     n = queue_dequeue(&task->dead_children);
     mini = queue_entry(mini_pcb_s *, n);
-    free(mini);
+    slab_free(&mini_cache, mini);
   }
 
   /* Free your last dead child */
@@ -251,8 +264,8 @@ void task_final(task_t *victim)
 
   /* Free the task's resources */
   thr_free(victim->dead_thr);
-  sfree((void *)(victim->cr3), PAGE_SIZE);
-  free(victim);
+  pd_free((pte_t *)(victim->cr3));
+  slab_free(&task_cache, victim);
 
   return;
 }
@@ -304,10 +317,25 @@ int task_reap(task_t *task, int *status)
   /* Relinquish lock */
   mutex_unlock(&task->lock);
 
-  free(mini);
+  slab_free(&mini_cache, mini);
   return tid;
 }
 
+/** @brief Free a mini PCB.
+ *
+ *  Only needed for tasks that die before anyone could enqueue their mini
+ *  PCB; task_free(...) and task_reap(...) take care of the rest.
+ *
+ *  @param mini The mini PCB.
+ *
+ *  @return Void.
+ **/
+void task_free_mini(mini_pcb_s *mini)
+{
+  slab_free(&mini_cache, mini);
+  return;
+}
+
 
 /*************************************************************************
  *  Task list manipulation
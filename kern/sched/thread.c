@@ -19,6 +19,7 @@
 #include <process.h>
 #include <sched.h>
 #include <sc_utils.h>
+#include <slab.h>
 #include <thread.h>
 #include <util.h>
 #include <vm.h>
@@ -37,6 +38,29 @@ static mutex_s thrlist_lock = MUTEX_INITIALIZER(thrlist_lock);
 /* For traversing the global thread list */
 static cll_list *rover = NULL;
 
+/** @brief Constructs a TCB for the thread cache.
+ *
+ *  The embedded list nodes always point back at their thread, and stay
+ *  that way while the TCB sits free in the cache.
+ *
+ *  @param obj The TCB.
+ *
+ *  @return Void.
+ **/
+static void thread_ctor(void *obj)
+{
+  thread_t *thread = obj;
+
+  cll_init_node(&thread->rq_entry, thread);
+  cll_init_node(&thread->task_node, thread);
+  cll_init_node(&thread->thrlist_entry, thread);
+  return;
+}
+
+/* TCBs come from their own cache, since every fork and thread_fork needs one */
+static slab_cache_s thread_cache =
+  SLAB_CACHE_INITIALIZER(thread_cache, thread_t, thread_ctor);
+
 /* @brief Initialize a thread.
  *
  * Allocate a thread_t struct and atomically acquires a TID.
@@ -49,13 +73,13 @@ thread_t *thread_init(task_t *task)
   assert(task);
 
   /* Allocate the thread structure */
-  thread_t *thread = malloc(sizeof(thread_t));
+  thread_t *thread = slab_alloc(&thread_cache);
   if (!thread) return NULL;
 
   /* Allocate the kernel stack */
-  thread->kstack = smemalign(KSTACK_ALIGN, KSTACK_SIZE);
+  thread->kstack = kstack_alloc();
   if (!thread->kstack) {
-    free(thread);
+    slab_free(&thread_cache, thread);
     return NULL;
   }
 
@@ -66,11 +90,7 @@ thread_t *thread_init(task_t *task)
   thread->sp = NULL;
   thread->pc = NULL;
   thread->desched = THR_NOT_DESCHED;
-
-  /* Embedded list traversal */
-  cll_init_node(&thread->rq_entry, thread);
-  cll_init_node(&thread->task_node, thread);
-  cll_init_node(&thread->thrlist_entry, thread);
+  fr_mag_init(&thread->frmag);
 
   /* No software exception handlers should be registered */
   swexn_deregister(&thread->swexn); 
@@ -83,7 +103,8 @@ thread_t *thread_init(task_t *task)
 
 /** @brief Free a thread.
  *
- *  We free the thread's kernel stack, then the thread's TCB.
+ *  We return the thread's cached frames, the thread's kernel stack to the
+ *  stack pool, then the thread's TCB to its cache.
  *
  *  @param t The thread to free.
  *
@@ -92,8 +113,9 @@ thread_t *thread_init(task_t *task)
 void thr_free(thread_t *t)
 {
   mutex_final(&t->lock);
-  sfree(t->kstack, PAGE_SIZE);
-  free(t);
+  fr_mag_final(&t->frmag);
+  kstack_free(t->kstack);
+  slab_free(&thread_cache, t);
   return;
 }
 
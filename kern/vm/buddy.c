@@ -0,0 +1,239 @@
+/** @file buddy.c
+ *
+ *  @brief Implements our buddy allocator.
+ *
+ *  The buddy allocator hands out physically contiguous, naturally aligned
+ *  blocks of 2^order frames from a 4MB-aligned pool at the top of user
+ *  memory.  Frames in the pool are never touched: all of the bookkeeping
+ *  lives in an out-of-band array with one entry per frame, and blocks are
+ *  handed out dirty.
+ *
+ *  @author Enrique Naudon (esn)
+ *  @author Marlies Ruck (mruck)
+ **/
+#include <simics.h>
+
+/* Buddy allocator includes */
+#include <buddy.h>
+
+/* Pebbles includes */
+#include <mutex.h>
+#include <util.h>
+
+/* Libc includes */
+#include <assert.h>
+#include <malloc.h>
+#include <stddef.h>
+#include <string.h>
+
+/* No block */
+#define BUDDY_NIL (-1)
+
+/** @struct buddy_block
+ *  @brief Bookkeeping for the block starting at a given frame.
+ *
+ *  Only the entry for a block's first frame is meaningful.
+ **/
+struct buddy_block {
+  int next;           /**< Next free block of the same order **/
+  int prev;           /**< Previous free block of the same order **/
+  signed char order;  /**< The block's order **/
+  char free;          /**< Whether the block is free **/
+};
+typedef struct buddy_block buddy_block_s;
+
+/* The pool */
+static char *base = NULL;
+static int nframes = 0;
+static buddy_block_s *blocks = NULL;
+
+/* Heads of the per-order free lists */
+static int heads[BUDDY_ORDERS];
+
+static buddy_stats_s stats;
+
+static mutex_s buddy_lock = MUTEX_INITIALIZER(buddy_lock);
+
+
+/*************************************************************************
+ *  Free list manipulation
+ *************************************************************************/
+
+static void push_block(int i, int order)
+{
+  blocks[i].order = order;
+  blocks[i].free = 1;
+  blocks[i].prev = BUDDY_NIL;
+  blocks[i].next = heads[order];
+  if (heads[order] != BUDDY_NIL) blocks[heads[order]].prev = i;
+  heads[order] = i;
+
+  ++stats.free_blocks[order];
+  return;
+}
+
+static void remove_block(int i)
+{
+  int order = blocks[i].order;
+
+  if (blocks[i].prev != BUDDY_NIL) blocks[blocks[i].prev].next = blocks[i].next;
+  else heads[order] = blocks[i].next;
+  if (blocks[i].next != BUDDY_NIL) blocks[blocks[i].next].prev = blocks[i].prev;
+  blocks[i].free = 0;
+
+  --stats.free_blocks[order];
+  return;
+}
+
+
+/*************************************************************************
+ *  Exported API
+ *************************************************************************/
+
+/** @brief Initialize the buddy allocator.
+ *
+ *  @param start The first byte of the pool; must be BUDDY_BLOCK_SIZE-aligned.
+ *  @param limit The first byte after the pool; must be BUDDY_BLOCK_SIZE-aligned.
+ *
+ *  @return 0 on success; a negative integer error code on failure.
+ **/
+int buddy_init(void *start, void *limit)
+{
+  int i;
+
+  assert(FLOOR(start, BUDDY_BLOCK_SIZE) == (unsigned int)start);
+  assert(FLOOR(limit, BUDDY_BLOCK_SIZE) == (unsigned int)limit);
+
+  for (i = 0; i < BUDDY_ORDERS; ++i)
+    heads[i] = BUDDY_NIL;
+  memset(&stats, 0, sizeof(stats));
+
+  base = start;
+  nframes = ((char *)limit - (char *)start)/PAGE_SIZE;
+  if (!nframes) return 0;
+
+  blocks = calloc(nframes, sizeof(buddy_block_s));
+  if (!blocks) {
+    nframes = 0;
+    return -1;
+  }
+
+  /* The pool starts out as max-order blocks */
+  for (i = nframes - BUDDY_BLOCK_FRAMES; i >= 0; i -= BUDDY_BLOCK_FRAMES)
+    push_block(i, BUDDY_MAX_ORDER);
+
+  return 0;
+}
+
+/** @brief Allocate a block of physically contiguous frames.
+ *
+ *  We take the smallest free block that's big enough and split it until
+ *  it's the right size, freeing the upper halves.
+ *
+ *  @param order The block's order (2^order frames).
+ *
+ *  @return The block's physical address, or NULL if there's no such block.
+ **/
+void *buddy_alloc(int order)
+{
+  int i, k;
+
+  assert(0 <= order && order <= BUDDY_MAX_ORDER);
+
+  mutex_lock(&buddy_lock);
+
+  /* Find the smallest block that fits */
+  for (k = order; k <= BUDDY_MAX_ORDER && heads[k] == BUDDY_NIL; ++k)
+    continue;
+  if (k > BUDDY_MAX_ORDER) {
+    ++stats.fails;
+    mutex_unlock(&buddy_lock);
+    return NULL;
+  }
+  i = heads[k];
+  remove_block(i);
+
+  /* Split it down to size */
+  while (k > order) {
+    --k;
+    push_block(i + (1 << k), k);
+    ++stats.splits;
+  }
+  blocks[i].order = order;
+  ++stats.allocs;
+
+  mutex_unlock(&buddy_lock);
+
+  return base + i * PAGE_SIZE;
+}
+
+/** @brief Free a block of frames.
+ *
+ *  The block is merged with its buddy for as long as the buddy is free.
+ *
+ *  @param block The block's physical address.
+ *  @param order The order the block was allocated with.
+ *
+ *  @return Void.
+ **/
+void buddy_free(void *block, int order)
+{
+  int i, b;
+
+  i = ((char *)block - base)/PAGE_SIZE;
+  assert(0 <= i && i < nframes);
+
+  mutex_lock(&buddy_lock);
+
+  assert(!blocks[i].free && blocks[i].order == order);
+  ++stats.frees;
+
+  /* Coalesce with free buddies */
+  while (order < BUDDY_MAX_ORDER) {
+    b = i ^ (1 << order);
+    if (!blocks[b].free || blocks[b].order != order) break;
+    remove_block(b);
+    if (b < i) i = b;
+    ++order;
+    ++stats.coalesces;
+  }
+  push_block(i, order);
+
+  mutex_unlock(&buddy_lock);
+
+  return;
+}
+
+/** @brief Take a snapshot of the allocator's statistics.
+ *
+ *  @param dst Where to store the statistics.
+ *
+ *  @return Void.
+ **/
+void buddy_get_stats(buddy_stats_s *dst)
+{
+  mutex_lock(&buddy_lock);
+  *dst = stats;
+  mutex_unlock(&buddy_lock);
+  return;
+}
+
+/** @brief Print the allocator's statistics to the simics console.
+ *
+ *  @return Void.
+ **/
+void buddy_dump_stats(void)
+{
+  buddy_stats_s snap;
+  int i;
+
+  buddy_get_stats(&snap);
+
+  lprintf("buddy: %d frames at %p", nframes, base);
+  lprintf("buddy: %u allocs, %u fails, %u frees, %u splits, %u coalesces",
+          snap.allocs, snap.fails, snap.frees, snap.splits, snap.coalesces);
+  for (i = 0; i < BUDDY_ORDERS; ++i)
+    lprintf("buddy: order %d: %u free", i, snap.free_blocks[i]);
+
+  return;
+}
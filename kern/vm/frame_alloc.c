@@ -11,76 +11,581 @@
 #include <frame_alloc.h>
 
 /* Pebbles includes */
+#include <buddy.h>
+#include <cllist.h>
 #include <common_kern.h>
 #include <util.h>
 #include <page_alloc.h>
+#include <pg_table.h>
+#include <atomic.h>
 
 /* Libc includes */
 #include <stddef.h>
 #include <stdint.h>
 #include <assert.h>
+#include <malloc.h>
+#include <string.h>
 
 #define FIRST_FRAME_INDEX ( USER_MEM_START/sizeof(frame_t) )
 
+/** @brief Calculate a frame's index into the reference count array.
+ *
+ *  @param frame The frame.
+ *
+ *  @return The frame's reference count index.
+ **/
+#define REFCNT_INDEX(frame) \
+  ( ((unsigned int) (frame))/sizeof(frame_t) - FIRST_FRAME_INDEX )
+
 const frame_t *frames = (const frame_t *)NULL;
 int fr_avail = 0;
 
+/** @brief Atomically adjust the number of free frames.
+ *
+ *  @param n The number of frames freed (or, if negative, allocated).
+ *
+ *  @return Void.
+ **/
+#define FR_AVAIL_ADD(n) \
+  ( (void)fetch_and_add((volatile unsigned int *)&fr_avail, (n)) )
+
 mutex_s frame_allocator_lock = MUTEX_INITIALIZER(frame_allocator_lock);
 
-/* Pointer to the head of the free list */
-static void *freelist_p;
+/* The free frames.  Pre-zeroed frames are stacked up from the bottom, and
+ * dirty frames down from the top; stats holds the size of each pool.
+ */
+static void **fr_stack;
+static int fr_cap;
+
+/* Pool sizes and hit rates */
+static fr_stats_s stats;
+
+/* Push/pop frames to/from either end of the frame stack */
+#define PUSH_ZEROED(frame)  ( fr_stack[stats.zeroed++] = (frame) )
+#define POP_ZEROED()        ( fr_stack[--stats.zeroed] )
+#define PUSH_DIRTY(frame)   ( fr_stack[fr_cap - ++stats.dirty] = (frame) )
+#define POP_DIRTY()         ( fr_stack[fr_cap - stats.dirty--] )
+
+/* Number of mappings of each user frame */
+static unsigned int *refcnts;
+
+/* The buddy allocator's pool; frames borrowed from it go back to it */
+static void *bud_start, *bud_limit;
+#define IN_BUDDY_POOL(frame) \
+  ( bud_start <= (void *)(frame) && (void *)(frame) < bud_limit )
+
+/* Every thread's magazine, so their frames can be pulled back on OOM */
+static cll_list mag_list = CLL_LIST_INITIALIZER(mag_list);
+static mutex_s mag_list_lock = MUTEX_INITIALIZER(mag_list_lock);
+
+static int mags_reclaim(fr_mag_s *self);
 
 /** @brief Initialize frame allocator.
  *
- *  Stride through user memory and our implicit free list by making each free
- *  frame point to the next free frame.
+ *  Whole 4MB blocks at the top of user memory are set aside for the buddy
+ *  allocator.  The rest of user memory goes on the frame stack; we don't
+ *  know what's in it, so it starts out dirty.  The buddy pool isn't lost to
+ *  single frames, though: once the frame stack runs dry, frames are
+ *  borrowed from it, so its free frames count as available too.
  *
  *  @return Void.
  **/
 void fr_init_allocator(void)
 {
-  int i;
+  int i, bud_lo, bud_hi;
   int lim = machine_phys_frames();
 
-  for(i = FIRST_FRAME_INDEX; i < lim - 1; i++){
-    *((uint32_t *)frames[i]) = (uint32_t)(frames[i + 1]);
-    ++fr_avail;
+  /* Nobody maps anything yet */
+  refcnts = calloc(lim - FIRST_FRAME_INDEX, sizeof(unsigned int));
+  assert(refcnts);
+
+  /* Carve out the buddy allocator's pool */
+  bud_hi = FLOOR(lim, BUDDY_BLOCK_FRAMES);
+  bud_lo = bud_hi - FLOOR((lim - FIRST_FRAME_INDEX)/BUDDY_POOL_DIVISOR,
+                          BUDDY_BLOCK_FRAMES);
+  bud_start = (void *)frames[bud_lo];
+  bud_limit = (void *)frames[bud_hi];
+  assert( !buddy_init(bud_start, bud_limit) );
+
+  /* Allocate the frame stack */
+  fr_cap = (lim - FIRST_FRAME_INDEX) - (bud_hi - bud_lo);
+  fr_stack = malloc(fr_cap * sizeof(void *));
+  assert(fr_stack);
+
+  /* Stack the frames back to front, so the lowest frame is on top */
+  for(i = lim - 1; i >= FIRST_FRAME_INDEX; i--){
+    if (bud_lo <= i && i < bud_hi) continue;
+    PUSH_DIRTY((void *)frames[i]);
   }
- *((uint32_t *)(frames[i])) = 0;
+  fr_avail = fr_cap + (bud_hi - bud_lo);
+
+  return;
+}
+
+
+/*************************************************************************
+ *  Frame reference counting
+ *************************************************************************/
+
+/** @brief Add a reference to a frame.
+ *
+ *  Frames are shared after a fork(...) until one of the sharers writes to
+ *  the page; the frame may only be freed once every sharer has dropped its
+ *  reference.  Reference counts are updated atomically, so the frame
+ *  allocator need not be locked.
+ *
+ *  @param frame The frame being mapped.
+ *
+ *  @return Void.
+ **/
+void fr_ref(void *frame)
+{
+  fetch_and_add(&refcnts[REFCNT_INDEX(frame)], 1);
+  return;
+}
+
+/** @brief Drop a reference to a frame.
+ *
+ *  @param frame The frame being unmapped.
+ *
+ *  @return The number of references that remain.
+ **/
+int fr_unref(void *frame)
+{
+  unsigned int old;
 
- freelist_p = (void *)(frames[FIRST_FRAME_INDEX]);
+  old = fetch_and_add(&refcnts[REFCNT_INDEX(frame)], -1);
+  assert(old > 0);
 
- return;
+  return old - 1;
 }
 
-/** @brief Retrieves head of free list.
+/** @brief Count the references to a frame.
  *
- *  Our frame allocator is implemented as an implicit free list.  This function
- *  acquires free the list lock and returns the head of the list. The allocator
- *  makes several assumptions:
- *  -The free list is locked.
- *  -The old head of the free list is stored in the new head of free list
- *  before it's mapping is invalidated. 
- *  -update_head() is called immediately after
+ *  @param frame The frame.
  *
- *  @return Head of free list.
- */
-void *fr_retrieve_head(void)
+ *  @return The frame's reference count.
+ **/
+int fr_refcnt(void *frame)
+{
+  return refcnts[REFCNT_INDEX(frame)];
+}
+
+
+/*************************************************************************
+ *  Batched allocation
+ *************************************************************************/
+
+/** @brief Take frames off the frame stack.
+ *
+ *  Frames are handed out zeroed, so they may be mapped read-only straight
+ *  away.  We prefer pre-zeroed frames, but fall back to zeroing dirty ones.
+ *  The frames are still counted as available; that's up to the caller.
+ *
+ *  @param frames An array to store the frames in.
+ *  @param n The number of frames wanted.
+ *
+ *  @return The number of frames taken, which may be less than n.
+ **/
+static int stack_pop(void **frames, int n)
+{
+  int i;
+
+  mutex_lock(&frame_allocator_lock);
+
+  for (i = 0; i < n && stats.zeroed; ++i) {
+    frames[i] = POP_ZEROED();
+    ++stats.zero_hits;
+  }
+
+  for ( ; i < n && stats.dirty; ++i) {
+    frames[i] = POP_DIRTY();
+    memset(kwin_map(KWIN_FRAME_ALLOC, frames[i]), 0, PAGE_SIZE);
+    ++stats.zero_misses;
+  }
+
+  mutex_unlock(&frame_allocator_lock);
+
+  return i;
+}
+
+/** @brief Borrow single frames from the buddy allocator's pool.
+ *
+ *  This is the last resort, since it fragments the pool that large pages
+ *  come from.  The frames go back to the pool when they're freed.
+ *
+ *  @param frames An array to store the frames in.
+ *  @param n The number of frames wanted.
+ *
+ *  @return The number of frames borrowed, which may be less than n.
+ **/
+static int pool_borrow(void **frames, int n)
+{
+  int i;
+
+  mutex_lock(&frame_allocator_lock);
+
+  for (i = 0; i < n && (frames[i] = buddy_alloc(0)); ++i) {
+    memset(kwin_map(KWIN_FRAME_ALLOC, frames[i]), 0, PAGE_SIZE);
+    ++stats.zero_misses;
+    ++stats.borrowed;
+  }
+
+  mutex_unlock(&frame_allocator_lock);
+
+  return i;
+}
+
+/** @brief Put frames back on the frame stack.
+ *
+ *  The frames' contents are never touched; dirty frames are left for the
+ *  background zeroer.  Frames borrowed from the buddy allocator's pool are
+ *  returned to it instead.
+ *
+ *  @param frames The frames.
+ *  @param n The number of frames.
+ *  @param zeroed Whether the frames are already zeroed.
+ *
+ *  @return Void.
+ **/
+static void stack_push(void **frames, int n, int zeroed)
+{
+  int i;
+
+  mutex_lock(&frame_allocator_lock);
+
+  for (i = 0; i < n; ++i) {
+    if (IN_BUDDY_POOL(frames[i])) {
+      buddy_free(frames[i], 0);
+      --stats.borrowed;
+    }
+    else if (zeroed) PUSH_ZEROED(frames[i]);
+    else PUSH_DIRTY(frames[i]);
+  }
+
+  mutex_unlock(&frame_allocator_lock);
+
+  return;
+}
+
+/** @brief Allocate several frames under one lock acquisition.
+ *
+ *  If the frame stack runs dry, frames cached in threads' magazines are
+ *  pulled back, and then frames are borrowed from the buddy allocator,
+ *  before we give up.
+ *
+ *  @param frames An array to store the frames in.
+ *  @param n The number of frames wanted.
+ *
+ *  @return The number of frames allocated, which may be less than n.
+ **/
+int fr_alloc_batch(void **frames, int n)
+{
+  int got;
+
+  got = stack_pop(frames, n);
+  if (got < n && mags_reclaim(NULL))
+    got += stack_pop(&frames[got], n - got);
+  if (got < n)
+    got += pool_borrow(&frames[got], n - got);
+  FR_AVAIL_ADD(-got);
+
+  return got;
+}
+
+/** @brief Free several frames under one lock acquisition.
+ *
+ *  @param frames The frames to free.
+ *  @param n The number of frames.
+ *  @param zeroed Whether the frames are already zeroed.
+ *
+ *  @return Void.
+ **/
+void fr_free_batch(void **frames, int n, int zeroed)
+{
+  stack_push(frames, n, zeroed);
+  FR_AVAIL_ADD(n);
+  return;
+}
+
+
+/*************************************************************************
+ *  Contiguous blocks
+ *************************************************************************/
+
+/** @brief Allocate a block of physically contiguous frames.
+ *
+ *  Blocks come from the buddy allocator; this just keeps fr_avail honest.
+ *  They come back dirty.
+ *
+ *  @param order The block's order (2^order frames).
+ *
+ *  @return The block, or NULL if there's no such block.
+ **/
+void *fr_alloc_block(int order)
+{
+  void *block;
+
+  block = buddy_alloc(order);
+  if (block) FR_AVAIL_ADD(-(1 << order));
+
+  return block;
+}
+
+/** @brief Free a block of physically contiguous frames.
+ *
+ *  @param block The block.
+ *  @param order The order it was allocated with.
+ *
+ *  @return Void.
+ **/
+void fr_free_block(void *block, int order)
+{
+  buddy_free(block, order);
+  FR_AVAIL_ADD(1 << order);
+  return;
+}
+
+
+/*************************************************************************
+ *  Background zeroing
+ *************************************************************************/
+
+/** @brief Move a few frames from the dirty pool to the zeroed pool.
+ *
+ *  This is called from the idle thread's loop, so it never blocks: if the
+ *  frame allocator is busy we simply try again on the next pass.  The lock
+ *  is held only for a small budget of frames, so an allocating thread that
+ *  preempts us doesn't wait long.
+ *
+ *  @param budget The most frames to zero.
+ *
+ *  @return The number of frames zeroed.
+ **/
+int fr_zero_idle(int budget)
+{
+  void *frame;
+  int i;
+
+  if (!stats.dirty || mutex_trylock(&frame_allocator_lock))
+    return 0;
+
+  for (i = 0; i < budget && stats.dirty; ++i) {
+    frame = POP_DIRTY();
+    memset(kwin_map(KWIN_FRAME_ALLOC, frame), 0, PAGE_SIZE);
+    PUSH_ZEROED(frame);
+  }
+  stats.bg_zeroed += i;
+
+  mutex_unlock(&frame_allocator_lock);
+
+  return i;
+}
+
+/** @brief Take a snapshot of the frame allocator's statistics.
+ *
+ *  @param dst Where to store the statistics.
+ *
+ *  @return Void.
+ **/
+void fr_get_stats(fr_stats_s *dst)
+{
+  mutex_lock(&frame_allocator_lock);
+  *dst = stats;
+  mutex_unlock(&frame_allocator_lock);
+  return;
+}
+
+/** @brief Print the frame allocator's statistics to the simics console.
+ *
+ *  @return Void.
+ **/
+void fr_dump_stats(void)
 {
-  return freelist_p;
+  fr_stats_s snap;
+  unsigned int allocs;
+
+  fr_get_stats(&snap);
+  allocs = snap.zero_hits + snap.zero_misses;
+
+  lprintf("frames: %u zeroed, %u dirty, %d available", snap.zeroed,
+          snap.dirty, fr_avail);
+  lprintf("frames: %u/%u allocations pre-zeroed (%u%%), %u zeroed in idle",
+          snap.zero_hits, allocs, allocs ? 100*snap.zero_hits/allocs : 100,
+          snap.bg_zeroed);
+  lprintf("frames: %u borrowed from the buddy pool", snap.borrowed);
+
+  return;
 }
 
-/** @brief Update free list with address of newly freed frame
+
+/*************************************************************************
+ *  Frame magazines
+ *************************************************************************/
+
+/** @brief Return all of a magazine's frames to the frame stack.
  *
- *  Assumes free list is locked. 
+ *  The frames stay available; they're just no longer cached.  The caller
+ *  must hold the magazine's lock.
  *
- *  @param frame Address of frame.
+ *  @param mag The magazine.
  *
  *  @return Void.
  **/
-void fr_update_head(void *frame)
+static void mag_empty(fr_mag_s *mag)
 {
-  freelist_p = frame;
+  if (mag->count) stack_push(mag->frames, mag->count, 1);
+  if (mag->ndirty) stack_push(mag->dirty, mag->ndirty, 0);
+  mag->count = 0;
+  mag->ndirty = 0;
   return;
 }
 
+/** @brief Pull every magazine's frames back to the frame stack.
+ *
+ *  Magazines whose owners are using them right now are skipped rather than
+ *  waited for, so this never blocks on another thread's magazine.
+ *
+ *  @param self The caller's magazine, whose lock it already holds, or NULL.
+ *
+ *  @return The number of frames returned to the frame stack.
+ **/
+static int mags_reclaim(fr_mag_s *self)
+{
+  fr_mag_s *mag;
+  cll_node *n;
+  int got = 0;
+
+  mutex_lock(&mag_list_lock);
+
+  cll_foreach(&mag_list, n) {
+    mag = cll_entry(fr_mag_s *, n);
+    if (mag != self && mutex_trylock(&mag->lock)) continue;
+    got += mag->count + mag->ndirty;
+    mag_empty(mag);
+    if (mag != self) mutex_unlock(&mag->lock);
+  }
+
+  mutex_unlock(&mag_list_lock);
+
+  return got;
+}
+
+/** @brief Initialize an empty magazine.
+ *
+ *  @param mag The magazine.
+ *
+ *  @return Void.
+ **/
+void fr_mag_init(fr_mag_s *mag)
+{
+  mag->count = 0;
+  mag->ndirty = 0;
+  mutex_init(&mag->lock);
+  cll_init_node(&mag->node, mag);
+
+  mutex_lock(&mag_list_lock);
+  cll_insert(&mag_list, &mag->node);
+  mutex_unlock(&mag_list_lock);
+
+  return;
+}
+
+/** @brief Return all of a magazine's frames to the frame stack.
+ *
+ *  @param mag The magazine.
+ *
+ *  @return Void.
+ **/
+void fr_mag_drain(fr_mag_s *mag)
+{
+  mutex_lock(&mag->lock);
+  mag_empty(mag);
+  mutex_unlock(&mag->lock);
+  return;
+}
+
+/** @brief Drain a magazine and stop tracking it.
+ *
+ *  @param mag The magazine.
+ *
+ *  @return Void.
+ **/
+void fr_mag_final(fr_mag_s *mag)
+{
+  mutex_lock(&mag_list_lock);
+  assert(cll_extract(&mag_list, &mag->node));
+  mutex_unlock(&mag_list_lock);
+
+  fr_mag_drain(mag);
+  mutex_final(&mag->lock);
+  return;
+}
+
+/** @brief Allocate a zeroed frame.
+ *
+ *  Frames come from the magazine if it has any; an empty magazine is
+ *  refilled with half its capacity at once.  Each magazine's lock is
+ *  normally only taken by its owner, so only refills touch the frame
+ *  allocator lock.  If the frame stack is empty too, we pull back the
+ *  frames other threads' magazines are sitting on, and failing that borrow
+ *  one from the buddy allocator.
+ *
+ *  @param mag The caller's magazine, or NULL to use the frame stack directly.
+ *
+ *  @return A frame, or NULL if we're out of memory.
+ **/
+void *fr_alloc(fr_mag_s *mag)
+{
+  void *frame;
+
+  if (!mag)
+    return fr_alloc_batch(&frame, 1) ? frame : NULL;
+
+  mutex_lock(&mag->lock);
+
+  if (!mag->count)
+    mag->count = stack_pop(mag->frames, FR_MAG_BATCH);
+  if (!mag->count && mags_reclaim(mag))
+    mag->count = stack_pop(mag->frames, FR_MAG_BATCH);
+  if (!mag->count)
+    mag->count = pool_borrow(mag->frames, 1);
+  frame = mag->count ? mag->frames[--mag->count] : NULL;
+
+  mutex_unlock(&mag->lock);
+
+  if (frame) FR_AVAIL_ADD(-1);
+  return frame;
+}
+
+/** @brief Free a (dirty) frame.
+ *
+ *  The frame's contents are left alone; it will be zeroed in the background
+ *  or when it's next allocated.  A full magazine drains half its dirty
+ *  frames to the dirty pool first.
+ *
+ *  @param mag The caller's magazine, or NULL to use the frame stack directly.
+ *  @param frame The frame to free.
+ *
+ *  @return Void.
+ **/
+void fr_free(fr_mag_s *mag, void *frame)
+{
+  if (!mag) {
+    fr_free_batch(&frame, 1, 0);
+    return;
+  }
+
+  mutex_lock(&mag->lock);
+
+  if (mag->ndirty == FR_MAG_SIZE) {
+    mag->ndirty -= FR_MAG_BATCH;
+    stack_push(&mag->dirty[mag->ndirty], FR_MAG_BATCH, 0);
+  }
+  mag->dirty[mag->ndirty++] = frame;
+
+  mutex_unlock(&mag->lock);
+
+  FR_AVAIL_ADD(1);
+  return;
+}
@@ -12,15 +12,165 @@
 /* Memory region includes */
 #include <mreg.h>
 
+/* Pebbles includes */
+#include <slab.h>
+
 /* Libc includes */
 #include <assert.h>
-#include <malloc.h>
 #include <stddef.h>
 
+/** @brief Height of a (possibly empty) subtree.
+ *
+ *  @param n The subtree's root.
+ *
+ *  @return The subtree's height.
+ **/
+#define HEIGHT(n) \
+  ( (n) ? (n)->height : 0 )
+
+/* Regions come and go with every new_pages and fork */
+static slab_cache_s mreg_cache = SLAB_CACHE_INITIALIZER(mreg_cache,
+                                                        mem_region_s, NULL);
+
+/*************************************************************************
+ *  Region tree
+ *************************************************************************/
+
+static void fix_height(mem_region_s *n)
+{
+  int l = HEIGHT(n->left);
+  int r = HEIGHT(n->right);
+
+  n->height = 1 + (l > r ? l : r);
+  return;
+}
+
+static mem_region_s *rotate_right(mem_region_s *n)
+{
+  mem_region_s *l = n->left;
+
+  n->left = l->right;
+  l->right = n;
+  fix_height(n);
+  fix_height(l);
+
+  return l;
+}
+
+static mem_region_s *rotate_left(mem_region_s *n)
+{
+  mem_region_s *r = n->right;
+
+  n->right = r->left;
+  r->left = n;
+  fix_height(n);
+  fix_height(r);
+
+  return r;
+}
+
+/** @brief Restore the AVL invariant at a node whose subtrees are balanced.
+ *
+ *  @param n The node.
+ *
+ *  @return The root of the rebalanced subtree.
+ **/
+static mem_region_s *rebalance(mem_region_s *n)
+{
+  int bal;
+
+  fix_height(n);
+  bal = HEIGHT(n->left) - HEIGHT(n->right);
+
+  /* Left heavy */
+  if (bal > 1) {
+    if (HEIGHT(n->left->left) < HEIGHT(n->left->right))
+      n->left = rotate_left(n->left);
+    return rotate_right(n);
+  }
+
+  /* Right heavy */
+  if (bal < -1) {
+    if (HEIGHT(n->right->right) < HEIGHT(n->right->left))
+      n->right = rotate_right(n->right);
+    return rotate_left(n);
+  }
+
+  return n;
+}
+
+static mem_region_s *tree_insert(mem_region_s *root, mem_region_s *new)
+{
+  if (!root) return new;
+
+  if (new->start < root->start)
+    root->left = tree_insert(root->left, new);
+  else
+    root->right = tree_insert(root->right, new);
+
+  return rebalance(root);
+}
+
+static mem_region_s *tree_remove_min(mem_region_s *root, mem_region_s **min)
+{
+  if (!root->left) {
+    *min = root;
+    return root->right;
+  }
+
+  root->left = tree_remove_min(root->left, min);
+  return rebalance(root);
+}
+
+static mem_region_s *tree_remove(mem_region_s *root, mem_region_s *victim)
+{
+  mem_region_s *min;
+
+  assert(root);
+
+  if (victim->start < root->start)
+    root->left = tree_remove(root->left, victim);
+  else if (victim->start > root->start)
+    root->right = tree_remove(root->right, victim);
+
+  /* Replace the victim with its successor */
+  else {
+    if (!root->right) return root->left;
+    root->right = tree_remove_min(root->right, &min);
+    min->left = root->left;
+    min->right = root->right;
+    root = min;
+  }
+
+  return rebalance(root);
+}
+
+
 /*************************************************************************
  *  Memory map and region manipulation
  *************************************************************************/
 
+/** @brief Allocate a region struct.
+ *
+ *  @return The region, uninitialized, or NULL if we're out of memory.
+ **/
+mem_region_s *mreg_alloc(void)
+{
+  return slab_alloc(&mreg_cache);
+}
+
+/** @brief Free a region struct allocated with mreg_alloc(...).
+ *
+ *  @param mreg The region, which must not be in a memory map.
+ *
+ *  @return Void.
+ **/
+void mreg_free(mem_region_s *mreg)
+{
+  slab_free(&mreg_cache, mreg);
+  return;
+}
+
 void mreg_init(mem_region_s *mreg, void *start, void *limit, unsigned int attrs)
 {
   /* Intialize the mem region struct */
@@ -28,7 +178,28 @@ void mreg_init(mem_region_s *mreg, void *start, void *limit, unsigned int attrs)
   mreg->limit = limit;
   mreg->attrs = attrs;
   cll_init_node(&mreg->node, mreg);
+  mreg->left = mreg->right = NULL;
+  mreg->height = 1;
+  mreg->file = NULL;
+  mreg->nexts = 0;
+  mreg->shm = NULL;
+  mreg->fa_next = NULL;
+  mreg->fa_window = 0;
+
+  return;
+}
 
+/** @brief Initialize an empty memory map.
+ *
+ *  @param map The memory map.
+ *
+ *  @return Void.
+ **/
+void mreg_map_init(mem_map_s *map)
+{
+  cll_init_list(&map->list);
+  map->root = NULL;
+  map->hint = NULL;
   return;
 }
 
@@ -47,20 +218,33 @@ ord_e mreg_compare(mem_region_s *lhs, mem_region_s *rhs)
 
 
 /** @brief Identify a memory region WITHOUT extracting it.
+ *
+ *  Any region overlapping targ is a match.  The last region found is
+ *  checked before searching the tree.  Lookups may run concurrently under
+ *  a shared lock, so the hint is read once, and racing updates are
+ *  harmless: it only ever points at a region in the map.
  *
  *  @param map Memory map to search.
  *  @param targ Memory region start address to search for.
  *
  *  @return NULL if not found, else the memory region.
  **/
-mem_region_s *mreg_lookup(cll_list *map, mem_region_s *targ)
+mem_region_s *mreg_lookup(mem_map_s *map, mem_region_s *targ)
 {
-  cll_node *n;
   mem_region_s *mreg;
 
-  cll_foreach(map, n) {
-    mreg = cll_entry(mem_region_s *, n);
-    if (mreg_compare(mreg, targ) == ORD_EQ) {
+  /* Try our luck */
+  mreg = map->hint;
+  if (mreg && mreg_compare(mreg, targ) == ORD_EQ)
+    return mreg;
+
+  mreg = map->root;
+  while (mreg) {
+    switch (mreg_compare(targ, mreg)) {
+    case ORD_LT: mreg = mreg->left; break;
+    case ORD_GT: mreg = mreg->right; break;
+    default:
+      map->hint = mreg;
       return mreg;
     }
   }
@@ -68,6 +252,21 @@ mem_region_s *mreg_lookup(cll_list *map, mem_region_s *targ)
   return NULL;
 }
 
+/** @brief Find the memory region containing an address.
+ *
+ *  @param map Memory map to search.
+ *  @param addr The address.
+ *
+ *  @return NULL if not found, else the memory region.
+ **/
+mem_region_s *mreg_find(mem_map_s *map, void *addr)
+{
+  mem_region_s temp;
+
+  mreg_init(&temp, addr, addr, 0);
+  return mreg_lookup(map, &temp);
+}
+
 /** @brief Ordered insertion into a sorted memory map.
  *
  *  Order is based on memory address. Lower memory address occur earlier in the
@@ -78,21 +277,23 @@ mem_region_s *mreg_lookup(cll_list *map, mem_region_s *targ)
  *
  *  @return -1 if out of memory, else 0.
  **/
-int mreg_insert(cll_list *map, mem_region_s *new)
+int mreg_insert(mem_map_s *map, mem_region_s *new)
 {
-  cll_node *n;
-  mem_region_s *mreg;
-  ord_e ord;
+  mem_region_s *mreg, *succ;
 
-  /* Ordered insertion by address into the mem map*/
-  cll_foreach(map, n){
-    mreg = cll_entry(mem_region_s *, n);
-    ord = mreg_compare(new, mreg);
-    if((ord == ORD_LT) || (ord == ORD_EQ))
-      break;
+  /* Find the region after us */
+  succ = NULL;
+  for (mreg = map->root; mreg; ) {
+    if (new->start < mreg->start) {
+      succ = mreg;
+      mreg = mreg->left;
+    }
+    else mreg = mreg->right;
   }
 
-  cll_insert(n, &new->node);
+  /* Ordered insertion by address into the mem map*/
+  cll_insert(succ ? &succ->node : &map->list, &new->node);
+  map->root = tree_insert(map->root, new);
 
   return 0;
 }
@@ -105,12 +306,12 @@ int mreg_insert(cll_list *map, mem_region_s *new)
  *  @return NULL if targ is the highest region in memory, else the 
  *   memory region.
  **/
-mem_region_s *mreg_next(cll_list *map, mem_region_s *targ)
+mem_region_s *mreg_next(mem_map_s *map, mem_region_s *targ)
 {
   cll_node *n;
 
   n = targ->node.next;
-  if(n == map)
+  if(n == &map->list)
     return NULL;
   else
     return cll_entry(mem_region_s *, n);
@@ -124,12 +325,12 @@ mem_region_s *mreg_next(cll_list *map, mem_region_s *targ)
  *  @return NULL if targ is the lowest region in memory, else the 
  *   memory region.
  **/
-mem_region_s *mreg_prev(cll_list *map, mem_region_s *targ)
+mem_region_s *mreg_prev(mem_map_s *map, mem_region_s *targ)
 {
   cll_node *n;
 
   n = targ->node.prev;
-  if(n == map)
+  if(n == &map->list)
     return NULL;
   else
     return cll_entry(mem_region_s *, n);
@@ -142,19 +343,62 @@ mem_region_s *mreg_prev(cll_list *map, mem_region_s *targ)
  *
  *  @return NULL if not found, else the memory region.
  **/
-mem_region_s *mreg_extract(cll_list *map, mem_region_s *targ)
+mem_region_s *mreg_extract(mem_map_s *map, mem_region_s *targ)
 {
-  cll_node *n;
   mem_region_s *mreg;
 
-  cll_foreach(map, n) {
-    mreg = cll_entry(mem_region_s *, n);
-    if (mreg_compare(mreg, targ) == ORD_EQ) {
-      cll_extract(map, n);
-      return mreg;
-    }
-  }
+  mreg = mreg_lookup(map, targ);
+  if (!mreg) return NULL;
 
-  return NULL;
+  map->root = tree_remove(map->root, mreg);
+  cll_extract(&map->list, &mreg->node);
+  if (map->hint == mreg) map->hint = NULL;
+
+  mreg->left = mreg->right = NULL;
+  mreg->height = 1;
+
+  return mreg;
 }
 
+/** @brief Merge a region with adjacent regions that have the same attributes.
+ *
+ *  Merged-away regions are extracted and freed.
+ *
+ *  @param map Memory map the region is in.
+ *  @param mreg The region to merge.
+ *  @param nomerge Regions with any of these attributes are left alone, as
+ *                 are file-backed and shared regions.
+ *
+ *  @return The merged region.
+ **/
+mem_region_s *mreg_coalesce(mem_map_s *map, mem_region_s *mreg,
+                            unsigned int nomerge)
+{
+  mem_region_s *prev, *next;
+
+  /* File-backed and shared regions keep their own backing */
+  if ((mreg->attrs & nomerge) || mreg->file || mreg->shm) return mreg;
+
+  /* Fold ourselves into the region below */
+  prev = mreg_prev(map, mreg);
+  if (prev && !prev->file && !prev->shm && prev->attrs == mreg->attrs
+      && (char *)prev->limit + 1 == (char *)mreg->start)
+  {
+    assert(mreg_extract(map, mreg) == mreg);
+    prev->limit = mreg->limit;
+    mreg_free(mreg);
+    mreg = prev;
+  }
+
+  /* Fold the region above into ourselves */
+  next = mreg_next(map, mreg);
+  if (next && !next->file && !next->shm && next->attrs == mreg->attrs
+      && (char *)mreg->limit + 1 == (char *)next->start)
+  {
+    assert(mreg_extract(map, next) == next);
+    mreg->limit = next->limit;
+    mreg_free(next);
+  }
+
+  return mreg;
+}
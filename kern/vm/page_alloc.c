@@ -10,10 +10,14 @@
 #include <page_alloc.h>
 
 /* Pebbles */
+#include <buddy.h>
 #include <frame_alloc.h>
+#include <page_cache.h>
+#include <sched.h>
 #include <tlb.h>
 #include <vm.h>
 #include <util.h>
+#include <zswap.h>
 
 /* Libc includes */
 #include <assert.h>
@@ -27,6 +31,20 @@
 /* ZFOD dummy frame */
 void *zfod = NULL;
 
+/* The running thread's frame magazine (there's no thread during boot) */
+#define CURR_MAG ( curr_thr ? &curr_thr->frmag : NULL )
+
+/* Serializes use of the copy window */
+static mutex_s copy_lock = MUTEX_INITIALIZER(copy_lock);
+
+/* Serializes filling in untouched pages */
+static mutex_s page_in_lock = MUTEX_INITIALIZER(page_in_lock);
+
+/* Freed (and so zeroed) page tables, ready for reuse */
+static void *tbl_cache[PG_TBL_CACHE_HWM];
+static int tbl_cached = 0;
+static mutex_s tbl_cache_lock = MUTEX_INITIALIZER(tbl_cache_lock);
+
 /*************************************************************************
  *  Helper functions
  *************************************************************************/
@@ -43,122 +61,129 @@ void translate_attrs(pte_t *pte, unsigned int attrs)
   return;
 }
 
-void *physically_back_page(pg_info_s *pgi, void *vaddr)
+/** @brief Free a frame.
+ *
+ *  The frame needn't be mapped anywhere; it's zeroed in the background (or
+ *  when it's next allocated), not here.
+ *
+ *  @param frame The frame to free.
+ *
+ *  @return Void.
+ **/
+void free_frame(void *frame)
 {
-  void *frame, *new_head;
-  pte_t pte;
+  assert(frame != zfod);
 
-  /* Find the page's PTE */
-  assert(!get_pte(pgi->pg_dir, pgi->pg_tbls, vaddr, &pte));
+  /* Hand it back to our magazine */
+  fr_free(CURR_MAG, frame);
 
-  /* Serialize access to the free list */
-  mutex_lock(&frame_allocator_lock);
-
-  /* Grab the head of free list */
-  frame = fr_retrieve_head();
-  if (!frame) {
-    mutex_unlock(&frame_allocator_lock);
-    return NULL;
-  }
+  return;
+}
 
-  /* Back vaddr with frame
-   * We just checked the PDE; set_pte(...) shouldn't fail
-   */
-  pte = PACK_PTE(frame, GET_ATTRS(pte));
-  assert( !set_pte(pgi->pg_dir, pgi->pg_tbls, vaddr, &pte) );
-  tlb_inval_page(vaddr);
+/** @brief Copy a page into a fresh frame.
+ *
+ *  The new frame is filled through the copy window, so it never needs to be
+ *  mapped in user-space.
+ *
+ *  @param vaddr A virtual address on the page to copy.
+ *
+ *  @return The new frame, with one reference, or NULL if we're out of memory.
+ **/
+void *copy_frame(void *vaddr)
+{
+  void *frame;
 
-  /* Save the new head */
-  --fr_avail;
-  new_head = *(void **)FLOOR(vaddr, PAGE_SIZE);
-  fr_update_head(new_head);
+  frame = fr_alloc(CURR_MAG);
+  if (!frame) return NULL;
+  fr_ref(frame);
 
-  mutex_unlock(&frame_allocator_lock);
+  mutex_lock(&copy_lock);
+  memcpy(kwin_map(KWIN_COPY, frame), (void *)FLOOR(vaddr, PAGE_SIZE),
+         PAGE_SIZE);
+  mutex_unlock(&copy_lock);
 
   return frame;
 }
 
-void free_frame(void *frame, void *vaddr)
+/** @brief Split a copy-on-write page.
+ *
+ *  If we hold the only reference to the frame, we simply take back write
+ *  access; otherwise we copy the frame into a private one.  The PTE is
+ *  re-checked under the frame allocator lock, so a peer thread that split
+ *  the page first wins and our copy is thrown away.
+ *
+ *  @param pgi Page table information.
+ *  @param vaddr The faulting virtual address.
+ *
+ *  @return 0 on success; a negative integer error code on failure.
+ **/
+int break_cow(pg_info_s *pgi, void *vaddr)
 {
-  assert(vaddr != zfod);
-
-  /* The implicit pointer should be stored in the lowest addressable word */
-  uint32_t *floor = (uint32_t *)(FLOOR(vaddr, PAGE_SIZE));
-
-  /* Zero the frame */
-  memset(floor,0,PAGE_SIZE);
+  pte_t pte;
+  void *old, *frame;
+  int last, cached;
 
-  /* Serialize access to the free list */
+  /* We might be the last sharer */
   mutex_lock(&frame_allocator_lock);
-
-  /* Retrieve and store out the old head while frame is mapped in */
-  void *old_head = fr_retrieve_head();
-  *floor = (uint32_t)(old_head);
-
-  /* Add frame to free list */
-  ++fr_avail;
-  fr_update_head(frame);
-
+  assert( !get_pte(pgi->pg_dir, pgi->pg_tbls, vaddr, &pte) );
+  old = GET_ADDR(pte);
+  if (!(pte & PG_TBL_COW) || fr_refcnt(old) == 1) {
+    pte = (pte & ~PG_TBL_COW) | PG_TBL_WRITABLE;
+    assert( !set_pte(pgi->pg_dir, pgi->pg_tbls, vaddr, &pte) );
+    tlb_inval_page(vaddr);
+    mutex_unlock(&frame_allocator_lock);
+    return 0;
+  }
   mutex_unlock(&frame_allocator_lock);
-  return;
-}
 
-void *copy_frame(pg_info_s *src, void *vaddr, void *buf)
-{
-  pte_t pte;
+  /* Make a private copy */
+  frame = copy_frame(vaddr);
+  if (!frame) return -1;
 
-  /* Allocate the dest page and map it into the current address 
-   * space for copying
-   */
-  void *frame = physically_back_page(src, buf);
-  if (!frame) return NULL;
+  /* Install the copy, unless someone beat us to it */
+  mutex_lock(&frame_allocator_lock);
+  assert( !get_pte(pgi->pg_dir, pgi->pg_tbls, vaddr, &pte) );
+  if (GET_ADDR(pte) != old || !(pte & PG_TBL_COW)) {
+    fr_unref(frame);
+    mutex_unlock(&frame_allocator_lock);
+    free_frame(frame);
+    return 0;
+  }
+  cached = pte & PG_TBL_CACHED;
+  pte = PACK_PTE(frame, (GET_ATTRS(pte) & ~(PG_TBL_COW | PG_TBL_CACHED))
+                        | PG_TBL_WRITABLE);
+  assert( !set_pte(pgi->pg_dir, pgi->pg_tbls, vaddr, &pte) );
+  tlb_inval_page(vaddr);
+  last = !cached && !fr_unref(old);
+  mutex_unlock(&frame_allocator_lock);
 
-  /* Copy data */
-  memcpy(buf, vaddr, PAGE_SIZE);
+  /* Page cache frames go back through the cache */
+  if (cached) last = pc_put(old);
 
-  /* Unmap the dest page
-   * We just checked the PDE; set_pte(...) shouldn't fail
-   */
-  pte = PACK_PTE(buf, KERN_PTE_ATTRS);
-  assert( !set_pte(src->pg_dir, src->pg_tbls, buf, &pte) );
-  tlb_inval_page(buf);
+  /* The other sharers may have exited while we were copying */
+  if (last) free_frame(old);
 
-  return frame;
+  return 0;
 }
 
 void *alloc_table(pg_info_s *pgi, void *vaddr)
 {
-  pte_t pde, pte;
-  page_t *tome;
+  pte_t pde;
+  void *frame;
 
-  /* Serialize access to the free list */
-  mutex_lock(&frame_allocator_lock);
+  /* Reuse an old table if we can */
+  mutex_lock(&tbl_cache_lock);
+  frame = tbl_cached ? tbl_cache[--tbl_cached] : NULL;
+  mutex_unlock(&tbl_cache_lock);
 
-  /* Grab the head of free list */
-  void *frame = fr_retrieve_head();
-  if (!frame) {
-    mutex_unlock(&frame_allocator_lock);
-    return NULL;
-  }
+  /* Otherwise grab a zeroed frame; every PTE in it is already invalid */
+  if (!frame) frame = fr_alloc(CURR_MAG);
+  if (!frame) return NULL;
 
-  /* Map the frame into virtual memory so we can read the address of the next
-   * free frame */
-  init_pte(&pde, frame);
+  /* Install the new page table */
   pde = PACK_PTE(frame, PG_TBL_ATTRS);
   set_pde(pgi->pg_dir, vaddr, &pde);
 
-  /* Update the head of the free list */
-  --fr_avail;
-  void *new_head = (void *)GET_ADDR(*pgi->pg_tbls[PG_DIR_INDEX(vaddr)]);
-  fr_update_head(new_head);
-
-  mutex_unlock(&frame_allocator_lock);
-
-  /* Zero the head of the free list */
-  tome = tomes[PG_DIR_INDEX(vaddr)];
-  init_pte(&pte, NULL);
-  assert( !set_pte(pgi->pg_dir, pgi->pg_tbls, tome, &pte) );
-
   return frame;
 }
 
@@ -199,11 +224,27 @@ void *pg_alloc(pg_info_s *pgi, void *vaddr, unsigned int attrs)
   pte_t pde;
   unsigned int real_attrs;
 
+  mutex_lock(&page_in_lock);
+
   /* If the PDE isn't valid, make it so */
   if (get_pde(pgi->pg_dir, vaddr, NULL))
   {
-    if (!alloc_table(pgi, vaddr))
+    if (!alloc_table(pgi, vaddr)) {
+      mutex_unlock(&page_in_lock);
       return NULL;
+    }
+  }
+
+  /* A peer thread might have filled the page in already (or the page might
+   * be swapped out)
+   */
+  if (!get_pte(pgi->pg_dir, pgi->pg_tbls, vaddr, &pde)) {
+    mutex_unlock(&page_in_lock);
+    return GET_ADDR(pde);
+  }
+  if (pg_swapped(pgi, vaddr)) {
+    mutex_unlock(&page_in_lock);
+    return NULL;
   }
 
   /* Back vaddr with the ZFOD frame
@@ -215,6 +256,7 @@ void *pg_alloc(pg_info_s *pgi, void *vaddr, unsigned int attrs)
   assert( !set_pte(pgi->pg_dir, pgi->pg_tbls, vaddr, &pde) );
   tlb_inval_page(vaddr);
 
+  mutex_unlock(&page_in_lock);
   return zfod;
 }
 
@@ -223,12 +265,24 @@ void *pg_alloc(pg_info_s *pgi, void *vaddr, unsigned int attrs)
  *  @param pgi Page table information.
  *  @param vaddr A virtual address on the page.
  *  @param attrs The attributes for the page.
+ *  @param tlb Batch to queue the invalidation on, or NULL to do it now.
  *
  *  @return 0 on success; a negative integer error code on failure.
  **/
-int pg_set_attrs(pg_info_s *pgi, void *vaddr, unsigned int attrs)
+int pg_set_attrs(pg_info_s *pgi, void *vaddr, unsigned int attrs,
+                 tlb_batch_s *tlb)
 {
   pte_t pte;
+  void *frame;
+
+  /* Large pages keep their attributes in the PDE */
+  if (!get_pde(pgi->pg_dir, vaddr, &pte) && (pte & PG_DIR_PSE)) {
+    translate_attrs(&pte, attrs);
+    set_pde(pgi->pg_dir, vaddr, &pte);
+    if (tlb) tlb_batch_page(tlb, vaddr);
+    else tlb_inval_page(vaddr);
+    return 0;
+  }
 
   /* Find the page's PTE */
   if (get_pte(pgi->pg_dir, pgi->pg_tbls, vaddr, &pte))
@@ -236,44 +290,68 @@ int pg_set_attrs(pg_info_s *pgi, void *vaddr, unsigned int attrs)
 
   /* Write the new attributes */
   translate_attrs(&pte, attrs);
+
+  /* Shared frames stay read-only until someone writes to them */
+  if (pte & PG_TBL_WRITABLE) {
+    frame = GET_ADDR(pte);
+    if (frame == zfod)
+      pte &= ~PG_TBL_WRITABLE;
+    else if (fr_refcnt(frame) > 1)
+      pte = (pte & ~PG_TBL_WRITABLE) | PG_TBL_COW;
+    else
+      pte &= ~PG_TBL_COW;
+  }
+  else pte &= ~PG_TBL_COW;
+
   assert( !set_pte(pgi->pg_dir, pgi->pg_tbls, vaddr, &pte) );
-  /* Do we need an tlb_inval_page() here? */
-  tlb_inval_page(vaddr);
+  if (tlb) tlb_batch_page(tlb, vaddr);
+  else tlb_inval_page(vaddr);
 
   return 0;
 }
 
 /** @brief Copies an address page.
+ *
+ *  Nothing is actually copied: the child maps the parent's frame and takes
+ *  a reference to it.  Writable pages are made read-only and marked
+ *  copy-on-write in both address spaces; whoever writes first gets a
+ *  private copy in pg_page_fault_handler(...).
  *
  *  @param dst The destination page info struct.
  *  @param src The source page info struct.
  *  @param addr The vitual address of the page to copy.
+ *  @param tlb Batch to queue the parent's invalidation on, or NULL.
  *
  *  @return 0 on success; a negative integer error code on failure.
  **/
-int pg_copy(pg_info_s *dst, pg_info_s *src, void *vaddr, void *buf)
+int pg_copy(pg_info_s *dst, pg_info_s *src, void *vaddr, tlb_batch_s *tlb)
 {
   pte_t pte;
-  void *frame = NULL;
+  void *frame;
 
   /* The page better exist in the parent */
   if (get_pte(src->pg_dir, src->pg_tbls, vaddr, &pte))
     return -1;
 
-  /* Only copy non-ZFOD pages*/
-  if (GET_ADDR(pte) != zfod) {
-    frame = copy_frame(src, vaddr, buf);
-    if (!frame) return -1;
-    pte = PACK_PTE(frame, GET_ATTRS(pte));
-  }
-
   /* The child might need a page table */
   if (get_pde(dst->pg_dir, vaddr, NULL))
   {
-    if (!alloc_table(dst, vaddr)) {
-      if (frame && frame != zfod)
-        free_frame(frame, vaddr);
+    if (!alloc_table(dst, vaddr))
       return 1;
+  }
+
+  /* ZFOD pages already share the dummy frame */
+  frame = GET_ADDR(pte);
+  if (frame != zfod)
+  {
+    fr_ref(frame);
+
+    /* Write-protect the parent's mapping */
+    if (pte & PG_TBL_WRITABLE) {
+      pte = (pte & ~PG_TBL_WRITABLE) | PG_TBL_COW;
+      assert( !set_pte(src->pg_dir, src->pg_tbls, vaddr, &pte) );
+      if (tlb) tlb_batch_page(tlb, vaddr);
+      else tlb_inval_page(vaddr);
     }
   }
   
@@ -283,42 +361,462 @@ int pg_copy(pg_info_s *dst, pg_info_s *src, void *vaddr, void *buf)
   return 0;
 }
 
+/** @brief Moves a page to another address in the same address space.
+ *
+ *  The PTE moves as is, so whatever backs the page (a frame, the ZFOD
+ *  frame, or a compressed copy) comes along without being copied.  The
+ *  destination must be unmapped.
+ *
+ *  @param pgi Page table information.
+ *  @param dst The destination virtual address.
+ *  @param src The source virtual address.
+ *  @param tlb Batch to queue the source's invalidation on, or NULL.
+ *
+ *  @return 0 on success; a negative integer error code if we couldn't get
+ *  a page table for dst.
+ **/
+int pg_move(pg_info_s *pgi, void *dst, void *src, tlb_batch_s *tlb)
+{
+  pte_t pte, old;
+
+  mutex_lock(&page_in_lock);
+
+  /* Nothing to move if the page was never touched */
+  if (peek_pte(pgi->pg_dir, pgi->pg_tbls, src, &pte) || !pte) {
+    mutex_unlock(&page_in_lock);
+    return 0;
+  }
+
+  if (get_pde(pgi->pg_dir, dst, NULL) && !alloc_table(pgi, dst)) {
+    mutex_unlock(&page_in_lock);
+    return -1;
+  }
+  assert( !peek_pte(pgi->pg_dir, pgi->pg_tbls, dst, &old) && !old );
+
+  assert( !set_pte(pgi->pg_dir, pgi->pg_tbls, dst, &pte) );
+  init_pte(&old, NULL);
+  assert( !set_pte(pgi->pg_dir, pgi->pg_tbls, src, &old) );
+
+  if (tlb) tlb_batch_page(tlb, src);
+  else tlb_inval_page(src);
+
+  mutex_unlock(&page_in_lock);
+  return 0;
+}
+
 /** @brief Free a page.
+ *
+ *  With a batch, both the invalidation and the frame's release wait for
+ *  tlb_batch_commit(...).
  *
  *  @param pgi   Page table information.
  *  @param vaddr Logical address of frame.
+ *  @param tlb   Batch to queue the invalidation on, or NULL to do it now.
  *  @return Void.
  **/
-void pg_free(pg_info_s *pgi, void *vaddr)
+void pg_free(pg_info_s *pgi, void *vaddr, tlb_batch_s *tlb)
 {
   pte_t pte;
+  void *frame;
+  int last;
 
   /* If the PDE isn't valid, there's nothing to free */
-  if (get_pte(pgi->pg_dir, pgi->pg_tbls, vaddr, &pte))
+  if (get_pte(pgi->pg_dir, pgi->pg_tbls, vaddr, &pte)) {
+    /* ...unless the page is in the compressed pool */
+    if (!peek_pte(pgi->pg_dir, pgi->pg_tbls, vaddr, &pte)
+        && IS_SWAP_PTE(pte))
+    {
+      zs_drop(SWAP_SLOT(pte));
+      init_pte(&pte, NULL);
+      assert( !set_pte(pgi->pg_dir, pgi->pg_tbls, vaddr, &pte) );
+    }
     return;
-  
-  /* Make the page writable so we can store an implicit pointer to 
-   * the old head
-   */
-  if( !(pte & PG_TBL_WRITABLE) ){
-    pte |= PG_TBL_WRITABLE;
-    assert( !set_pte(pgi->pg_dir, pgi->pg_tbls, vaddr, &pte) );
+  }
+
+  /* Drop our reference to the frame */
+  frame = (void *)GET_ADDR(pte);
+  if (pte & PG_TBL_CACHED) last = pc_put(frame);
+  else last = (frame != zfod) && !fr_unref(frame);
+
+  /* Free the page */
+  init_pte(&pte, NULL);
+  assert( !set_pte(pgi->pg_dir, pgi->pg_tbls, vaddr, &pte) );
+
+  /* Invalidate the tlb entry; free the frame if nobody else maps it */
+  if (tlb) {
+    tlb_batch_page(tlb, vaddr);
+    if (last) tlb_batch_defer_free(tlb, frame);
+  }
+  else {
     tlb_inval_page(vaddr);
+    if (last) free_frame(frame);
   }
 
-  /* Free the frame */
-  void *frame = (void *)GET_ADDR(pte);
-  if(frame != zfod) free_frame(frame, vaddr);
+  return;
+}
 
-  /* Free the page; invalidate the tlb entry */
+/** @brief Checks whether a page has yet to be written.
+ *
+ *  @param pgi Page table information.
+ *  @param page The page.
+ *
+ *  @return Nonzero if the page is unmapped (and not swapped out) or still on
+ *  the ZFOD frame.
+ **/
+static int untouched(pg_info_s *pgi, void *page)
+{
+  pte_t pte;
+  int err;
+
+  err = get_pte(pgi->pg_dir, pgi->pg_tbls, page, &pte);
+  if (err == -2) return !pg_swapped(pgi, page);
+  if (err) return err != -3;
+  return GET_ADDR(pte) == zfod;
+}
+
+/** @brief Backs a run of untouched pages with real frames.
+ *
+ *  The page containing vaddr must be untouched (unmapped, or mapped to the
+ *  ZFOD frame); the pages after it are backed too, up to npages in all,
+ *  until we reach one that isn't.  Frames for the run come from a single
+ *  frame allocator acquisition (or our magazine, for a single page).
+ *
+ *  @param pgi Page table information.
+ *  @param vaddr The faulting virtual address.
+ *  @param npages The most pages to back; the run must not leave vaddr's
+ *         page table.
+ *  @param attrs The region's attributes.
+ *
+ *  @return The number of pages backed; 0 if we're out of memory.
+ **/
+int pg_back_zfod(pg_info_s *pgi, void *vaddr, int npages, unsigned int attrs)
+{
+  void *frames[VM_FA_MAX_PAGES];
+  tlb_batch_s tlb;
+  char *page;
+  pte_t pte;
+  int i, n;
+
+  page = (char *)FLOOR(vaddr, PAGE_SIZE);
+  assert(npages <= VM_FA_MAX_PAGES);
+
+  /* Find the end of the run */
+  for (n = 1; n < npages; ++n) {
+    if (!untouched(pgi, page + n*PAGE_SIZE)) break;
+  }
+
+  /* Grab the frames */
+  if (n == 1) n = ( (frames[0] = fr_alloc(CURR_MAG)) != NULL );
+  else n = fr_alloc_batch(frames, n);
+  if (!n) return 0;
+
+  mutex_lock(&page_in_lock);
+
+  /* We might need a page table */
+  if (get_pde(pgi->pg_dir, page, NULL) && !alloc_table(pgi, page)) {
+    mutex_unlock(&page_in_lock);
+    for (i = 0; i < n; ++i) free_frame(frames[i]);
+    return 0;
+  }
+
+  /* Map the frames, unless a peer thread got there first */
+  tlb_batch_init(&tlb);
+  for (i = 0; i < n; ++i, page += PAGE_SIZE) {
+    if (!untouched(pgi, page)) {
+      tlb_batch_defer_free(&tlb, frames[i]);
+      continue;
+    }
+    fr_ref(frames[i]);
+    pte = PACK_PTE(frames[i], PG_TBL_PRESENT);
+    translate_attrs(&pte, attrs);
+    assert( !set_pte(pgi->pg_dir, pgi->pg_tbls, page, &pte) );
+    tlb_batch_page(&tlb, page);
+  }
+
+  mutex_unlock(&page_in_lock);
+  tlb_batch_commit(&tlb);
+
+  return n;
+}
+
+/** @brief Checks whether a page is in the compressed pool.
+ *
+ *  @param pgi Page table information.
+ *  @param vaddr A virtual address on the page.
+ *
+ *  @return Nonzero if the page's PTE holds a swap cookie; 0 otherwise.
+ **/
+int pg_swapped(pg_info_s *pgi, void *vaddr)
+{
+  pte_t pte;
+
+  return !peek_pte(pgi->pg_dir, pgi->pg_tbls, vaddr, &pte)
+         && IS_SWAP_PTE(pte);
+}
+
+/** @brief Tries to move a page into the compressed pool.
+ *
+ *  Only private, resident pages are candidates.  Pages referenced since
+ *  the last look just have their accessed bit cleared (the flush is queued
+ *  on tlb); pages that weren't are compressed and their frames freed.
+ *
+ *  The page is made not-present before it's compressed, so a peer thread
+ *  touching it meanwhile faults and waits for us in pg_swap_in(...).
+ *
+ *  @param pgi Page table information.
+ *  @param vaddr A virtual address on the page.
+ *  @param tlb Batch for accessed bit flushes and the freed frame.
+ *
+ *  @return ZS_SWAPPED if the page was swapped out; ZS_AGED if it just had
+ *  its accessed bit cleared; ZS_SKIPPED if it was skipped; ZS_EFULL if the
+ *  pool is full.
+ **/
+int pg_swap_out(pg_info_s *pgi, void *vaddr, tlb_batch_s *tlb)
+{
+  pte_t pte, old;
+  void *frame;
+  int slot;
+
+  mutex_lock(&page_in_lock);
+
+  /* Only private pages */
+  if (get_pte(pgi->pg_dir, pgi->pg_tbls, vaddr, &pte)) goto skip;
+  frame = GET_ADDR(pte);
+  if (frame == zfod || (pte & (PG_TBL_COW | PG_TBL_CACHED))
+      || fr_refcnt(frame) != 1)
+    goto skip;
+
+  /* Give recently used pages another lap */
+  if (pte & PG_TBL_ACCESSED) {
+    pte &= ~PG_TBL_ACCESSED;
+    assert( !set_pte(pgi->pg_dir, pgi->pg_tbls, vaddr, &pte) );
+    tlb_batch_page(tlb, vaddr);
+    mutex_unlock(&page_in_lock);
+    return ZS_AGED;
+  }
+
+  /* Fence the page off, then compress it */
+  old = pte;
   init_pte(&pte, NULL);
   assert( !set_pte(pgi->pg_dir, pgi->pg_tbls, vaddr, &pte) );
   tlb_inval_page(vaddr);
 
-  return;
+  slot = zs_store(frame);
+  if (slot < 0) {
+    assert( !set_pte(pgi->pg_dir, pgi->pg_tbls, vaddr, &old) );
+    mutex_unlock(&page_in_lock);
+    return (slot == ZS_EFULL) ? ZS_EFULL : ZS_SKIPPED;
+  }
+
+  pte = SWAP_PTE(slot);
+  assert( !set_pte(pgi->pg_dir, pgi->pg_tbls, vaddr, &pte) );
+  mutex_unlock(&page_in_lock);
+
+  fr_unref(frame);
+  tlb_batch_defer_free(tlb, frame);
+  return ZS_SWAPPED;
+
+skip:
+  mutex_unlock(&page_in_lock);
+  return ZS_SKIPPED;
+}
+
+/** @brief Brings a page back from the compressed pool.
+ *
+ *  @param pgi Page table information.
+ *  @param vaddr A virtual address on the page.
+ *  @param attrs The page's region's attributes.
+ *
+ *  @return 0 on success (or if a peer thread beat us to it); a negative
+ *  integer error code on failure.
+ **/
+int pg_swap_in(pg_info_s *pgi, void *vaddr, unsigned int attrs)
+{
+  void *frame;
+  pte_t pte;
+
+  frame = fr_alloc(CURR_MAG);
+  if (!frame) return -1;
+
+  mutex_lock(&page_in_lock);
+
+  /* Someone beat us to it */
+  if (peek_pte(pgi->pg_dir, pgi->pg_tbls, vaddr, &pte)
+      || !IS_SWAP_PTE(pte))
+  {
+    mutex_unlock(&page_in_lock);
+    free_frame(frame);
+    return 0;
+  }
+
+  if (zs_load(SWAP_SLOT(pte), frame)) {
+    mutex_unlock(&page_in_lock);
+    free_frame(frame);
+    return -2;
+  }
+
+  fr_ref(frame);
+  pte = PACK_PTE(frame, PG_TBL_PRESENT);
+  translate_attrs(&pte, attrs);
+  assert( !set_pte(pgi->pg_dir, pgi->pg_tbls, vaddr, &pte) );
+  tlb_inval_page(vaddr);
+
+  mutex_unlock(&page_in_lock);
+  return 0;
+}
+
+/** @brief Checks whether a page is mapped.
+ *
+ *  @param pgi Page table information.
+ *  @param vaddr A virtual address on the page.
+ *
+ *  @return Nonzero if the page has a valid PTE; 0 otherwise.
+ **/
+int pg_present(pg_info_s *pgi, void *vaddr)
+{
+  return !get_pte(pgi->pg_dir, pgi->pg_tbls, vaddr, NULL);
+}
+
+/** @brief Checks whether a page has a frame of its own.
+ *
+ *  Unlike pg_present(...), pages still on the ZFOD frame don't count.
+ *
+ *  @param pgi Page table information.
+ *  @param vaddr The virtual address.
+ *
+ *  @return Nonzero if the page is backed by a real frame; 0 otherwise.
+ **/
+int pg_resident(pg_info_s *pgi, void *vaddr)
+{
+  pte_t pte;
+
+  if (get_pte(pgi->pg_dir, pgi->pg_tbls, vaddr, &pte)) return 0;
+  return GET_ADDR(pte) != zfod;
+}
+
+/** @brief Maps a page read in by pg_page_in(...) or pg_map_frame(...).
+ *
+ *  @param pgi Page table information.
+ *  @param page The page-aligned virtual address.
+ *  @param frame The frame, already referenced for this mapping.
+ *  @param attrs The region's attributes.
+ *  @param flags Extra PTE bits (PG_TBL_CACHED for page cache frames).
+ *
+ *  @return The frame now backing the page, or NULL if we're out of memory.
+ **/
+static void *map_page_in(pg_info_s *pgi, void *page, void *frame,
+                         unsigned int attrs, unsigned int flags)
+{
+  pte_t pte;
+  int last;
+
+  mutex_lock(&page_in_lock);
+
+  /* We might need a page table; someone might have beaten us to it */
+  if ((get_pde(pgi->pg_dir, page, NULL) && !alloc_table(pgi, page))
+      || !get_pte(pgi->pg_dir, pgi->pg_tbls, page, &pte))
+  {
+    mutex_unlock(&page_in_lock);
+    last = (flags & PG_TBL_CACHED) ? pc_put(frame) : !fr_unref(frame);
+    if (last) free_frame(frame);
+    return pg_present(pgi, page) ? GET_ADDR(pte) : NULL;
+  }
+
+  /* Map it */
+  pte = PACK_PTE(frame, PG_TBL_PRESENT | flags);
+  translate_attrs(&pte, attrs);
+  assert( !set_pte(pgi->pg_dir, pgi->pg_tbls, page, &pte) );
+  tlb_inval_page(page);
+
+  mutex_unlock(&page_in_lock);
+  return frame;
+}
+
+/** @brief Reads in a page of a file-backed region.
+ *
+ *  The frame is filled through the copy window before it's mapped, so
+ *  read-only pages need no special treatment.  If a peer thread read the
+ *  page in first, our frame is thrown away.
+ *
+ *  Read-only pages go through the page cache, so every task running the
+ *  same executable (or mapping the same file) shares them.
+ *
+ *  @param pgi Page table information.
+ *  @param vaddr The faulting virtual address.
+ *  @param mreg The file-backed region containing vaddr.
+ *
+ *  @return The frame backing the page, or NULL if we're out of memory.
+ **/
+void *pg_page_in(pg_info_s *pgi, void *vaddr, const mem_region_s *mreg)
+{
+  const file_extent_s *ext;
+  char *page, *lo, *hi, *dst, *key;
+  void *frame, *cached;
+  int i, shared;
+
+  page = (char *)FLOOR(vaddr, PAGE_SIZE);
+  shared = !(mreg->attrs & VM_ATTR_RDWR);
+
+  /* Mapped files are cached by offset, executables by address */
+  key = page;
+  if (mreg->attrs & VM_ATTR_NEWPG)
+    key = (char *)(page - (char *)mreg->exts[0].start + mreg->exts[0].off);
+
+  /* Somebody else running this executable may have read it in already */
+  if (shared && (frame = pc_get(mreg->file, key)))
+    return map_page_in(pgi, page, frame, mreg->attrs, PG_TBL_CACHED);
+
+  /* Grab a zeroed frame and copy in whatever the file covers */
+  frame = fr_alloc(CURR_MAG);
+  if (!frame) return NULL;
+  mutex_lock(&copy_lock);
+  dst = kwin_map(KWIN_COPY, frame);
+  for (i = 0; i < mreg->nexts; ++i) {
+    ext = &mreg->exts[i];
+    lo = MAX(page, (char *)ext->start);
+    hi = MIN(page + PAGE_SIZE, (char *)ext->start + ext->len);
+    if (lo < hi)
+      memcpy(dst + (lo - page),
+             mreg->file->execbytes + ext->off + (lo - (char *)ext->start),
+             hi - lo);
+  }
+  mutex_unlock(&copy_lock);
+  fr_ref(frame);
+
+  /* Offer it to the cache; we may get back another task's copy */
+  if (shared && (cached = pc_insert(mreg->file, key, frame))) {
+    if (cached != frame) {
+      fr_unref(frame);
+      free_frame(frame);
+    }
+    return map_page_in(pgi, page, cached, mreg->attrs, PG_TBL_CACHED);
+  }
+
+  return map_page_in(pgi, page, frame, mreg->attrs, 0);
+}
+
+/** @brief Maps a frame that's owned elsewhere, e.g. by a shared memory
+ *         object.
+ *
+ *  If a peer thread mapped the page first, our reference is dropped.
+ *
+ *  @param pgi Page table information.
+ *  @param vaddr The faulting virtual address.
+ *  @param frame The frame, already referenced for this mapping.
+ *  @param attrs The region's attributes.
+ *
+ *  @return The frame now backing the page, or NULL if we're out of memory.
+ **/
+void *pg_map_frame(pg_info_s *pgi, void *vaddr, void *frame,
+                   unsigned int attrs)
+{
+  return map_page_in(pgi, (void *)FLOOR(vaddr, PAGE_SIZE), frame, attrs, 0);
 }
 
 /** @brief Free a page table.
+ *
+ *  pg_free(...) zeroes every PTE it frees, so an empty table is all zeroes;
+ *  we keep up to PG_TBL_CACHE_HWM of them around for alloc_table(...).
  *
  *  @param pgi Page table information.
  *  @param vaddr The faulting virtual address.
@@ -332,12 +830,20 @@ void pg_free_table(pg_info_s *pgi, void *vaddr)
   /* Invariant checker: Ensure all PTEs in this page table are invalid */
   validate_pt(pgi, vaddr);
 
-  /* Retrieve the PDE entry */
-  get_pde(pgi->pg_dir, vaddr, &pte);
+  /* Retrieve the PDE entry; file-backed regions might never have needed
+   * the table
+   */
+  if (get_pde(pgi->pg_dir, vaddr, &pte)) return;
 
-  /* Free the frame */
+  /* Cache or free the frame */
   void *frame = (void *)GET_ADDR(pte);
-  free_frame(frame, &pgi->pg_tbls[PG_DIR_INDEX(vaddr)]);
+  mutex_lock(&tbl_cache_lock);
+  if (tbl_cached < PG_TBL_CACHE_HWM) {
+    tbl_cache[tbl_cached++] = frame;
+    frame = NULL;
+  }
+  mutex_unlock(&tbl_cache_lock);
+  if (frame) free_frame(frame);
 
   /* Zero the PDE and invalidate the tlb */
   init_pte(&pte, NULL);
@@ -346,37 +852,190 @@ void pg_free_table(pg_info_s *pgi, void *vaddr)
 return;
 }
 
-/** @brief Handle page faults.
+/** @brief Resolves a page fault.
  *
- *  We try to back faulting ZFOD pages with real physical frames; nothing
- *  is done with non-ZFOD pages.
+ *  The caller holds the faulter's map lock.
  *
- *  @param pgi Page table information.
+ *  @param vmi The faulter's vm_info struct.
  *  @param vaddr The faulting virtual address.
+ *  @param error_code The error code the processor pushed for the fault.
  *
  *  @return 0 on success; a negative integer error code on failure.
  **/
-/* For debugging cho variant, please keep */
-#include <sched.h>
-int pg_page_fault_handler(void *vaddr)
+static int resolve_fault(vm_info_s *vmi, void *vaddr, unsigned int error_code)
 {
   pte_t pte;
   pg_info_s *pgi;
+  int err;
 
   /* Grab the faulter's page info */
-  pgi = &curr_tsk->vmi.pg_info;
+  pgi = &vmi->pg_info;
 
-  /* Get the faulting address' PTE */
-  if (get_pte(pgi->pg_dir, pgi->pg_tbls, vaddr, &pte)) return -1;
+  /* Get the faulting address' PTE; the VM layer fills in missing pages */
+  if ((err = get_pte(pgi->pg_dir, pgi->pg_tbls, vaddr, &pte))) {
+    if (err == -3) return -1;
+    return vm_page_in(vmi, vaddr, error_code & PG_FAULT_WRITE) ? -1 : 0;
+  }
+
+  /* Give the writer its own copy */
+  if (pte & PG_TBL_COW) {
+    if (!break_cow(pgi, vaddr)) return 0;
+
+    /* Out of frames; squeeze some cold pages and try once more.  A peer
+     * may have split the page meanwhile, and the sweep may even have
+     * compressed it; then the access simply faults again.
+     */
+    if (vm_reclaim(vmi, ZS_RECLAIM_BATCH) <= 0) return -4;
+    if (get_pte(pgi->pg_dir, pgi->pg_tbls, vaddr, &pte)
+        || !(pte & PG_TBL_COW))
+      return 0;
+    return break_cow(pgi, vaddr) ? -4 : 0;
+  }
 
   /* Don't back non-ZFOD pages */
   if (GET_ADDR(pte) != zfod) return -2;
 
-  /* Try to get a real frame */
-  if (!physically_back_page(pgi, vaddr)) return -3;
+  /* Back it (and maybe its neighbors) with real frames */
+  return vm_fault_zfod(vmi, vaddr) ? -3 : 0;
+}
+
+/** @brief Handle page faults.
+ *
+ *  We try to back faulting ZFOD pages with real physical frames, split
+ *  copy-on-write pages and read in file-backed pages; nothing is done with
+ *  other pages.  The VM layer decides how many neighbors of a ZFOD or
+ *  file-backed page to fill in along with it.
+ *
+ *  The faulter's map lock is held shared throughout, so no region can be
+ *  reshaped or freed under us.  That includes the faults the uaccess
+ *  primitives take on the kernel's behalf; they must never run with the
+ *  map lock held.
+ *
+ *  @param vaddr The faulting virtual address.
+ *  @param error_code The error code the processor pushed for the fault.
+ *
+ *  @return 0 on success; a negative integer error code on failure.
+ **/
+/* For debugging cho variant, please keep */
+#include <sched.h>
+int pg_page_fault_handler(void *vaddr, unsigned int error_code)
+{
+  vm_info_s *vmi;
+  int err;
+
+  vmi = &curr_tsk->vmi;
+
+  rwlock_lock(&vmi->lock, RWLOCK_READ);
+  err = resolve_fault(vmi, vaddr, error_code);
+  rwlock_unlock(&vmi->lock);
+
+  return err;
+}
+
+
+/*************************************************************************
+ *  Large pages
+ *************************************************************************/
+
+/** @brief Allocate a 4MB page.
+ *
+ *  Large pages are backed right away by a zeroed, physically contiguous
+ *  block from the buddy allocator; we don't ZFOD them.
+ *
+ *  @param pgi Page table information.
+ *  @param vaddr The (4MB-aligned) virtual address to allocate.
+ *  @param attrs The attributes for the allocation.
+ *
+ *  @return A pointer to the block backing the page, or NULL on failure.
+ **/
+void *pg_alloc_large(pg_info_s *pgi, void *vaddr, unsigned int attrs)
+{
+  pte_t pde;
+  char *block;
+  int i;
+
+  /* The tome better not be in use */
+  if (!get_pde(pgi->pg_dir, vaddr, NULL)) return NULL;
+
+  block = fr_alloc_block(BUDDY_MAX_ORDER);
+  if (!block) return NULL;
+
+  /* Buddy blocks come to us dirty */
+  for (i = 0; i < BUDDY_BLOCK_FRAMES; ++i) {
+    mutex_lock(&copy_lock);
+    memset(kwin_map(KWIN_COPY, block + i*PAGE_SIZE), 0, PAGE_SIZE);
+    mutex_unlock(&copy_lock);
+  }
+
+  /* Map the block */
+  pde = PACK_PTE(block, PG_TBL_PRESENT | PG_DIR_PSE);
+  translate_attrs(&pde, attrs);
+  set_pde(pgi->pg_dir, vaddr, &pde);
+  tlb_inval_page(vaddr);
+
+  return block;
+}
+
+/** @brief Free a 4MB page.
+ *
+ *  @param pgi Page table information.
+ *  @param vaddr The page's virtual address.
+ *
+ *  @return Void.
+ **/
+void pg_free_large(pg_info_s *pgi, void *vaddr)
+{
+  pte_t pde;
+
+  /* If it isn't a large page, there's nothing to free */
+  if (get_pde(pgi->pg_dir, vaddr, &pde) || !(pde & PG_DIR_PSE))
+    return;
+
+  fr_free_block(GET_ADDR(pde), BUDDY_MAX_ORDER);
+
+  /* Free the page; invalidate the tlb entry */
+  init_pte(&pde, NULL);
+  set_pde(pgi->pg_dir, vaddr, &pde);
+  tlb_inval_page(vaddr);
+
+  return;
+}
+
+/** @brief Copies a 4MB page.
+ *
+ *  Large pages aren't shared copy-on-write; the child gets its own block
+ *  right away.  The source must be the current address space.
+ *
+ *  @param dst The destination page info struct.
+ *  @param src The source page info struct.
+ *  @param vaddr The vitual address of the page to copy.
+ *
+ *  @return 0 on success; a negative integer error code if the page doesn't
+ *  exist; 1 if we're out of memory.
+ **/
+int pg_copy_large(pg_info_s *dst, pg_info_s *src, void *vaddr)
+{
+  pte_t pde;
+  char *block;
+  int i;
+
+  /* The page better exist in the parent */
+  if (get_pde(src->pg_dir, vaddr, &pde) || !(pde & PG_DIR_PSE))
+    return -1;
+
+  block = fr_alloc_block(BUDDY_MAX_ORDER);
+  if (!block) return 1;
+
+  /* Copy the block a frame at a time */
+  for (i = 0; i < BUDDY_BLOCK_FRAMES; ++i) {
+    mutex_lock(&copy_lock);
+    memcpy(kwin_map(KWIN_COPY, block + i*PAGE_SIZE),
+           (char *)vaddr + i*PAGE_SIZE, PAGE_SIZE);
+    mutex_unlock(&copy_lock);
+  }
 
-  /* Make the page writable */
-  pg_set_attrs(pgi, vaddr, GET_ATTRS(pte) | PG_TBL_WRITABLE);
+  pde = PACK_PTE(block, GET_ATTRS(pde));
+  set_pde(dst->pg_dir, vaddr, &pde);
 
   return 0;
 }
@@ -402,11 +1061,12 @@ void validate_pd(pg_info_s *pgi)
 
   for(i = KERN_PD_ENTRIES; i < PG_TBL_ENTRIES - 1; i++){
     /* PDE is present, make sure PTEs are present too */
-    if(!get_pde(pgi->pg_dir, &tomes[i], &pte)){
+    if(!get_pde(pgi->pg_dir, &tomes[i], &pte) && !(pte & PG_DIR_PSE)){
       found = 0;
       for(j = 0; j < PG_TBL_ENTRIES; j++){
-        /* valid PTE found */
-        if(!get_pte(pgi->pg_dir, pgi->pg_tbls, &tomes[i][j], &pte)){
+        /* valid (or swapped out) PTE found */
+        if(!peek_pte(pgi->pg_dir, pgi->pg_tbls, &tomes[i][j], &pte)
+           && pte){
           found = 1;
           break;
         }
@@ -418,7 +1078,7 @@ void validate_pd(pg_info_s *pgi)
   return;
 }
 
-/** @brief Ensure that if we are freeing a page table, all PTEs are invalid.
+/** @brief Ensure that if we are freeing a page table, all PTEs are zero.
  *
  *  @param pgi Page directory and table information.
  *  @param vaddr Virtual address that maps to page table we are checking.
@@ -434,8 +1094,10 @@ void validate_pt(pg_info_s *pgi, void *vaddr)
   tome = tomes[PG_DIR_INDEX(vaddr)];
 
   for(i = 0; i < PG_TBL_ENTRIES; i++){
-    /* Ensure no PTE is valid */
-    assert(get_pte(pgi->pg_dir, pgi->pg_tbls, &tome[i], &pte));
+    /* Ensure every PTE is zero; we cache empty tables, and a stray swap
+     * cookie would leak its slot
+     */
+    assert(peek_pte(pgi->pg_dir, pgi->pg_tbls, &tome[i], &pte) || !pte);
   }
 
   return;
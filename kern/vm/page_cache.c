@@ -0,0 +1,246 @@
+/** @file page_cache.c
+ *
+ *  @brief Implements the executable page cache.
+ *
+ *  Read-only pages of an executable (text and rodata) are the same in
+ *  every task running it, so the first task to read one in shares its
+ *  frame with everyone after it.  Pages are keyed on the executable's
+ *  table of contents entry and the page's address, which the ELF header
+ *  fixes.  Pages of files mapped whole (see vm_map_file(...)) are keyed on
+ *  their file offset instead; files live in kernel memory, so offsets are
+ *  all below USER_MEM_START and never collide with addresses.
+ *
+ *  The cache holds one reference on each frame, and every mapping holds
+ *  another.  When the last mapping goes away, pc_put(...) drops the entry
+ *  and its reference, and the frame is freed.  Mappings of cached frames
+ *  carry PG_TBL_CACHED so the page allocator knows to come here.
+ *
+ *  @author Enrique Naudon (esn)
+ *  @author Marlies Ruck (mruck)
+ **/
+#include <simics.h>
+
+#include <page_cache.h>
+
+/* Pebbles includes */
+#include <frame_alloc.h>
+#include <mutex.h>
+#include <pg_table.h>
+
+/* Libc includes */
+#include <assert.h>
+#include <malloc.h>
+#include <stddef.h>
+
+
+/* Entries hashed by (file, vaddr) and by frame */
+static pc_entry_s *key_tbl[PC_BUCKETS];
+static pc_entry_s *frame_tbl[PC_BUCKETS];
+
+/* Protects both tables and the stats */
+static mutex_s pc_lock = MUTEX_INITIALIZER(pc_lock);
+static pc_stats_s stats;
+
+/** @brief Hashes an address to a bucket.
+ *
+ *  @param addr A page-aligned address.
+ *
+ *  @return A bucket index.
+ **/
+#define PC_HASH(addr) \
+  ( ((unsigned int)(addr) >> PG_TBL_SHIFT) % PC_BUCKETS )
+
+/** @brief Hashes a (file, vaddr) key to a bucket.
+ *
+ *  @param file The executable.
+ *  @param vaddr The page's address.
+ *
+ *  @return A bucket index.
+ **/
+#define PC_KEY_HASH(file,vaddr) \
+  ( (PC_HASH(vaddr) ^ ((unsigned int)(file) >> 4)) % PC_BUCKETS )
+
+/*************************************************************************
+ *  Helper functions
+ *************************************************************************/
+
+/** @brief Finds a page's entry.  Call with pc_lock held.
+ *
+ *  @param file The executable.
+ *  @param vaddr The page's address.
+ *
+ *  @return The entry, or NULL if the page isn't cached.
+ **/
+static pc_entry_s *find_key(const exec2obj_userapp_TOC_entry *file,
+                            void *vaddr)
+{
+  pc_entry_s *e;
+
+  for (e = key_tbl[PC_KEY_HASH(file, vaddr)]; e; e = e->key_next) {
+    if (e->file == file && e->vaddr == vaddr) return e;
+  }
+  return NULL;
+}
+
+/** @brief Unlinks a frame's entry from both tables.  Call with pc_lock held.
+ *
+ *  @param frame The frame.
+ *
+ *  @return The entry, or NULL if the frame isn't cached.
+ **/
+static pc_entry_s *unlink_frame(void *frame)
+{
+  pc_entry_s **pp, *e;
+
+  /* Reverse lookup */
+  for (pp = &frame_tbl[PC_HASH(frame)]; *pp; pp = &(*pp)->frame_next) {
+    if ((*pp)->frame == frame) break;
+  }
+  if (!(e = *pp)) return NULL;
+  *pp = e->frame_next;
+
+  /* Now drop it from the key table */
+  for (pp = &key_tbl[PC_KEY_HASH(e->file, e->vaddr)]; *pp != e;
+       pp = &(*pp)->key_next) {
+    assert(*pp);
+  }
+  *pp = e->key_next;
+
+  return e;
+}
+
+/*************************************************************************
+ *  Exported API
+ *************************************************************************/
+
+/** @brief Looks up a cached page.
+ *
+ *  @param file The executable.
+ *  @param vaddr The page's (page-aligned) address.
+ *
+ *  @return The page's frame, with a new reference for the caller's mapping,
+ *  or NULL on a miss.
+ **/
+void *pc_get(const exec2obj_userapp_TOC_entry *file, void *vaddr)
+{
+  pc_entry_s *e;
+  void *frame = NULL;
+
+  mutex_lock(&pc_lock);
+  if ((e = find_key(file, vaddr))) {
+    frame = e->frame;
+    fr_ref(frame);
+    stats.hits++;
+  }
+  else stats.misses++;
+  mutex_unlock(&pc_lock);
+
+  return frame;
+}
+
+/** @brief Caches a freshly read-in page.
+ *
+ *  If another task cached the page while we were reading it in, we get
+ *  theirs instead and the caller should drop its frame.
+ *
+ *  @param file The executable.
+ *  @param vaddr The page's (page-aligned) address.
+ *  @param frame The frame holding the page, with one reference for the
+ *         caller's mapping.
+ *
+ *  @return The frame the caller should map (referenced for it), or NULL if
+ *  we couldn't allocate an entry and the page is not cached.
+ **/
+void *pc_insert(const exec2obj_userapp_TOC_entry *file, void *vaddr,
+                void *frame)
+{
+  pc_entry_s *e, *new;
+  unsigned int b;
+
+  new = malloc(sizeof(pc_entry_s));
+
+  mutex_lock(&pc_lock);
+
+  /* Somebody beat us to it */
+  if ((e = find_key(file, vaddr))) {
+    fr_ref(e->frame);
+    mutex_unlock(&pc_lock);
+    if (new) free(new);
+    return e->frame;
+  }
+  if (!new) {
+    mutex_unlock(&pc_lock);
+    return NULL;
+  }
+
+  /* The cache keeps its own reference */
+  new->file = file;
+  new->vaddr = vaddr;
+  new->frame = frame;
+  fr_ref(frame);
+
+  b = PC_KEY_HASH(file, vaddr);
+  new->key_next = key_tbl[b];
+  key_tbl[b] = new;
+  b = PC_HASH(frame);
+  new->frame_next = frame_tbl[b];
+  frame_tbl[b] = new;
+  stats.entries++;
+
+  mutex_unlock(&pc_lock);
+  return frame;
+}
+
+/** @brief Drops a mapping's reference to a cached frame.
+ *
+ *  If only the cache's reference is left, the page is evicted.
+ *
+ *  @param frame The frame.
+ *
+ *  @return Nonzero if the caller should now free the frame; 0 otherwise.
+ **/
+int pc_put(void *frame)
+{
+  pc_entry_s *e = NULL;
+  int left;
+
+  mutex_lock(&pc_lock);
+  left = fr_unref(frame);
+  if (left == 1 && (e = unlink_frame(frame))) {
+    left = fr_unref(frame);
+    stats.entries--;
+    stats.evictions++;
+  }
+  mutex_unlock(&pc_lock);
+
+  if (e) free(e);
+  return left == 0;
+}
+
+/** @brief Reads the page cache counters.
+ *
+ *  @param dst Where to write the counters.
+ *
+ *  @return Void.
+ **/
+void pc_get_stats(pc_stats_s *dst)
+{
+  mutex_lock(&pc_lock);
+  *dst = stats;
+  mutex_unlock(&pc_lock);
+  return;
+}
+
+/** @brief Prints the page cache counters to the simics console.
+ *
+ *  @return Void.
+ **/
+void pc_dump_stats(void)
+{
+  pc_stats_s s;
+
+  pc_get_stats(&s);
+  lprintf("page cache: %u pages, %u hits, %u misses, %u evictions",
+          s.entries, s.hits, s.misses, s.evictions);
+  return;
+}
@@ -13,8 +13,11 @@
 
 /* Pebbles includes */
 #include <frame_alloc.h>
+#include <mutex.h>
+#include <tlb.h>
 
 /* Libc includes */
+#include <assert.h>
 #include <malloc.h>
 #include <stddef.h>
 #include <string.h>
@@ -24,27 +27,86 @@
 page_t *pages = (page_t *)NULL;
 tome_t *tomes = (tome_t *)NULL;
 
+/* Kernel page directory entries, and page tables for the few that need them */
+static pte_t kern_pd[KERN_PD_ENTRIES];
 static pte_t *kern_pt[KERN_PD_ENTRIES];
 
+/* Kernel window pages */
+static page_t *kwins;
+
+/* Kernel memory that gets real page tables, so pages can be unmapped */
+#define KERN_FINE_RANGES 4
+static struct { char *lo, *hi; } fine[KERN_FINE_RANGES];
+static int nfine = 0;
+
+/* Freed page directories, ready for reuse */
+static pte_t *pd_cache[PG_DIR_CACHE_HWM];
+static int pd_cached = 0;
+static mutex_s pd_cache_lock = MUTEX_INITIALIZER(pd_cache_lock);
+
+
+/** @brief Reserves kernel memory mapped with small pages.
+ *
+ *  The rest of the direct map uses large pages, so this is the only kernel
+ *  memory whose pages can be unmapped (see kern_unmap_page(...)).  The
+ *  reservation must happen before init_kern_pt(...) builds the tables.
+ *
+ *  @param len Bytes to reserve; a multiple of PAGE_SIZE.
+ *
+ *  @return The page-aligned memory, or NULL if we're out.
+ **/
+void *kern_reserve_fine(size_t len)
+{
+  char *mem;
+
+  assert(nfine < KERN_FINE_RANGES);
+  assert(len % PAGE_SIZE == 0);
+
+  mem = smemalign(PAGE_SIZE, len);
+  if (!mem) return NULL;
+
+  fine[nfine].lo = mem;
+  fine[nfine].hi = mem + len - 1;
+  nfine++;
+
+  return mem;
+}
 
 /** @brief Initialize kernel pages.
  *
  *  Kernel memory is direct-mapped into every process' lowest 16MB of
- *  memory, so we store the page tables in a global and reuse them for each
- *  process.
+ *  memory, so we store the page directory entries in a global and reuse them
+ *  for each process.  The direct map uses global 4MB pages, except for the
+ *  tomes holding the kernel windows and other fine reservations: those get
+ *  real page tables so their pages can be retargeted or unmapped.
  *
  *  @return Void.
  **/
 void init_kern_pt(void)
 {
-  int i, j;
+  int i, j, k;
+
+  /* Reserve the kernel windows */
+  kwins = kern_reserve_fine(KWIN_COUNT * PAGE_SIZE);
+  assert(kwins);
 
   for (i = 0; i < KERN_PD_ENTRIES; i++)
   {
+    /* Most of the kernel is one large page per tome */
+    for (k = 0; k < nfine; ++k) {
+      if (PG_DIR_INDEX(fine[k].lo) <= i && i <= PG_DIR_INDEX(fine[k].hi))
+        break;
+    }
+    if (k == nfine) {
+      kern_pt[i] = NULL;
+      kern_pd[i] = PACK_PTE(tomes[i], KERN_PSE_ATTRS);
+      continue;
+    }
+
     /* Allocate kernel page table */
-    kern_pt[i] = fr_retrieve_head();
-    --fr_avail;
-    fr_update_head(*(void **)kern_pt[i]);
+    kern_pt[i] = smemalign(PAGE_SIZE, PAGE_SIZE);
+    assert(kern_pt[i]);
+    kern_pd[i] = PACK_PTE(kern_pt[i], KERN_PTE_ATTRS);
 
     /* Direct map kernel pages */
     for (j = 0; j < PG_TBL_ENTRIES; j++) {
@@ -55,12 +117,59 @@ void init_kern_pt(void)
   return;
 }
 
+/** @brief Unmaps a page of kernel memory, e.g. to make a guard page.
+ *
+ *  The page must come from kern_reserve_fine(...).  Kernel page tables are
+ *  shared by every address space, so the page is gone everywhere.
+ *
+ *  @param vaddr The page's address.
+ *
+ *  @return Void.
+ **/
+void kern_unmap_page(void *vaddr)
+{
+  assert(kern_pt[PG_DIR_INDEX(vaddr)]);
+
+  kern_pt[PG_DIR_INDEX(vaddr)][PG_TBL_INDEX(vaddr)] = 0;
+  tlb_inval_page(vaddr);
+
+  return;
+}
+
+/** @brief Point a kernel window at an arbitrary frame.
+ *
+ *  The kernel's page tables are shared by every address space, so this lets
+ *  us touch frames that aren't mapped in user-space regardless of who is
+ *  running.
+ *
+ *  @param win The window.
+ *  @param frame The frame to map.
+ *
+ *  @return The window's virtual address.
+ **/
+void *kwin_map(kwin_e win, void *frame)
+{
+  void *vaddr;
+
+  assert(0 <= win && win < KWIN_COUNT);
+  vaddr = &kwins[win];
+
+  kern_pt[PG_DIR_INDEX(vaddr)][PG_TBL_INDEX(vaddr)] =
+    PACK_PTE(frame, KERN_PTE_ATTRS);
+  tlb_inval_page(vaddr);
+
+  return vaddr;
+}
+
 
 /*************************************************************************
  *  Page directory manipulation
  *************************************************************************/
 
 /** @brief Allocate and initialize a page directory.
+ *
+ *  Page directories freed by pd_free(...) are still initialized, so we hand
+ *  those out as-is when we have them.
  *
  *  @return A pointer to the new page directory.
  **/
@@ -69,6 +178,12 @@ pte_t *pd_init(void)
   pte_t *pd;
   int i;
 
+  /* Try the cache first */
+  mutex_lock(&pd_cache_lock);
+  pd = pd_cached ? pd_cache[--pd_cached] : NULL;
+  mutex_unlock(&pd_cache_lock);
+  if (pd) return pd;
+
   /* Allocate memory for the page directory */
   pd = smemalign(PAGE_SIZE, PAGE_SIZE);
   if (!pd) return NULL;
@@ -76,9 +191,9 @@ pte_t *pd_init(void)
   /* The page directory is also a page table... */
   pd[PG_SELFREF_INDEX] = PACK_PTE(pd, PG_SELFREF_ATTRS);
 
-  /* Map the kernel's page table */
+  /* Map the kernel */
   for (i = 0; i < KERN_PD_ENTRIES; i++) {
-    pd[i] = PACK_PTE(kern_pt[i], KERN_PTE_ATTRS);
+    pd[i] = kern_pd[i];
   }
 
   /* Init the directory */
@@ -90,6 +205,35 @@ pte_t *pd_init(void)
   return pd;
 }
 
+/** @brief Free a page directory.
+ *
+ *  The directory's user-space must already have been torn down, which
+ *  leaves it exactly as pd_init(...) made it; we keep up to
+ *  PG_DIR_CACHE_HWM such directories around for reuse.
+ *
+ *  @param pd The page directory.
+ *
+ *  @return Void.
+ **/
+void pd_free(pte_t *pd)
+{
+  int i;
+
+  /* Invariant checker: no user-space mappings remain */
+  for (i = KERN_PD_ENTRIES; i < PG_SELFREF_INDEX; i++)
+    assert(pd[i] == 0);
+
+  mutex_lock(&pd_cache_lock);
+  if (pd_cached < PG_DIR_CACHE_HWM) {
+    pd_cache[pd_cached++] = pd;
+    pd = NULL;
+  }
+  mutex_unlock(&pd_cache_lock);
+
+  if (pd) sfree(pd, PAGE_SIZE);
+  return;
+}
+
 /** @brief Get a page directory entry.
  *
  *  @param pd The page directory the entry is in.
@@ -176,11 +320,16 @@ void init_pt(pte_t *pt)
 int get_pte(pte_t *pd, pt_t *pt, void *addr, pte_t *dst)
 {
   int pdi, pti;
+  pte_t pde;
   
   /* Return an error if the PDE isn't present */
-  if (get_pde(pd, addr, NULL))
+  if (get_pde(pd, addr, &pde))
     return -1;
 
+  /* Large pages don't have page tables */
+  if (pde & PG_DIR_PSE)
+    return -3;
+
   /* Compute index into page directory */
   pdi = PG_DIR_INDEX(addr); 
   pti = PG_TBL_INDEX(addr); 
@@ -194,6 +343,32 @@ int get_pte(pte_t *pd, pt_t *pt, void *addr, pte_t *dst)
   return 0;
 }
 
+/** @brief Get a page table entry, present or not.
+ *
+ *  Unlike get_pte(...), not-present entries are returned too, so callers
+ *  can see swap cookies.
+ *
+ *  @param pd The page directory the entry's page table is in.
+ *  @param pt The page table the entry is in.
+ *  @param addr The virtual address whose entry we want.
+ *  @param dst Where to write the entry.
+ *
+ *  @return 0 on success; a negative integer error code if there is no page
+ *  table for addr.
+ **/
+int peek_pte(pte_t *pd, pt_t *pt, void *addr, pte_t *dst)
+{
+  pte_t pde;
+
+  if (get_pde(pd, addr, &pde))
+    return -1;
+  if (pde & PG_DIR_PSE)
+    return -3;
+
+  *dst = pt[PG_DIR_INDEX(addr)][PG_TBL_INDEX(addr)];
+  return 0;
+}
+
 /** @brief Set a page table entry.
  *
  *  @param pd The page directory the entry's page table is in.
@@ -206,11 +381,16 @@ int get_pte(pte_t *pd, pt_t *pt, void *addr, pte_t *dst)
 int set_pte(pte_t *pd, pt_t *pt, void *addr, pte_t *pte)
 {
   int pdi, pti;
+  pte_t pde;
   
   /* Return an error if the PDE isn't present */ 
-  if (get_pde(pd, addr, NULL))
+  if (get_pde(pd, addr, &pde))
     return -1;
 
+  /* Large pages don't have page tables */
+  if (pde & PG_DIR_PSE)
+    return -3;
+
   /* Compute index into page directory */
   pdi = PG_DIR_INDEX(addr); 
   pti = PG_TBL_INDEX(addr); 
@@ -221,3 +401,53 @@ int set_pte(pte_t *pd, pt_t *pt, void *addr, pte_t *pte)
   return 0;
 }
 
+/** @brief Walks the in-use entries under a range.
+ *
+ *  Absent page tables are skipped a directory entry at a time, so the walk
+ *  costs time in the number of tables and pages actually mapped, not in
+ *  the size of the range.  Entries in use (present, or holding a swap
+ *  cookie) are handed to fn in contiguous runs; a run never crosses a page
+ *  table.  fn may rewrite the entries it's given, but not free the table.
+ *
+ *  Large pages have no entries, so the walk passes over them.
+ *
+ *  @param pd The page directory.
+ *  @param pt The page tables.
+ *  @param lo The first byte of the range.
+ *  @param hi The last byte of the range.
+ *  @param fn Called with each run.
+ *  @param arg Passed to fn.
+ *
+ *  @return 0 if the walk finished, or whatever fn stopped it with.
+ **/
+int walk_ptes(pte_t *pd, pt_t *pt, void *lo, void *hi, pte_run_fn fn,
+              void *arg)
+{
+  int pdi, pdi_hi, pti, pti_hi, run, err;
+
+  pdi_hi = PG_DIR_INDEX(hi);
+  for (pdi = PG_DIR_INDEX(lo); pdi <= pdi_hi; ++pdi)
+  {
+    if (!(pd[pdi] & PG_TBL_PRESENT) || (pd[pdi] & PG_DIR_PSE)) continue;
+
+    pti = (pdi == PG_DIR_INDEX(lo)) ? PG_TBL_INDEX(lo) : 0;
+    pti_hi = (pdi == pdi_hi) ? PG_TBL_INDEX(hi) : PG_TBL_ENTRIES - 1;
+
+    while (pti <= pti_hi)
+    {
+      /* Skip unused entries, then measure the run */
+      if (!pt[pdi][pti]) {
+        ++pti;
+        continue;
+      }
+      for (run = 1; pti + run <= pti_hi && pt[pdi][pti + run]; ++run)
+        continue;
+
+      if ((err = fn(&tomes[pdi][pti], run, arg))) return err;
+      pti += run;
+    }
+  }
+
+  return 0;
+}
+
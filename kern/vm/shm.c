@@ -0,0 +1,246 @@
+/** @file shm.c
+ *
+ *  @brief Implements shared memory objects.
+ *
+ *  An object is a run of pages that any number of tasks can map (see
+ *  vm_alloc_shared(...)).  Mapped pages point straight at the object's
+ *  frames, so writes by one task are seen by every other without the
+ *  kernel copying anything.
+ *
+ *  Objects live in a fixed table and are named by handles, which count up
+ *  from 1 so a stale handle won't find the object that took over its slot.
+ *
+ *  Since handles are easy to guess, a task may only attach objects it
+ *  created or inherited the right to: each task records the handles it was
+ *  granted, indexed by the object's slot (see sys_shm_attach(...)).  Stale
+ *  grants are harmless, as the slot's next object has a new handle.
+ *
+ *  @author Enrique Naudon (esn)
+ *  @author Marlies Ruck (mruck)
+ **/
+#include <simics.h>
+
+#include <shm.h>
+
+/* Pebbles includes */
+#include <frame_alloc.h>
+#include <mutex.h>
+#include <page_alloc.h>
+#include <sched.h>
+
+/* Libc includes */
+#include <assert.h>
+#include <malloc.h>
+#include <stddef.h>
+
+
+static shm_s objects[SHM_MAX];
+static int next_handle = 1;
+
+/* Protects everything above and the stats */
+static mutex_s shm_lock = MUTEX_INITIALIZER(shm_lock);
+static shm_stats_s stats;
+
+/*************************************************************************
+ *  Exported API
+ *************************************************************************/
+
+/** @brief Creates a shared memory object.
+ *
+ *  The object starts with one reference, for the caller's mapping.
+ *
+ *  @param npages The object's size, in pages.
+ *
+ *  @return The object, or NULL if we're out of objects or memory.
+ **/
+shm_s *shm_create(int npages)
+{
+  shm_s *shm = NULL;
+  void **frames;
+  int i;
+
+  if (npages <= 0 || npages > SHM_MAX_PAGES) return NULL;
+
+  frames = calloc(npages, sizeof(void *));
+  if (!frames) return NULL;
+
+  mutex_lock(&shm_lock);
+
+  for (i = 0; i < SHM_MAX; ++i) {
+    if (!objects[i].handle) {
+      shm = &objects[i];
+      break;
+    }
+  }
+  if (!shm) {
+    mutex_unlock(&shm_lock);
+    free(frames);
+    return NULL;
+  }
+
+  shm->handle = next_handle;
+  if (++next_handle <= 0) next_handle = 1;
+  shm->refs = 1;
+  shm->npages = npages;
+  shm->frames = frames;
+
+  stats.creates++;
+  if (++stats.objects > stats.peak) stats.peak = stats.objects;
+
+  mutex_unlock(&shm_lock);
+  return shm;
+}
+
+/** @brief Finds an object by handle, taking a reference to it.
+ *
+ *  @param handle The object's handle.
+ *
+ *  @return The object, or NULL if no object has that handle.
+ **/
+shm_s *shm_lookup(int handle)
+{
+  shm_s *shm = NULL;
+  int i;
+
+  if (handle <= 0) return NULL;
+
+  mutex_lock(&shm_lock);
+  for (i = 0; i < SHM_MAX; ++i) {
+    if (objects[i].handle == handle) {
+      shm = &objects[i];
+      shm->refs++;
+      stats.attaches++;
+      break;
+    }
+  }
+  mutex_unlock(&shm_lock);
+
+  return shm;
+}
+
+/** @brief Gets an object's slot in the table.
+ *
+ *  @param shm The object.
+ *
+ *  @return The slot, from 0 to SHM_MAX - 1.
+ **/
+int shm_slot(const shm_s *shm)
+{
+  return shm - objects;
+}
+
+/** @brief Takes another reference to an object.
+ *
+ *  @param shm The object.
+ *
+ *  @return Void.
+ **/
+void shm_ref(shm_s *shm)
+{
+  mutex_lock(&shm_lock);
+  assert(shm->refs > 0);
+  shm->refs++;
+  mutex_unlock(&shm_lock);
+  return;
+}
+
+/** @brief Drops a reference to an object, destroying it if it was the last.
+ *
+ *  The object's frames are freed once no PTE maps them either.
+ *
+ *  @param shm The object.
+ *
+ *  @return Void.
+ **/
+void shm_put(shm_s *shm)
+{
+  void **frames;
+  int i, npages;
+
+  mutex_lock(&shm_lock);
+  assert(shm->refs > 0);
+  if (--shm->refs) {
+    mutex_unlock(&shm_lock);
+    return;
+  }
+
+  /* Free the slot; nobody can reach the frames now */
+  frames = shm->frames;
+  npages = shm->npages;
+  shm->handle = 0;
+  shm->frames = NULL;
+  stats.objects--;
+  for (i = 0; i < npages; ++i)
+    if (frames[i]) stats.frames--;
+  mutex_unlock(&shm_lock);
+
+  for (i = 0; i < npages; ++i) {
+    if (frames[i] && !fr_unref(frames[i])) free_frame(frames[i]);
+  }
+  free(frames);
+
+  return;
+}
+
+/** @brief Gets the frame backing one of an object's pages.
+ *
+ *  A page's frame is allocated (zeroed) the first time it's asked for.
+ *
+ *  @param shm The object.
+ *  @param idx The page's index in the object.
+ *
+ *  @return The frame, with a reference taken for the caller's mapping, or
+ *  NULL if we're out of memory.
+ **/
+void *shm_frame(shm_s *shm, int idx)
+{
+  void *frame;
+
+  assert(0 <= idx && idx < shm->npages);
+
+  mutex_lock(&shm_lock);
+
+  if (!(frame = shm->frames[idx])) {
+    frame = fr_alloc(&curr_thr->frmag);
+    if (!frame) {
+      mutex_unlock(&shm_lock);
+      return NULL;
+    }
+    fr_ref(frame);
+    shm->frames[idx] = frame;
+    stats.frames++;
+  }
+  fr_ref(frame);
+
+  mutex_unlock(&shm_lock);
+  return frame;
+}
+
+/** @brief Reads the shared memory counters.
+ *
+ *  @param dst Where to write the counters.
+ *
+ *  @return Void.
+ **/
+void shm_get_stats(shm_stats_s *dst)
+{
+  mutex_lock(&shm_lock);
+  *dst = stats;
+  mutex_unlock(&shm_lock);
+  return;
+}
+
+/** @brief Prints the shared memory counters to the simics console.
+ *
+ *  @return Void.
+ **/
+void shm_dump_stats(void)
+{
+  shm_stats_s s;
+
+  shm_get_stats(&s);
+  lprintf("shm: %u objects (peak %u/%u) holding %u frames, %u created, "
+          "%u attaches", s.objects, s.peak, SHM_MAX, s.frames, s.creates,
+          s.attaches);
+  return;
+}
@@ -7,11 +7,20 @@
  *
  *  @bug No known bugs.
  */
+#include <simics.h>
+
 #include <tlb.h>
 
 /* Pebbles specific includes */
 #include <pg_table.h>
 #include <page_alloc.h>
+#include <util.h>
+
+/* Batches larger than this get a full flush */
+int tlb_flush_threshold = TLB_FLUSH_THRESHOLD;
+
+/* Invalidation counters; only ever incremented, so no lock */
+static tlb_stats_s stats;
 
 
 /** @brief Invalidates page table-worth of TLB entries.
@@ -29,13 +38,12 @@
  **/
 void tlb_inval_tome(void *pt)
 {
-  page_t *tome;
-  int i;
+  tlb_batch_s batch;
 
-  tome = tomes[PG_DIR_INDEX(pt)];
-  for (i = 0; i < PG_TBL_ENTRIES; ++i) {
-    tlb_inval_page(&tome[i]);
-  }
+  /* A whole tome is well past the threshold; this is a CR3 reload */
+  tlb_batch_init(&batch);
+  tlb_batch_range(&batch, tomes[PG_DIR_INDEX(pt)], PG_TBL_ENTRIES);
+  tlb_batch_commit(&batch);
 
   return;
 }
@@ -53,3 +61,169 @@ void tlb_inval_pde(pg_info_s *pgi, void *vaddr)
 
   return;
 }
+
+/*************************************************************************
+ *  Batches
+ *************************************************************************/
+
+/** @brief Initializes an empty batch.
+ *
+ *  @param batch The batch to initialize.
+ *
+ *  @return Void.
+ **/
+void tlb_batch_init(tlb_batch_s *batch)
+{
+  batch->npages = 0;
+  batch->nranges = 0;
+  batch->overflow = 0;
+  batch->nframes = 0;
+
+  return;
+}
+
+/** @brief Queues a page for invalidation.
+ *
+ *  @param batch The batch.
+ *  @param vaddr An address on the page.
+ *
+ *  @return Void.
+ **/
+void tlb_batch_page(tlb_batch_s *batch, void *vaddr)
+{
+  tlb_batch_range(batch, vaddr, 1);
+  return;
+}
+
+/** @brief Queues a run of contiguous pages for invalidation.
+ *
+ *  Runs that pick up where the last one left off are merged into it.  Once
+ *  we're out of ranges, we stop tracking addresses and just count pages;
+ *  the commit will have to reload CR3.
+ *
+ *  @param batch The batch.
+ *  @param start An address on the first page.
+ *  @param npages The number of pages.
+ *
+ *  @return Void.
+ **/
+void tlb_batch_range(tlb_batch_s *batch, void *start, int npages)
+{
+  tlb_range_s *last;
+
+  start = (void *)FLOOR(start, PAGE_SIZE);
+  batch->npages += npages;
+  if (batch->overflow) return;
+
+  /* Extend the last run if we can */
+  if (batch->nranges > 0) {
+    last = &batch->ranges[batch->nranges - 1];
+    if ((char *)last->start + last->npages*PAGE_SIZE == start) {
+      last->npages += npages;
+      return;
+    }
+  }
+
+  /* Otherwise start a new one */
+  if (batch->nranges == TLB_BATCH_RANGES) {
+    batch->overflow = 1;
+    return;
+  }
+  batch->ranges[batch->nranges].start = start;
+  batch->ranges[batch->nranges].npages = npages;
+  batch->nranges++;
+
+  return;
+}
+
+/** @brief Frees a frame once the batch's invalidations are done.
+ *
+ *  The caller must have already queued every page that maps the frame.  If
+ *  the batch is out of room, we commit it early to make some.
+ *
+ *  @param batch The batch.
+ *  @param frame The frame to free.
+ *
+ *  @return Void.
+ **/
+void tlb_batch_defer_free(tlb_batch_s *batch, void *frame)
+{
+  if (batch->nframes == TLB_BATCH_FRAMES)
+    tlb_batch_commit(batch);
+
+  batch->frames[batch->nframes++] = frame;
+  return;
+}
+
+/** @brief Performs a batch's invalidations and frees its deferred frames.
+ *
+ *  Small batches are invalidated page by page; anything larger than
+ *  tlb_flush_threshold pages (or too fragmented to track) reloads CR3
+ *  instead.  Kernel mappings are global, so they survive the reload.
+ *
+ *  The batch is left empty and may be reused.
+ *
+ *  @param batch The batch.
+ *
+ *  @return Void.
+ **/
+void tlb_batch_commit(tlb_batch_s *batch)
+{
+  tlb_range_s *r;
+  char *addr;
+  int i, j;
+
+  if (batch->npages == 0 && batch->nframes == 0) return;
+  stats.commits++;
+
+  /* Invalidate */
+  if (batch->overflow || batch->npages > tlb_flush_threshold) {
+    tlb_flush_all();
+    stats.full_flushes++;
+    stats.saved += batch->npages - 1;
+  }
+  else {
+    for (i = 0; i < batch->nranges; ++i) {
+      r = &batch->ranges[i];
+      addr = r->start;
+      for (j = 0; j < r->npages; ++j, addr += PAGE_SIZE)
+        tlb_inval_page(addr);
+    }
+    stats.invlpgs += batch->npages;
+  }
+
+  /* Nothing can reach these frames anymore */
+  for (i = 0; i < batch->nframes; ++i)
+    free_frame(batch->frames[i]);
+
+  tlb_batch_init(batch);
+  return;
+}
+
+/*************************************************************************
+ *  Stats
+ *************************************************************************/
+
+/** @brief Reads the invalidation counters.
+ *
+ *  @param dst Where to write the counters.
+ *
+ *  @return Void.
+ **/
+void tlb_get_stats(tlb_stats_s *dst)
+{
+  *dst = stats;
+  return;
+}
+
+/** @brief Prints the invalidation counters to the simics console.
+ *
+ *  @return Void.
+ **/
+void tlb_dump_stats(void)
+{
+  lprintf("tlb: %u commits, %u invlpgs, %u full flushes (%u invlpgs saved), "
+          "threshold %d", stats.commits, stats.invlpgs, stats.full_flushes,
+          stats.saved, tlb_flush_threshold);
+  return;
+}
@@ -2,6 +2,13 @@
  *
  *  @brief Implements out virtual memory allocator.
  *
+ *  Each address space's memory map is guarded by its map lock.  Anything
+ *  that only looks regions up, page faults included, holds it shared;
+ *  anything that adds, removes or reshapes regions holds it exclusively.
+ *  It isn't the task lock, which system calls hold while touching user
+ *  memory: nothing may touch user memory while holding the map lock, since
+ *  the fault that might cause would need it again.
+ *
  *  @author Enrique Naudon (esn)
  *  @author Marlies Ruck (mruck)
  **/
@@ -14,17 +21,33 @@
 #include <frame_alloc.h>
 #include <mreg.h>
 #include <page_alloc.h>
+#include <shm.h>
 #include <tlb.h>
 #include <util.h>
+#include <zswap.h>
 
 /* Libc includes */
 #include <assert.h>
 #include <malloc.h>
 #include <stddef.h>
+#include <string.h>
 
 
 #define CHILD_PDE ( (void *)tomes[PG_TBL_ENTRIES - 2] )
 
+/* Fault-around window limit and counters */
+int vm_fa_max_pages = VM_FA_MAX_PAGES;
+static vm_fa_stats_s fa_stats;
+
+/** @brief The size of the pages backing a region.
+ *
+ *  @param mreg The region.
+ *
+ *  @return The region's page size.
+ **/
+#define MREG_PAGE_SIZE(mreg)  \
+  ( ((mreg)->attrs & VM_ATTR_LARGE) ? LARGE_PAGE_SIZE : PAGE_SIZE )
+
 /*************************************************************************
  *  Internal helper functions
  *************************************************************************/
@@ -62,34 +85,80 @@ mem_region_s *create_mem_region(vm_info_s *vmi, void *va_start, size_t len,
   assert( (((unsigned int) pg_start) & (PAGE_SIZE-1)) == 0 );
   assert( (((unsigned int) pg_limit) & (PAGE_SIZE-1)) == 0 );
 
-  /* Check that the system has enough frames */
+  /* Check that the system has enough frames (large pages come from the
+   * buddy allocator, which will tell us if it runs out)
+   */
   pg_count = (pg_limit - pg_start)/PAGE_SIZE;
-  if (pg_count > fr_avail) return NULL;
+  if (!(attrs & VM_ATTR_LARGE) && pg_count > fr_avail) return NULL;
 
   /* Allocate and initialize the new region */
-  mreg = malloc(sizeof(mem_region_s));
+  mreg = mreg_alloc();
   if (!mreg) return NULL;
   mreg_init(mreg, pg_start, pg_limit-1, attrs);
 
   /* Check that the requested memory is available */
   if (mreg_lookup(&vmi->mmap, mreg)) {
-    free(mreg);
+    mreg_free(mreg);
     return NULL;
   } 
 
   /* Insert it into the memory map */
   if (mreg_insert(&vmi->mmap, mreg)) {
-    free(mreg);
+    mreg_free(mreg);
     return NULL;
   }
 
   return mreg;
 }
 
+/** @brief Checks that a span lies in user-space.
+ *
+ *  The span may not wrap around, nor reach the tome vm_copy(...) borrows
+ *  for the child's page tables (or the self-mapped one above it).
+ *
+ *  @param va_start The span's start.
+ *  @param len The span's length in bytes.
+ *
+ *  @return Nonzero if it does; 0 otherwise.
+ **/
+static int user_span_ok(void *va_start, size_t len)
+{
+  char *lim = (char *)va_start + len - 1;
+
+  return va_start >= (void *)USER_MEM_START && len
+         && lim >= (char *)va_start && lim < (char *)CHILD_PDE;
+}
+
+/** @brief Frees the page tables under a span no region uses anymore.
+ *
+ *  Tables under tomes that some region still overlaps are kept.  Every page
+ *  in the span must already be unmapped.
+ *
+ *  @param vmi The vm_info struct the span is in.
+ *  @param lo The first byte of the span.
+ *  @param hi The last byte of the span.
+ *
+ *  @return Void.
+ **/
+static void free_span_tables(vm_info_s *vmi, void *lo, void *hi)
+{
+  mem_region_s tome;
+  int i;
+
+  for (i = PG_DIR_INDEX(lo); i <= PG_DIR_INDEX(hi); ++i) {
+    mreg_init(&tome, &tomes[i], (char *)&tomes[i + 1] - 1, 0);
+    if (!mreg_lookup(&vmi->mmap, &tome))
+      pg_free_table(&vmi->pg_info, &tomes[i]);
+  }
+
+  return;
+}
+
 /** @brief Destroys a memory region.
  *
  *  We also extract the memory region from the memory map and free the
- *  region's page tables where possible.
+ *  region's page tables where possible.  Every page in the region must
+ *  already be unmapped.
  *
  *  @param map Memory map to search.
  *  @param targ Region to check.
@@ -98,46 +167,112 @@ mem_region_s *create_mem_region(vm_info_s *vmi, void *va_start, size_t len,
  **/
 void destroy_mem_region(vm_info_s *vmi, mem_region_s *targ)
 {
-  int pdi_lo, pdi_hi, i;
-  int share_lo, share_hi;
-  mem_region_s *prev, *next;
+  /* Extract the node first, so only its neighbors can keep its tables;
+   * large pages don't have any
+   */
+  mreg_extract(&vmi->mmap, targ);
+  if (!(targ->attrs & VM_ATTR_LARGE))
+    free_span_tables(vmi, targ->start, targ->limit);
 
-  /* Retrieve your neighors in memory */
-  prev = mreg_prev(&vmi->mmap, targ);
-  next = mreg_next(&vmi->mmap, targ);
+  /* Free the node, letting go of any object it mapped */
+  if (targ->shm) shm_put(targ->shm);
+  mreg_free(targ);
+  return;
+}
 
-  /* Compute boundary page directory indicies */
-  pdi_lo = PG_DIR_INDEX(targ->start);
-  pdi_hi = PG_DIR_INDEX(targ->limit);
+/** @struct pte_walk
+ *  @brief What the walk_ptes(...) callbacks below need.
+ **/
+struct pte_walk {
+  vm_info_s *vmi;             /**< The address space being walked **/
+  vm_info_s *dst;             /**< Where copies go **/
+  unsigned int attrs;         /**< The attributes of the region walked **/
+  tlb_batch_s *tlb;           /**< Batch for the walked space's flushes **/
+};
+typedef struct pte_walk pte_walk_s;
+
+/** @brief Frees a run of pages.
+ *
+ *  @param addr The run's first page.
+ *  @param npages The number of pages in the run.
+ *  @param arg The walk.
+ *
+ *  @return 0.
+ **/
+static int free_run(void *addr, int npages, void *arg)
+{
+  pte_walk_s *w = arg;
+  char *page = addr;
 
-  /* Figure out which page tables are shared */
-  share_lo = prev ? pdi_lo == PG_DIR_INDEX(prev->limit) : 0;
-  share_hi = next ? pdi_hi == PG_DIR_INDEX(next->start) : 0;
+  for ( ; npages > 0; --npages, page += PAGE_SIZE)
+    pg_free(&w->vmi->pg_info, page, w->tlb);
 
-  /* The region has only one page table */
-  if(pdi_lo == pdi_hi)
-  {
-    /* Only free the tables if we don't share them */
-    if(!share_lo && !share_hi) pg_free_table(&vmi->pg_info, targ->start);
+  return 0;
+}
+
+/** @brief Shares one page with the walk's destination.
+ *
+ *  @param w The walk.
+ *  @param page The page; it may be unmapped, in which case we do nothing.
+ *
+ *  @return 0 on success; a negative integer error code if we're out of
+ *          memory.
+ **/
+static int copy_page(pte_walk_s *w, char *page)
+{
+  /* Compressed pages come back so they can be shared */
+  if (pg_swapped(&w->vmi->pg_info, page)) {
+    if (pg_swap_in(&w->vmi->pg_info, page, w->attrs)) return -1;
   }
+  else if (!pg_present(&w->vmi->pg_info, page)) return 0;
 
-  /* The region has multiple page tables */
-  else
-  {
-    /* Free your low table if it's not shared */
-    if(!share_lo) pg_free_table(&vmi->pg_info, targ->start);
+  return pg_copy(&w->dst->pg_info, &w->vmi->pg_info, page, w->tlb) ? -1 : 0;
+}
 
-    /* Free your high table if it's not shared */
-    if(!share_hi) pg_free_table(&vmi->pg_info, targ->start);
+/** @brief Shares a run of pages with the walk's destination.
+ *
+ *  Running out of frames (for a swapped-in page or one of the destination's
+ *  page tables) squeezes some cold pages out of the source and retries.
+ *  The page is looked at afresh, since the sweep may have compressed it.
+ *
+ *  @param addr The run's first page.
+ *  @param npages The number of pages in the run.
+ *  @param arg The walk.
+ *
+ *  @return 0 on success; a negative integer error code on failure.
+ **/
+static int copy_run(void *addr, int npages, void *arg)
+{
+  pte_walk_s *w = arg;
+  char *page = addr;
 
-    /* Free any tables in between */
-    for(i = ++pdi_lo; i < pdi_hi - 1; i++)
-      pg_free_table(&vmi->pg_info, &tomes[i]);
+  for ( ; npages > 0; --npages, page += PAGE_SIZE)
+  {
+    if (copy_page(w, page)
+        && (vm_reclaim(w->vmi, ZS_RECLAIM_BATCH) <= 0 || copy_page(w, page)))
+      return -1;
   }
 
-  /* Extract and free the node */
-  mreg_extract(&vmi->mmap, targ);
-  free(targ);
+  return 0;
+}
+
+/** @brief Frees all of a region's small pages.
+ *
+ *  @param vmi The vm_info struct the region is in.
+ *  @param mreg The region.
+ *  @param tlb Batch to queue the flushes on.
+ *
+ *  @return Void.
+ **/
+static void free_region_pages(vm_info_s *vmi, const mem_region_s *mreg,
+                              tlb_batch_s *tlb)
+{
+  pte_walk_s w;
+
+  w.vmi = vmi;
+  w.tlb = tlb;
+  walk_ptes(vmi->pg_info.pg_dir, vmi->pg_info.pg_tbls, mreg->start,
+            mreg->limit, free_run, &w);
   return;
 }
 
@@ -153,20 +288,62 @@ void map_dest_tables(vm_info_s *dst, vm_info_s *src)
   return;
 }
 
-void unmap_dest_tables(vm_info_s *dst, vm_info_s *src)
+void unmap_dest_tables(vm_info_s *dst, vm_info_s *src, tlb_batch_s *tlb)
 {
   pte_t pde;
 
-  /* Unmap dest tables */
+  /* Unmap dest tables; the flush rides along with whatever the copy
+   * queued (a tome is past the threshold, so this is one CR3 reload)
+   */
   pde = PACK_PTE(NULL, 0);
   set_pde(src->pg_info.pg_dir, CHILD_PDE, &pde);
-  tlb_inval_tome(CHILD_PDE);
-  tlb_inval_page(src->pg_info.pg_tbls[PG_DIR_INDEX(dst->pg_info.pg_tbls)]);
+  tlb_batch_range(tlb, CHILD_PDE, PG_TBL_ENTRIES);
+  tlb_batch_page(tlb,
+                 src->pg_info.pg_tbls[PG_DIR_INDEX(dst->pg_info.pg_tbls)]);
+  tlb_batch_commit(tlb);
   dst->pg_info.pg_tbls = PG_TBL_ADDR;
 
   return;
 }
 
+/** @brief Sizes a region's fault-around window for a fault.
+ *
+ *  A fault right where the last window ended looks like a sequential walk,
+ *  so the window doubles; any other fault shrinks it back to one page.  The
+ *  window never leaves the region or the faulting page's page table.
+ *
+ *  @param mreg The region containing the fault.
+ *  @param vaddr The faulting address.
+ *
+ *  @return The number of pages to fill in, starting with vaddr's.
+ **/
+int fault_window(mem_region_s *mreg, void *vaddr)
+{
+  char *page, *limit;
+  int max, n;
+
+  page = (char *)FLOOR(vaddr, PAGE_SIZE);
+  max = MIN(vm_fa_max_pages, VM_FA_MAX_PAGES);
+
+  if (page == mreg->fa_next) {
+    n = MIN(2*mreg->fa_window, max);
+    fa_stats.grows++;
+  }
+  else {
+    n = 1;
+    fa_stats.resets++;
+  }
+
+  /* Stay inside the region and the page table */
+  limit = MIN((char *)mreg->limit + 1,
+              (char *)CEILING(page + 1, TOME_SIZE));
+  n = MAX(1, MIN(n, (limit - page)/PAGE_SIZE));
+
+  mreg->fa_window = n;
+  mreg->fa_next = page + n*PAGE_SIZE;
+  return n;
+}
+
 /*************************************************************************
  *  Exported functions
  *************************************************************************/
@@ -183,7 +360,9 @@ void vm_init(vm_info_s *vmi)
 {
   vmi->pg_info.pg_dir = pd_init();
   vmi->pg_info.pg_tbls = PG_TBL_ADDR;
-  cll_init_list(&vmi->mmap);
+  mreg_map_init(&vmi->mmap);
+  vmi->zs_hand = NULL;
+  rwlock_init(&vmi->lock);
 
   return;
 }
@@ -203,8 +382,9 @@ void vm_init_allocator(void)
  *
  *  The new region will starting at va_start, extending for len bytes, and
  *  have the protections specified by attrs. The region struct is allocated
- *  by create_mem_region(), and the region is backed by physical frames in
- *  this function.
+ *  by create_mem_region(); large pages are backed by physical frames in
+ *  this function, but small pages are only recorded in the memory map and
+ *  are filled in by vm_page_in(...) when first touched.
  *
  *  If the allocation succeeds, the actual starting address of the allocated
  *  region is returned; otherwise NULL is returned.
@@ -223,31 +403,382 @@ void *vm_alloc(vm_info_s *vmi, void *va_start, size_t len,
   void *addr, *addr2;
   mem_region_s *mreg;
 
-  /* Ensure the address is not in reserved kernel memory */
-  if((va_start < (void *)USER_MEM_START)
-     || (va_start > (void *) PG_TBL_ADDR))
+  /* Ensure the span is not in reserved kernel memory */
+  if (!user_span_ok(va_start, len)) return NULL;
+
+  /* Large pages must cover whole tomes */
+  if ((attrs & VM_ATTR_LARGE) && (FLOOR(va_start, LARGE_PAGE_SIZE)
+      != (unsigned int)va_start || len % LARGE_PAGE_SIZE))
   {
     return NULL;
   }
 
+  rwlock_lock(&vmi->lock, RWLOCK_WRITE);
+
   /* Allocate a region */
   mreg = create_mem_region(vmi, va_start, len, attrs);
-  if(!mreg) return NULL;
+  if(!mreg) {
+    rwlock_unlock(&vmi->lock);
+    return NULL;
+  }
 
-  /* Allocate frames for the requested memory */
-  for (addr = mreg->start; addr < mreg->limit; addr += PAGE_SIZE)
+  /* Allocate the large pages */
+  if (attrs & VM_ATTR_LARGE)
   {
-    if (!pg_alloc(&vmi->pg_info, addr, attrs))
+    for (addr = mreg->start; addr < mreg->limit; addr += LARGE_PAGE_SIZE)
     {
-      for (addr2 = mreg->start; addr2 < addr; addr2 += PAGE_SIZE)
-        pg_free(&vmi->pg_info, addr2);
-      destroy_mem_region(vmi, mreg);
-      return NULL;
+      if (!pg_alloc_large(&vmi->pg_info, addr, attrs))
+      {
+        for (addr2 = mreg->start; addr2 < addr; addr2 += LARGE_PAGE_SIZE)
+          pg_free_large(&vmi->pg_info, addr2);
+        destroy_mem_region(vmi, mreg);
+        rwlock_unlock(&vmi->lock);
+        return NULL;
+      }
     }
+    addr = mreg->start;
+    rwlock_unlock(&vmi->lock);
+    return addr;
   }
 
+  /* Small pages (and their page tables) are only filled in when they're
+   * first touched; see vm_page_in(...)
+   */
+
+  /* Merge with like neighbors; new_pages(...) regions stay separate so
+   * remove_pages(...) can find them
+   */
+  addr = mreg->start;
+  mreg_coalesce(&vmi->mmap, mreg, VM_ATTR_NEWPG);
+
+  rwlock_unlock(&vmi->lock);
+
   /* Return the ACTUAL start of the allocation */
-  return mreg->start;
+  return addr;
+}
+
+/** @brief Allocates a region whose pages are read in from a file on demand.
+ *
+ *  No pages are mapped here; pg_page_fault_handler(...) fills each page the
+ *  first time it's touched, copying in whatever part of the page the
+ *  extents cover and zeroing the rest.  Extents must lie within the region
+ *  and the file.
+ *
+ *  @param vmi The vm_info struct for this allocation.
+ *  @param va_start The starting address for the allocation.
+ *  @param len The length (in bytes) of the allocation.
+ *  @param attrs Attributes the allocated region will have.
+ *  @param file The file backing the region.
+ *  @param exts The parts of the region backed by the file.
+ *  @param nexts The number of extents (at most MREG_FILE_EXTENTS).
+ *
+ *  @return The actual start of the allocation; NULL on failure.
+ **/
+void *vm_alloc_file(vm_info_s *vmi, void *va_start, size_t len,
+                    unsigned int attrs, const exec2obj_userapp_TOC_entry *file,
+                    const file_extent_s *exts, int nexts)
+{
+  mem_region_s *mreg;
+  void *start;
+  int i;
+
+  if (nexts > MREG_FILE_EXTENTS || (attrs & VM_ATTR_LARGE)) return NULL;
+
+  /* Ensure the span is not in reserved kernel memory */
+  if (!user_span_ok(va_start, len)) return NULL;
+
+  rwlock_lock(&vmi->lock, RWLOCK_WRITE);
+
+  /* Allocate a region */
+  mreg = create_mem_region(vmi, va_start, len, attrs);
+  if(!mreg) {
+    rwlock_unlock(&vmi->lock);
+    return NULL;
+  }
+
+  /* Record where its pages come from */
+  mreg->file = file;
+  mreg->nexts = nexts;
+  for (i = 0; i < nexts; ++i) {
+    assert(exts[i].off + exts[i].len <= file->execlen);
+    mreg->exts[i] = exts[i];
+  }
+  start = mreg->start;
+
+  rwlock_unlock(&vmi->lock);
+  return start;
+}
+
+/** @brief Maps a whole file read-only.
+ *
+ *  Like a new_pages(...) region, the mapping is freed by remove_pages(...).
+ *  Pages are read in as they're touched, through the page cache, so every
+ *  task mapping the file shares its frames; the last page is zero-filled
+ *  past the end of the file.
+ *
+ *  @param vmi The vm_info struct for this allocation.
+ *  @param va_start The (page-aligned) starting address for the allocation.
+ *  @param file The file.
+ *
+ *  @return The start of the allocation; NULL on failure.
+ **/
+void *vm_map_file(vm_info_s *vmi, void *va_start,
+                  const exec2obj_userapp_TOC_entry *file)
+{
+  file_extent_s ext;
+
+  if (file->execlen <= 0
+      || FLOOR(va_start, PAGE_SIZE) != (unsigned int)va_start)
+  {
+    return NULL;
+  }
+
+  ext.start = va_start;
+  ext.off = 0;
+  ext.len = file->execlen;
+
+  return vm_alloc_file(vmi, va_start, file->execlen,
+                       VM_ATTR_USER|VM_ATTR_NEWPG, file, &ext, 1);
+}
+
+/** @brief Maps a shared memory object.
+ *
+ *  The region covers the whole object and is read/write; like a
+ *  new_pages(...) region, it's freed by remove_pages(...).  Pages are
+ *  mapped to the object's frames as they're touched.
+ *
+ *  @param vmi The vm_info struct for this allocation.
+ *  @param va_start The (page-aligned) starting address for the allocation.
+ *  @param shm The object; on success, the caller's reference to it passes
+ *         to the region.
+ *
+ *  @return The start of the allocation; NULL on failure.
+ **/
+void *vm_alloc_shared(vm_info_s *vmi, void *va_start, shm_s *shm)
+{
+  mem_region_s *mreg;
+
+  /* Ensure the span is not in reserved kernel memory */
+  if (!user_span_ok(va_start, shm->npages * PAGE_SIZE)
+      || FLOOR(va_start, PAGE_SIZE) != (unsigned int)va_start)
+  {
+    return NULL;
+  }
+
+  rwlock_lock(&vmi->lock, RWLOCK_WRITE);
+
+  mreg = create_mem_region(vmi, va_start, shm->npages * PAGE_SIZE,
+                           VM_ATTR_RDWR|VM_ATTR_USER|VM_ATTR_NEWPG);
+  if(!mreg) {
+    rwlock_unlock(&vmi->lock);
+    return NULL;
+  }
+  mreg->shm = shm;
+
+  rwlock_unlock(&vmi->lock);
+  return va_start;
+}
+
+/** @brief Fills in a page that has no PTE yet.
+ *
+ *  Pages of file-backed regions are read in, and pages of shared regions
+ *  map their object's frames; other pages are demand-zero.  A read maps
+ *  the ZFOD frame, and a write backs the page (and perhaps its neighbors)
+ *  with real frames right away.  Pages in the compressed pool are
+ *  decompressed.
+ *
+ *  The caller must hold the map lock (shared will do).
+ *
+ *  @param vmi The faulter's vm_info struct.
+ *  @param vaddr The faulting address.
+ *  @param write Whether the fault was a write.
+ *
+ *  @return 0 on success; a negative integer error code on failure.
+ **/
+int vm_page_in(vm_info_s *vmi, void *vaddr, int write)
+{
+  mem_region_s *mreg;
+  char *page;
+  void *frame;
+  int i, n;
+
+  mreg = mreg_find(&vmi->mmap, vaddr);
+  if (!mreg || (mreg->attrs & VM_ATTR_LARGE)) return -1;
+
+  /* Bring compressed pages back, making room if we have to */
+  if (pg_swapped(&vmi->pg_info, vaddr)) {
+    if (!pg_swap_in(&vmi->pg_info, vaddr, mreg->attrs)) return 0;
+    if (vm_reclaim(vmi, ZS_RECLAIM_BATCH) <= 0) return -3;
+    return pg_swap_in(&vmi->pg_info, vaddr, mreg->attrs) ? -3 : 0;
+  }
+
+  if (write && !(mreg->attrs & VM_ATTR_RDWR)) return -1;
+
+  /* Shared pages, whether read or written, map the object's frame */
+  if (mreg->shm) {
+    i = ((char *)vaddr - (char *)mreg->start) / PAGE_SIZE;
+    frame = shm_frame(mreg->shm, i);
+    if (!frame && vm_reclaim(vmi, ZS_RECLAIM_BATCH) > 0)
+      frame = shm_frame(mreg->shm, i);
+    if (!frame) return -2;
+    return pg_map_frame(&vmi->pg_info, vaddr, frame, mreg->attrs) ? 0 : -2;
+  }
+
+  /* Demand-zero pages */
+  if (!mreg->file) {
+    if (write) return vm_fault_zfod(vmi, vaddr);
+    return pg_alloc(&vmi->pg_info, vaddr, mreg->attrs) ? 0 : -2;
+  }
+
+  /* Out of frames; squeeze some cold pages and try once more */
+  if (!pg_page_in(&vmi->pg_info, vaddr, mreg)
+      && (vm_reclaim(vmi, ZS_RECLAIM_BATCH) <= 0
+          || !pg_page_in(&vmi->pg_info, vaddr, mreg)))
+    return -2;
+  fa_stats.faults++;
+  fa_stats.pages++;
+
+  /* Read in the rest of the window, stopping at the first resident page */
+  n = fault_window(mreg, vaddr);
+  page = (char *)FLOOR(vaddr, PAGE_SIZE);
+  for (i = 1; i < n; ++i) {
+    page += PAGE_SIZE;
+    if (pg_present(&vmi->pg_info, page)
+        || !pg_page_in(&vmi->pg_info, page, mreg))
+      break;
+    fa_stats.pages++;
+  }
+
+  return 0;
+}
+
+/** @brief Backs a page written for the first time, and perhaps some of its
+ *  neighbors.
+ *
+ *  The caller must hold the map lock (shared will do).  Fault-around state
+ *  is updated without further locking; racing faults at worst mis-size a
+ *  window.
+ *
+ *  @param vmi The faulter's vm_info struct.
+ *  @param vaddr The faulting address; its page must be untouched (unmapped,
+ *         or mapped to the ZFOD frame).
+ *
+ *  @return 0 on success; a negative integer error code on failure.
+ **/
+int vm_fault_zfod(vm_info_s *vmi, void *vaddr)
+{
+  mem_region_s *mreg;
+  int n;
+
+  /* Read-only regions stay on the ZFOD frame */
+  mreg = mreg_find(&vmi->mmap, vaddr);
+  if (!mreg || !(mreg->attrs & VM_ATTR_RDWR)) return -1;
+
+  n = fault_window(mreg, vaddr);
+  n = pg_back_zfod(&vmi->pg_info, vaddr, n, mreg->attrs);
+
+  /* Out of frames; squeeze some cold pages and try once more */
+  if (!n && vm_reclaim(vmi, ZS_RECLAIM_BATCH) > 0)
+    n = pg_back_zfod(&vmi->pg_info, vaddr, 1, mreg->attrs);
+  if (!n) return -2;
+
+  fa_stats.faults++;
+  fa_stats.pages += n;
+  return 0;
+}
+
+/** @brief Moves cold pages of an address space into the compressed pool.
+ *
+ *  A clock sweep over the private small-page regions: each call picks up
+ *  where the last left off, clearing accessed bits as it goes, and swaps
+ *  out pages whose bits were still clear.  We stop once target pages are
+ *  swapped out, ZS_SCAN_LIMIT pages have been looked at, or the pool is
+ *  full.  Pages whose bits we clear don't count toward the limit; each can
+ *  only be aged once before it's cold, so a busy address space costs us
+ *  roughly one extra lap over its resident pages, not a failed reclaim.
+ *
+ *  Only the caller's own address space is swept.  The caller must hold its
+ *  map lock, so the regions we walk stay put; shared will do, since
+ *  pg_swap_out(...) serializes with faults on the pages themselves.  Two
+ *  reclaimers may race on the clock hand, which at worst sweeps some pages
+ *  twice.
+ *
+ *  @param vmi The vm_info struct to reclaim from.
+ *  @param target How many pages to free.
+ *
+ *  @return The number of pages swapped out.
+ **/
+int vm_reclaim(vm_info_s *vmi, int target)
+{
+  tlb_batch_s tlb;
+  mem_region_s *mreg;
+  cll_node *n;
+  char *addr, *hand;
+  int got, scanned, rv;
+
+  assert(vmi->lock.nreaders || vmi->lock.writer != -1);
+  if (cll_empty(&vmi->mmap.list)) return 0;
+
+  /* Find the clock hand */
+  hand = vmi->zs_hand;
+  mreg = mreg_find(&vmi->mmap, hand);
+  if (mreg) addr = (char *)FLOOR(hand, PAGE_SIZE);
+  else {
+    mreg = cll_entry(mem_region_s *, vmi->mmap.list.next);
+    addr = mreg->start;
+  }
+
+  tlb_batch_init(&tlb);
+  for (got = scanned = 0; got < target && scanned < ZS_SCAN_LIMIT; ++scanned)
+  {
+    /* Move on to the next region, wrapping around at the end */
+    if (addr > (char *)mreg->limit) {
+      n = mreg->node.next;
+      if (n == &vmi->mmap.list) n = n->next;
+      mreg = cll_entry(mem_region_s *, n);
+      addr = mreg->start;
+    }
+
+    /* File-backed, shared and large pages stay put */
+    if (mreg->file || mreg->shm || (mreg->attrs & VM_ATTR_LARGE)) {
+      addr = (char *)mreg->limit + 1;
+      continue;
+    }
+
+    rv = pg_swap_out(&vmi->pg_info, addr, &tlb);
+    if (rv == ZS_EFULL) break;
+    if (rv == ZS_SWAPPED) ++got;
+    else if (rv == ZS_AGED) --scanned;
+    addr += PAGE_SIZE;
+  }
+  tlb_batch_commit(&tlb);
+
+  vmi->zs_hand = addr;
+  return got;
+}
+
+/** @brief Reads the fault-around counters.
+ *
+ *  @param dst Where to write the counters.
+ *
+ *  @return Void.
+ **/
+void vm_fa_get_stats(vm_fa_stats_s *dst)
+{
+  *dst = fa_stats;
+  return;
+}
+
+/** @brief Prints the fault-around counters to the simics console.
+ *
+ *  @return Void.
+ **/
+void vm_fa_dump_stats(void)
+{
+  lprintf("fault-around: %u faults filled %u pages (%u sequential, "
+          "%u random), max window %d", fa_stats.faults, fa_stats.pages,
+          fa_stats.grows, fa_stats.resets, vm_fa_max_pages);
+  return;
 }
 
 /** @brief Gets the attributes for a region.
@@ -260,17 +791,247 @@ void *vm_alloc(vm_info_s *vmi, void *va_start, size_t len,
  **/
 int vm_get_attrs(vm_info_s *vmi, void *va_start, unsigned int *dst)
 {
-  mem_region_s temp, *mreg;
+  mem_region_s *mreg;
 
-  /* Find the allocated region */
-  mreg_init(&temp, va_start, va_start, 0); 
-  mreg = mreg_lookup(&vmi->mmap, &temp);
-  if (!mreg) return -1;
+  rwlock_lock(&vmi->lock, RWLOCK_READ);
 
+  /* Find the allocated region */
+  mreg = mreg_find(&vmi->mmap, va_start);
+  if (!mreg) {
+    rwlock_unlock(&vmi->lock);
+    return -1;
+  }
   *dst = mreg->attrs;
+
+  rwlock_unlock(&vmi->lock);
   return 0;
 }
 
+/** @brief Applies paging advice to part of a region.
+ *
+ *  VM_ADV_DONTNEED frees the range's frames (and compressed copies); the
+ *  pages fault back in as zeroes, or from the file for file-backed regions.
+ *  VM_ADV_WILLNEED faults the range in now, giving writable pages frames of
+ *  their own.  VM_ADV_RESIDENT sets bit i of vec if the range's i-th page
+ *  has a frame of its own.
+ *
+ *  Shared pages keep their contents in their object, so VM_ADV_DONTNEED
+ *  only unmaps them.
+ *
+ *  The range must lie within a single small-page region.
+ *
+ *  @param vmi The vm_info struct for the range.
+ *  @param va_start The (page-aligned) start of the range.
+ *  @param len The length of the range; a multiple of PAGE_SIZE.
+ *  @param advice One of the VM_ADV_* values.
+ *  @param vec For VM_ADV_RESIDENT, a bitmap with a bit per page.
+ *
+ *  @return 0 on success; a negative integer error code on failure.
+ **/
+int vm_advise(vm_info_s *vmi, void *va_start, size_t len, int advice,
+              unsigned char *vec)
+{
+  mem_region_s *mreg;
+  tlb_batch_s tlb;
+  char *addr, *limit;
+  int i, write, err = 0;
+
+  /* Only freeing pages changes anything faults could see */
+  rwlock_lock(&vmi->lock,
+              advice == VM_ADV_DONTNEED ? RWLOCK_WRITE : RWLOCK_READ);
+
+  /* The range must sit inside one region */
+  mreg = mreg_find(&vmi->mmap, va_start);
+  limit = (char *)va_start + len;
+  if (!mreg || (mreg->attrs & VM_ATTR_LARGE) || limit <= (char *)va_start
+      || limit - 1 > (char *)mreg->limit)
+  {
+    rwlock_unlock(&vmi->lock);
+    return -1;
+  }
+
+  switch (advice)
+  {
+  case VM_ADV_DONTNEED:
+    tlb_batch_init(&tlb);
+    for (addr = va_start; addr < limit; addr += PAGE_SIZE)
+      pg_free(&vmi->pg_info, addr, &tlb);
+    tlb_batch_commit(&tlb);
+    break;
+
+  case VM_ADV_WILLNEED:
+    write = mreg->attrs & VM_ATTR_RDWR;
+    for (addr = va_start; addr < limit; addr += PAGE_SIZE)
+    {
+      if (pg_resident(&vmi->pg_info, addr)) continue;
+
+      /* Read-only pages can stay on the ZFOD frame */
+      if (pg_present(&vmi->pg_info, addr)) {
+        if (write && vm_fault_zfod(vmi, addr)) err = -2;
+      }
+      else if (vm_page_in(vmi, addr, write)) err = -2;
+      if (err) break;
+    }
+    break;
+
+  case VM_ADV_RESIDENT:
+    memset(vec, 0, (len/PAGE_SIZE + 7) / 8);
+    for (i = 0, addr = va_start; addr < limit; ++i, addr += PAGE_SIZE) {
+      if (pg_resident(&vmi->pg_info, addr)) vec[i/8] |= 1 << (i%8);
+    }
+    break;
+
+  default:
+    err = -1;
+  }
+
+  rwlock_unlock(&vmi->lock);
+  return err;
+}
+
+/** @brief Resizes a region, moving it if asked; see vm_remap(...).
+ *
+ *  The caller holds the map lock exclusively, so no fault can refill a
+ *  page we've freed or moved away while we're working.
+ *
+ *  @param vmi The vm_info struct the region is in.
+ *  @param va_start The region's starting address.
+ *  @param len The new length; rounded up to whole pages.
+ *  @param new_start Where the region should start; NULL (or va_start) to
+ *         resize it in place.
+ *
+ *  @return The region's starting address on success, or NULL on failure.
+ **/
+static void *remap(vm_info_s *vmi, void *va_start, size_t len,
+                   void *new_start)
+{
+  mem_region_s *mreg, span;
+  tlb_batch_s tlb;
+  char *old_lim, *new_lim;
+  size_t old_len, keep, off;
+
+  /* Find the region */
+  mreg = mreg_find(&vmi->mmap, va_start);
+  if (!mreg || mreg->start != va_start) return NULL;
+  if (!(mreg->attrs & VM_ATTR_NEWPG) || (mreg->attrs & VM_ATTR_LARGE)
+      || mreg->file || mreg->shm)
+  {
+    return NULL;
+  }
+
+  /* Check the new span */
+  if (!new_start) new_start = va_start;
+  len = CEILING(len, PAGE_SIZE);
+  new_lim = (char *)new_start + len - 1;
+  if (!user_span_ok(new_start, len)
+      || FLOOR(new_start, PAGE_SIZE) != (unsigned int)new_start)
+  {
+    return NULL;
+  }
+
+  old_lim = mreg->limit;
+  old_len = old_lim + 1 - (char *)va_start;
+
+  /* Growing needs the frames new_pages(...) would */
+  if (len > old_len && (len - old_len)/PAGE_SIZE > fr_avail) return NULL;
+
+  /* Stay put */
+  if (new_start == va_start)
+  {
+    if (len > old_len) {
+      mreg_init(&span, old_lim + 1, new_lim, 0);
+      if (mreg_lookup(&vmi->mmap, &span)) return NULL;
+    }
+
+    /* Give back the tail; its tables go once the region no longer
+     * covers them
+     */
+    if (len < old_len) {
+      tlb_batch_init(&tlb);
+      for (off = len; off < old_len; off += PAGE_SIZE)
+        pg_free(&vmi->pg_info, (char *)va_start + off, &tlb);
+      tlb_batch_commit(&tlb);
+    }
+
+    mreg->limit = new_lim;
+    mreg->fa_next = NULL;
+    mreg->fa_window = 0;
+    if (len < old_len) free_span_tables(vmi, new_lim + 1, old_lim);
+    return va_start;
+  }
+
+  /* Move */
+  mreg_init(&span, new_start, new_lim, 0);
+  if (mreg_lookup(&vmi->mmap, &span)) return NULL;
+
+  tlb_batch_init(&tlb);
+  keep = MIN(len, old_len);
+  for (off = 0; off < keep; off += PAGE_SIZE)
+  {
+    if (pg_move(&vmi->pg_info, (char *)new_start + off,
+                (char *)va_start + off, &tlb))
+    {
+      /* Out of page tables; put back what we moved.  That can't fail:
+       * the old tables are all still there, and nobody can have
+       * refilled the pages we emptied.
+       */
+      while (off > 0) {
+        off -= PAGE_SIZE;
+        assert( !pg_move(&vmi->pg_info, (char *)va_start + off,
+                         (char *)new_start + off, &tlb) );
+      }
+      tlb_batch_commit(&tlb);
+      free_span_tables(vmi, new_start, new_lim);
+      return NULL;
+    }
+  }
+  for (off = keep; off < old_len; off += PAGE_SIZE)
+    pg_free(&vmi->pg_info, (char *)va_start + off, &tlb);
+  tlb_batch_commit(&tlb);
+
+  /* Rehome the region, then drop the tables it left behind */
+  assert( mreg_extract(&vmi->mmap, mreg) );
+  mreg->start = new_start;
+  mreg->limit = new_lim;
+  mreg->fa_next = NULL;
+  mreg->fa_window = 0;
+  assert( !mreg_insert(&vmi->mmap, mreg) );
+  free_span_tables(vmi, va_start, old_lim);
+
+  return new_start;
+}
+
+/** @brief Resizes a new_pages(...) region, moving it if asked.
+ *
+ *  Staying put, the region grows into free space above it or gives back
+ *  its tail.  Moving, its pages are relinked at new_start (see
+ *  pg_move(...)) rather than copied, so the cost is in pages mapped, not
+ *  bytes.  Either way, pages past the old end start out untouched.
+ *
+ *  Only anonymous, private small-page regions can be remapped, and a moved
+ *  region may not overlap its old home.  The map lock is held exclusively
+ *  throughout, so other threads' faults wait until the region is in its
+ *  final shape.
+ *
+ *  @param vmi The vm_info struct the region is in.
+ *  @param va_start The region's starting address.
+ *  @param len The new length; rounded up to whole pages.
+ *  @param new_start Where the region should start; NULL (or va_start) to
+ *         resize it in place.
+ *
+ *  @return The region's starting address on success, or NULL on failure.
+ **/
+void *vm_remap(vm_info_s *vmi, void *va_start, size_t len, void *new_start)
+{
+  void *start;
+
+  rwlock_lock(&vmi->lock, RWLOCK_WRITE);
+  start = remap(vmi, va_start, len, new_start);
+  rwlock_unlock(&vmi->lock);
+
+  return start;
+}
+
 /** @brief Sets the attributes for a region.
  *
  *  @param vmi The vm_info struct for this allocation.
@@ -281,25 +1042,47 @@ int vm_get_attrs(vm_info_s *vmi, void *va_start, unsigned int *dst)
  **/
 int vm_set_attrs(vm_info_s *vmi, void *va_start, unsigned int attrs)
 {
-  mem_region_s temp, *mreg;
+  mem_region_s *mreg;
+  tlb_batch_s tlb;
   void *addr;
 
+  rwlock_lock(&vmi->lock, RWLOCK_WRITE);
+
   /* Find the allocated region */
-  mreg_init(&temp, va_start, va_start, 0); 
-  mreg = mreg_lookup(&vmi->mmap, &temp);
-  if (!mreg) return -1;
+  mreg = mreg_find(&vmi->mmap, va_start);
+  if (!mreg) {
+    rwlock_unlock(&vmi->lock);
+    return -1;
+  }
 
-  /* Free pages in that region */
-  for (addr = mreg->start; addr < mreg->limit; addr += PAGE_SIZE) {
-    if (pg_set_attrs(&vmi->pg_info, addr, attrs))
+  /* Update pages in that region */
+  tlb_batch_init(&tlb);
+  for (addr = mreg->start; addr < mreg->limit; addr += MREG_PAGE_SIZE(mreg)) {
+    /* Untouched pages pick up the new attributes when they're filled in */
+    if (!(mreg->attrs & VM_ATTR_LARGE) && !pg_present(&vmi->pg_info, addr))
+      continue;
+    if (pg_set_attrs(&vmi->pg_info, addr, attrs, &tlb)) {
+      tlb_batch_commit(&tlb);
+      rwlock_unlock(&vmi->lock);
       return -1;
+    }
   }
+  tlb_batch_commit(&tlb);
+
+  mreg->attrs = attrs | (mreg->attrs & VM_ATTR_LARGE);
 
-  mreg->attrs = attrs;
+  rwlock_unlock(&vmi->lock);
   return 0;
 }
 
 /** @brief Copies an address space.
+ *
+ *  The child shares all of the parent's frames copy-on-write (see
+ *  pg_copy(...)), so only page tables are allocated here.  Shared regions
+ *  are shared outright; the child maps their pages as it touches them.
+ *
+ *  The source's map lock is held shared throughout; nobody else can see the
+ *  destination yet.
  *
  *  @param dst The destination vm_info struct.
  *  @param src The source vm_info struct.
@@ -310,54 +1093,77 @@ int vm_copy(vm_info_s *dst, vm_info_s *src)
 {
   mem_region_s *dreg;
   const mem_region_s *sreg;
+  tlb_batch_s tlb;
+  pte_walk_s w;
   cll_node *n;
-  void *addr, *addr2, *buf;
+  void *addr, *addr2;
 
   /* Don't copy unless the dest is empty */
-  if (!cll_empty(&dst->mmap)) return -1;
-
-  /* Allocate a buffer for copying frames */
-  buf = smemalign(PAGE_SIZE, PAGE_SIZE);
-  if (!buf) return -1;
+  if (!cll_empty(&dst->mmap.list)) return -1;
 
   /* Map in the destination page tables */
+  rwlock_lock(&src->lock, RWLOCK_READ);
   map_dest_tables(dst, src);
+  tlb_batch_init(&tlb);
 
-  cll_foreach(&src->mmap, n)
+  w.vmi = src;
+  w.dst = dst;
+  w.tlb = &tlb;
+
+  cll_foreach(&src->mmap.list, n)
   {
     sreg = cll_entry(mem_region_s *, n);
 
     /* Allocate a dst region struct */
     dreg = create_mem_region(dst, sreg->start, sreg->limit-sreg->start,
                              sreg->attrs);
-    if (!dreg)
-    {
-      vm_final(dst);
-      unmap_dest_tables(dst, src);
-      sfree(buf, PAGE_SIZE);
-      return -1;
+    if (!dreg) goto fail;
+
+    /* Pages the parent never touched will be filled in by the child too */
+    dreg->file = sreg->file;
+    dreg->nexts = sreg->nexts;
+    memcpy(dreg->exts, sreg->exts, sizeof(dreg->exts));
+
+    /* Shared regions map the parent's object */
+    if (sreg->shm) {
+      shm_ref(sreg->shm);
+      dreg->shm = sreg->shm;
+      continue;
     }
 
-    /* Allocate pages for the region */
-    for (addr = sreg->start; addr < sreg->limit; addr += PAGE_SIZE)
+    /* Large pages are copied outright */
+    if (sreg->attrs & VM_ATTR_LARGE)
     {
-      if(pg_copy(&dst->pg_info, &src->pg_info, addr, buf))
+      for (addr = sreg->start; addr < sreg->limit; addr += LARGE_PAGE_SIZE)
       {
-        for (addr2 = sreg->start; addr2 < addr; addr2 += PAGE_SIZE)
-          pg_free(&dst->pg_info, addr2);
-        destroy_mem_region(dst, dreg);
-        vm_final(dst);
-        unmap_dest_tables(dst, src);
-        sfree(buf, PAGE_SIZE);
-        return -1;
+        if(pg_copy_large(&dst->pg_info, &src->pg_info, addr))
+        {
+          for (addr2 = sreg->start; addr2 < addr; addr2 += LARGE_PAGE_SIZE)
+            pg_free_large(&dst->pg_info, addr2);
+          destroy_mem_region(dst, dreg);
+          goto fail;
+        }
       }
+      continue;
     }
+
+    /* Share the region's pages; vm_final(...) undoes a partial copy */
+    w.attrs = sreg->attrs;
+    if (walk_ptes(src->pg_info.pg_dir, src->pg_info.pg_tbls, sreg->start,
+                  sreg->limit, copy_run, &w))
+      goto fail;
   }
 
   /* Do cleanup and return */
-  unmap_dest_tables(dst, src);
-  sfree(buf, PAGE_SIZE);
+  unmap_dest_tables(dst, src, &tlb);
+  rwlock_unlock(&src->lock);
   return 0;
+
+fail:
+  vm_final(dst);
+  unmap_dest_tables(dst, src, &tlb);
+  rwlock_unlock(&src->lock);
+  return -1;
 }
 
 /** @brief Frees a region previously allocated by vm_alloc(...).
@@ -369,17 +1175,28 @@ int vm_copy(vm_info_s *dst, vm_info_s *src)
  **/
 void vm_free(vm_info_s *vmi, void *va_start)
 {
-  mem_region_s temp, *mreg;
+  mem_region_s *mreg;
+  tlb_batch_s tlb;
   void *addr;
 
+  rwlock_lock(&vmi->lock, RWLOCK_WRITE);
+
   /* Find the allocated region */
-  mreg_init(&temp, va_start, va_start, 0); 
-  mreg = mreg_lookup(&vmi->mmap, &temp);
-  if (!mreg) return;
+  mreg = mreg_find(&vmi->mmap, va_start);
+  if (!mreg) {
+    rwlock_unlock(&vmi->lock);
+    return;
+  }
 
   /* Free pages in that region */
-  for (addr = mreg->start; addr < mreg->limit; addr += PAGE_SIZE) {
-    pg_free(&vmi->pg_info, addr);
+  if (mreg->attrs & VM_ATTR_LARGE) {
+    for (addr = mreg->start; addr < mreg->limit; addr += LARGE_PAGE_SIZE)
+      pg_free_large(&vmi->pg_info, addr);
+  }
+  else {
+    tlb_batch_init(&tlb);
+    free_region_pages(vmi, mreg, &tlb);
+    tlb_batch_commit(&tlb);
   }
 
   /* Free the region and it's page tables */
@@ -388,13 +1205,15 @@ void vm_free(vm_info_s *vmi, void *va_start)
   /* Sanity check */
   validate_pd(&vmi->pg_info);
 
+  rwlock_unlock(&vmi->lock);
   return;
 }
 
 /** @brief Frees a process' entire address space.
  *
  *  Technically, this function only free those parts allocated with
- *  vm_alloc(...).
+ *  vm_alloc(...).  No other thread may be using the address space, so the
+ *  map lock isn't taken.
  *
  *  @param vmi The vm_info struct whose memory map we'll free.
  *
@@ -403,35 +1222,40 @@ void vm_free(vm_info_s *vmi, void *va_start)
 void vm_final(vm_info_s *vmi)
 {
   mem_region_s *mreg;
-  int pdi, prev_pdi;
+  tlb_batch_s tlb;
+  pte_t pde;
   void *addr;
   cll_node *n;
+  int pdi;
 
   /* Free all of each region's pages */
-  cll_foreach(&vmi->mmap, n) {
+  tlb_batch_init(&tlb);
+  cll_foreach(&vmi->mmap.list, n) {
     mreg = cll_entry(mem_region_s *, n); 
-    for (addr = mreg->start; addr < mreg->limit; addr += PAGE_SIZE)
-      pg_free(&vmi->pg_info, addr);
+    if (mreg->attrs & VM_ATTR_LARGE) {
+      for (addr = mreg->start; addr < mreg->limit; addr += LARGE_PAGE_SIZE)
+        pg_free_large(&vmi->pg_info, addr);
+    }
+    else free_region_pages(vmi, mreg, &tlb);
   }
 
-  /* Free each region's page tables */
-  prev_pdi = -1;
-  while (!cll_empty(&vmi->mmap))
+  /* Flush before any of the tables go away */
+  tlb_batch_commit(&tlb);
+
+  /* Free the regions */
+  while (!cll_empty(&vmi->mmap.list))
   {
-    mreg = cll_entry(mem_region_s *,vmi->mmap.next); 
+    mreg = cll_entry(mem_region_s *,vmi->mmap.list.next); 
+    assert(mreg_extract(&vmi->mmap, mreg));
+    if (mreg->shm) shm_put(mreg->shm);
+    mreg_free(mreg);
+  }
 
-    /* Free each page table */
-    pdi = PG_DIR_INDEX(mreg->start);
-    if(pdi == prev_pdi) ++pdi;
-    for( ; (void *)&tomes[pdi] < mreg->limit; pdi++)
+  /* Free every page table; the directory knows which exist */
+  for (pdi = KERN_PD_ENTRIES; (void *)&tomes[pdi] < CHILD_PDE; ++pdi) {
+    if (!get_pde(vmi->pg_info.pg_dir, &tomes[pdi], &pde)
+        && !(pde & PG_DIR_PSE))
       pg_free_table(&vmi->pg_info, &tomes[pdi]);
-
-    /* Store out the index of the last page table freed */
-    prev_pdi = PG_DIR_INDEX(mreg->limit);
-
-    /* Free the region */
-    assert(mreg_extract(&vmi->mmap, mreg));
-    free(mreg);
   }
 
   /* Make sure we don't leak tables */
@@ -449,15 +1273,14 @@ void vm_final(vm_info_s *vmi)
  **/
 void *vm_find(vm_info_s *vmi, void *addr)
 {
-  cll_node *n;
   mem_region_s *mreg;
+  void *start;
 
-  cll_foreach(&vmi->mmap, n) {
-    mreg = cll_entry(mem_region_s *, n);
-    if((addr >= mreg->start) && (addr < mreg->limit))
-      return mreg->start;
-  }
+  rwlock_lock(&vmi->lock, RWLOCK_READ);
+  mreg = mreg_find(&vmi->mmap, addr);
+  start = mreg ? mreg->start : NULL;
+  rwlock_unlock(&vmi->lock);
 
-  return NULL;
+  return start;
 }
 
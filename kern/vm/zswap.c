@@ -0,0 +1,224 @@
+/** @file zswap.c
+ *
+ *  @brief Implements the compressed page pool.
+ *
+ *  When frames run out, the reclaimer (see vm_reclaim(...)) compresses cold
+ *  anonymous pages into this pool and frees their frames.  Each stored page
+ *  gets a slot; the page's PTE is left not-present and holds the slot
+ *  number (see SWAP_PTE(...)) until the page is faulted back in.
+ *
+ *  Compressed pages live in the kernel heap, up to ZS_POOL_LIMIT bytes.
+ *  Frames are read and written through the KWIN_ZSWAP window, so they
+ *  needn't be mapped anywhere.
+ *
+ *  @author Enrique Naudon (esn)
+ *  @author Marlies Ruck (mruck)
+ **/
+#include <simics.h>
+
+#include <zswap.h>
+
+/* Pebbles includes */
+#include <lz.h>
+#include <mutex.h>
+#include <pg_table.h>
+#include <tsc.h>
+
+/* Libc includes */
+#include <assert.h>
+#include <malloc.h>
+#include <stddef.h>
+#include <string.h>
+
+
+/** @struct zs_slot
+ *  @brief A compressed page.
+ **/
+struct zs_slot {
+  unsigned char *data;    /**< The compressed bytes, or NULL if free **/
+  int len;                /**< How many there are **/
+};
+typedef struct zs_slot zs_slot_s;
+
+static zs_slot_s slots[ZS_SLOTS];
+
+/* Free slot numbers, as a stack */
+static int free_slots[ZS_SLOTS];
+static int nfree = -1;
+
+/* Compression scratch space */
+static unsigned short lz_work[LZ_HASH_SIZE];
+static unsigned char lz_buf[ZS_MAX_CLEN];
+
+/* Protects everything above, the stats and the KWIN_ZSWAP window */
+static mutex_s zs_lock = MUTEX_INITIALIZER(zs_lock);
+static zs_stats_s stats;
+
+/** @brief Fills the free slot stack on first use.  Call with zs_lock held.
+ *
+ *  @return Void.
+ **/
+static void init_slots(void)
+{
+  if (nfree >= 0) return;
+  for (nfree = 0; nfree < ZS_SLOTS; ++nfree)
+    free_slots[nfree] = ZS_SLOTS - 1 - nfree;
+
+  return;
+}
+
+/*************************************************************************
+ *  Exported API
+ *************************************************************************/
+
+/** @brief Compresses a frame into the pool.
+ *
+ *  The frame itself is left alone; the caller frees it once the page's PTE
+ *  holds the slot.
+ *
+ *  @param frame The frame to compress.
+ *
+ *  @return The page's slot on success; ZS_EINCOMP or ZS_EFULL on failure.
+ **/
+int zs_store(void *frame)
+{
+  unsigned char *data;
+  int len, slot;
+
+  mutex_lock(&zs_lock);
+  init_slots();
+
+  /* Compress the page */
+  len = lz_compress(kwin_map(KWIN_ZSWAP, frame), PAGE_SIZE, lz_buf,
+                    ZS_MAX_CLEN, lz_work);
+  if (len < 0) {
+    stats.rejects++;
+    mutex_unlock(&zs_lock);
+    return ZS_EINCOMP;
+  }
+
+  /* Find it a home */
+  if (nfree == 0 || stats.pool_bytes + len > ZS_POOL_LIMIT
+      || !(data = malloc(len)))
+  {
+    stats.full++;
+    mutex_unlock(&zs_lock);
+    return ZS_EFULL;
+  }
+  memcpy(data, lz_buf, len);
+
+  slot = free_slots[--nfree];
+  assert(!slots[slot].data);
+  slots[slot].data = data;
+  slots[slot].len = len;
+
+  stats.stored++;
+  stats.stores++;
+  stats.pool_bytes += len;
+
+  mutex_unlock(&zs_lock);
+  return slot;
+}
+
+/** @brief Decompresses a page into a frame and frees its slot.
+ *
+ *  @param slot The page's slot.
+ *  @param frame The frame to fill.
+ *
+ *  @return 0 on success; a negative integer error code on failure.
+ **/
+int zs_load(int slot, void *frame)
+{
+  unsigned long long start;
+  unsigned int cycles;
+  int len;
+
+  assert(0 <= slot && slot < ZS_SLOTS);
+  start = read_tsc();
+
+  mutex_lock(&zs_lock);
+  assert(slots[slot].data);
+
+  len = lz_decompress(slots[slot].data, slots[slot].len,
+                      kwin_map(KWIN_ZSWAP, frame), PAGE_SIZE);
+
+  cycles = read_tsc() - start;
+  stats.loads++;
+  stats.load_cycles += cycles;
+  if (cycles > stats.load_max) stats.load_max = cycles;
+  mutex_unlock(&zs_lock);
+
+  if (len != PAGE_SIZE) return -1;
+
+  zs_drop(slot);
+  return 0;
+}
+
+/** @brief Frees a slot without reading it back.
+ *
+ *  @param slot The slot.
+ *
+ *  @return Void.
+ **/
+void zs_drop(int slot)
+{
+  unsigned char *data;
+
+  assert(0 <= slot && slot < ZS_SLOTS);
+
+  mutex_lock(&zs_lock);
+  data = slots[slot].data;
+  assert(data);
+  stats.stored--;
+  stats.pool_bytes -= slots[slot].len;
+  slots[slot].data = NULL;
+  free_slots[nfree++] = slot;
+  mutex_unlock(&zs_lock);
+
+  free(data);
+  return;
+}
+
+/** @brief Reads the pool's counters.
+ *
+ *  @param dst Where to write the counters.
+ *
+ *  @return Void.
+ **/
+void zs_get_stats(zs_stats_s *dst)
+{
+  mutex_lock(&zs_lock);
+  *dst = stats;
+  mutex_unlock(&zs_lock);
+  return;
+}
+
+/** @brief Prints the pool's counters to the simics console.
+ *
+ *  The compression ratio is over the pages currently stored.
+ *
+ *  @return Void.
+ **/
+void zs_dump_stats(void)
+{
+  zs_stats_s s;
+  unsigned int ratio, avg;
+
+  zs_get_stats(&s);
+
+  /* Hundredths, to avoid floating point (this fits: stored <= ZS_SLOTS) */
+  ratio = s.pool_bytes ? s.stored * PAGE_SIZE * 100 / s.pool_bytes : 0;
+
+  /* Stay in 32 bits; past that, kilocycles are precise enough */
+  if (!s.loads) avg = 0;
+  else if (s.load_cycles >> 32)
+    avg = ((unsigned int)(s.load_cycles >> 10) / s.loads) << 10;
+  else avg = (unsigned int)s.load_cycles / s.loads;
+
+  lprintf("zswap: %u pages in %u bytes (ratio %u.%02u), %u stores, "
+          "%u rejects, %u full", s.stored, s.pool_bytes, ratio / 100,
+          ratio % 100, s.stores, s.rejects, s.full);
+  lprintf("zswap: %u fault-ins, %u cycles avg, %u cycles max", s.loads,
+          avg, s.load_max);
+  return;
+}
@@ -0,0 +1,35 @@
+/** @file syscall_ext.h
+ *
+ *  @brief Declares the interrupt numbers and flags of our system calls
+ *  beyond the Pebbles spec.
+ *
+ *  The spec's calls use (most of) 0x41 through 0x62, and swexn 0x74; ours
+ *  take the gap in between.  Like the spec's syscall_int.h, this lives in
+ *  spec/ so the kernel and user-space build against the same copy.  It
+ *  must stay includable from assembly.
+ *
+ *  @author Enrique Naudon (esn)
+ *  @author Marlies Ruck (mruck)
+ **/
+#ifndef __SYSCALL_EXT_H__
+#define __SYSCALL_EXT_H__
+
+#define PAGE_ADVISE_INT 0x63
+#define REMAP_PAGES_INT 0x64
+#define SHM_CREATE_INT  0x65
+#define SHM_ATTACH_INT  0x66
+#define FILE_OPEN_INT   0x67
+#define FILE_PREAD_INT  0x68
+#define FILE_CLOSE_INT  0x69
+#define FILE_MAP_INT    0x6A
+
+/* Or this into new_pages(...)'s (page-aligned) len to back the region
+ * with large pages */
+#define NEW_PAGES_LARGE 0x001
+
+/* page_advise(...) advice */
+#define PAGE_DONTNEED 1   /* Give back the range's frames; reads see zeroes */
+#define PAGE_WILLNEED 2   /* Fault the range in now */
+#define PAGE_RESIDENT 3   /* Report which pages have frames, a bit each */
+
+#endif /* __SYSCALL_EXT_H__ */
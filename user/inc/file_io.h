@@ -0,0 +1,23 @@
+/** @file file_io.h
+ *
+ *  @brief Declares the file system calls.
+ *
+ *  @author Enrique Naudon (esn)
+ *  @author Marlies Ruck (mruck)
+ **/
+#ifndef __FILE_IO_H__
+#define __FILE_IO_H__
+
+/* The interrupt numbers */
+#include <syscall_ext.h>
+
+#ifndef ASSEMBLER
+
+int file_open(char *filename);
+int file_pread(int fd, char *buf, int count, int offset);
+int file_close(int fd);
+int file_map(int fd, void *addr);
+
+#endif /* ASSEMBLER */
+
+#endif /* __FILE_IO_H__ */
@@ -0,0 +1,17 @@
+/** @file large_pages.h
+ *
+ *  @brief Declares the new_pages(...) flag for 4MB pages.
+ *
+ *  @author Enrique Naudon (esn)
+ *  @author Marlies Ruck (mruck)
+ **/
+#ifndef __LARGE_PAGES_H__
+#define __LARGE_PAGES_H__
+
+/* Size and alignment of large pages */
+#define LARGE_PAGE_SIZE ( 1024 * PAGE_SIZE )
+
+/* The new_pages(...) flag, NEW_PAGES_LARGE */
+#include <syscall_ext.h>
+
+#endif /* __LARGE_PAGES_H__ */
@@ -0,0 +1,20 @@
+/** @file page_advice.h
+ *
+ *  @brief Declares the page_advise(...) system call.
+ *
+ *  @author Enrique Naudon (esn)
+ *  @author Marlies Ruck (mruck)
+ **/
+#ifndef __PAGE_ADVICE_H__
+#define __PAGE_ADVICE_H__
+
+/* The interrupt number and advice (PAGE_DONTNEED and friends) */
+#include <syscall_ext.h>
+
+#ifndef ASSEMBLER
+
+int page_advise(void *addr, int len, int advice, char *vec);
+
+#endif /* ASSEMBLER */
+
+#endif /* __PAGE_ADVICE_H__ */
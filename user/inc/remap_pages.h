@@ -0,0 +1,20 @@
+/** @file remap_pages.h
+ *
+ *  @brief Declares the remap_pages(...) system call.
+ *
+ *  @author Enrique Naudon (esn)
+ *  @author Marlies Ruck (mruck)
+ **/
+#ifndef __REMAP_PAGES_H__
+#define __REMAP_PAGES_H__
+
+/* The interrupt number */
+#include <syscall_ext.h>
+
+#ifndef ASSEMBLER
+
+int remap_pages(void *addr, int len, void *new_addr);
+
+#endif /* ASSEMBLER */
+
+#endif /* __REMAP_PAGES_H__ */
@@ -0,0 +1,21 @@
+/** @file shared_mem.h
+ *
+ *  @brief Declares the shared memory system calls.
+ *
+ *  @author Enrique Naudon (esn)
+ *  @author Marlies Ruck (mruck)
+ **/
+#ifndef __SHARED_MEM_H__
+#define __SHARED_MEM_H__
+
+/* The interrupt numbers */
+#include <syscall_ext.h>
+
+#ifndef ASSEMBLER
+
+int shm_create(void *addr, int len);
+int shm_attach(int handle, void *addr);
+
+#endif /* ASSEMBLER */
+
+#endif /* __SHARED_MEM_H__ */
@@ -0,0 +1,55 @@
+/** @file user/progs/cow.c
+ *
+ *  Tests that fork()ed tasks share frames copy-on-write: writes in the
+ *  child must not be visible in the parent, and vice versa.
+ *
+ *  @covers fork wait new_pages
+ *  @status done
+ */
+
+#include <syscall.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <simics.h>
+
+/* Make this big enough to span multiple pages */
+int test[4096];
+
+#define HEAP ( (int *)0x40000000 )
+
+int main()
+{
+  int status, i;
+
+  /* Dirty data and heap pages in the parent */
+  if (new_pages(HEAP, PAGE_SIZE)) {
+    lprintf("new_pages failed");
+    return -1;
+  }
+  test[0] = test[4095] = 1;
+  HEAP[0] = 1;
+
+  if (fork() == 0) {
+    /* The child sees the parent's values... */
+    if (test[0] != 1 || test[4095] != 1 || HEAP[0] != 1) exit(-1);
+
+    /* ...and gets its own copy on write */
+    for (i = 0; i < 4096; i += 1024) test[i] = 2;
+    HEAP[0] = 2;
+    if (test[0] != 2 || HEAP[0] != 2) exit(-1);
+    exit(0);
+  }
+
+  wait(&status);
+
+  /* Our pages must be untouched */
+  if (status != 0 || test[0] != 1 || test[4095] != 1 || HEAP[0] != 1) {
+    lprintf("cow test failed");
+    return -1;
+  }
+
+  /* We hold the last reference now */
+  test[0] = 3;
+  lprintf("cow test passed");
+  return 0;
+}
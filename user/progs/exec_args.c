@@ -0,0 +1,59 @@
+/** @file user/progs/exec_args.c
+ *
+ *  Tests exec argument passing: arguments arrive intact, including empty
+ *  and long ones, and an argument vector too big for the stack's top page
+ *  is refused without hurting the caller.  Also prints more than fits in a
+ *  thread's scratch area.
+ *
+ *  @covers exec print
+ *  @status done
+ */
+
+#include <syscall.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <simics.h>
+
+#define LONG_ARG 300
+
+char big[PAGE_SIZE + 1];
+char long_arg[LONG_ARG + 1];
+char line[600];
+
+int main(int argc, char *argv[])
+{
+  char *args[] = { "exec_args", "one", "", long_arg, NULL };
+  char *too_big[] = { "exec_args", big, NULL };
+
+  memset(long_arg, 'x', LONG_ARG);
+
+  if (argc == 1) {
+    /* Doesn't fit; we should still be here */
+    memset(big, 'y', PAGE_SIZE);
+    if (exec("exec_args", too_big) >= 0) {
+      lprintf("exec took an oversized argv");
+      return -1;
+    }
+
+    exec("exec_args", args);
+    lprintf("exec failed");
+    return -1;
+  }
+
+  if (argc != 4 || strcmp(argv[0], "exec_args") || strcmp(argv[1], "one")
+      || strcmp(argv[2], "") || strcmp(argv[3], long_arg) || argv[4]) {
+    lprintf("arguments mangled");
+    return -1;
+  }
+
+  memset(line, '-', sizeof(line) - 1);
+  line[sizeof(line) - 1] = '\n';
+  if (print(sizeof(line), line) < 0) {
+    lprintf("long print failed");
+    return -1;
+  }
+
+  lprintf("exec_args: success");
+  return 0;
+}
@@ -0,0 +1,85 @@
+/** @file user/progs/file_io.c
+ *
+ *  Tests the file system calls on our own executable: positioned reads
+ *  agree with a read-only mapping of the file, reads stop at the end of
+ *  the file, and closed or bogus descriptors are refused.
+ *
+ *  @covers file_open file_pread file_close file_map remove_pages
+ *  @status done
+ */
+
+#include <syscall.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <simics.h>
+#include <file_io.h>
+
+#define MAPPED ( (char *)0x40000000 )
+
+char buf[PAGE_SIZE];
+
+int main()
+{
+  int fd, len, off, n, i;
+
+  fd = file_open("file_io");
+  if (fd < 0) {
+    lprintf("file_open failed");
+    return -1;
+  }
+  if (file_open("no such file") >= 0) {
+    lprintf("opened a missing file");
+    return -1;
+  }
+
+  /* We're an ELF */
+  if (file_pread(fd, buf, 4, 0) != 4 || buf[0] != 0x7f || buf[1] != 'E'
+      || buf[2] != 'L' || buf[3] != 'F') {
+    lprintf("file_pread failed");
+    return -1;
+  }
+
+  /* The mapping holds what reads return */
+  len = file_map(fd, MAPPED);
+  if (len <= 0) {
+    lprintf("file_map failed");
+    return -1;
+  }
+  for (off = 0; off < len; off += n) {
+    n = file_pread(fd, buf, sizeof(buf), off);
+    if (n <= 0) {
+      lprintf("short read at %d", off);
+      return -1;
+    }
+    for (i = 0; i < n; ++i) {
+      if (MAPPED[off + i] != buf[i]) {
+        lprintf("mapping differs at %d", off + i);
+        return -1;
+      }
+    }
+  }
+
+  /* Reads stop at the end, and the mapping is zero-filled past it */
+  if (file_pread(fd, buf, sizeof(buf), len) != 0
+      || file_pread(fd, buf, sizeof(buf), len - 1) != 1) {
+    lprintf("read past the end");
+    return -1;
+  }
+  if (len % PAGE_SIZE && MAPPED[len] != 0) {
+    lprintf("mapping not zero-filled");
+    return -1;
+  }
+
+  /* Mappings outlive their descriptors */
+  if (file_close(fd) || file_pread(fd, buf, 1, 0) >= 0 || !file_close(fd)) {
+    lprintf("file_close failed");
+    return -1;
+  }
+  if (MAPPED[1] != 'E' || remove_pages(MAPPED)) {
+    lprintf("remove_pages failed");
+    return -1;
+  }
+
+  lprintf("file io test passed");
+  return 0;
+}
@@ -0,0 +1,83 @@
+/** @file user/progs/large_pages.c
+ *
+ *  Tests new_pages(...) regions backed by 4MB pages: they must start out
+ *  zeroed, be copied on fork(), and be removable.
+ *
+ *  @covers new_pages remove_pages fork wait
+ *  @status done
+ */
+
+#include <syscall.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <simics.h>
+#include <large_pages.h>
+
+#define HEAP ( (int *)0x40000000 )
+#define HEAP_LEN ( 2 * LARGE_PAGE_SIZE )
+#define HEAP_INTS ( HEAP_LEN/sizeof(int) )
+#define STRIDE ( PAGE_SIZE/sizeof(int) )
+
+/* The tome fork(...) borrows for the child's page tables */
+#define CHILD_TOME ( (void *)0xFF800000 )
+
+int main()
+{
+  int status, i;
+
+  /* Misaligned requests are refused */
+  if (!new_pages(HEAP + STRIDE, LARGE_PAGE_SIZE | NEW_PAGES_LARGE)) {
+    lprintf("misaligned large page allowed");
+    return -1;
+  }
+
+  /* So are ones in the kernel's tomes at the top, or wrapping past them */
+  if (!new_pages(CHILD_TOME, LARGE_PAGE_SIZE | NEW_PAGES_LARGE)
+      || !new_pages(CHILD_TOME, 3 * LARGE_PAGE_SIZE | NEW_PAGES_LARGE)
+      || !new_pages(CHILD_TOME, PAGE_SIZE)) {
+    lprintf("new_pages allowed over the top of user-space");
+    return -1;
+  }
+
+  if (new_pages(HEAP, HEAP_LEN | NEW_PAGES_LARGE)) {
+    lprintf("new_pages failed");
+    return -1;
+  }
+
+  /* Fresh memory is zeroed */
+  for (i = 0; i < HEAP_INTS; i += STRIDE) {
+    if (HEAP[i] != 0) {
+      lprintf("large page not zeroed");
+      return -1;
+    }
+    HEAP[i] = i;
+  }
+
+  if (fork() == 0) {
+    /* The child gets a copy... */
+    for (i = 0; i < HEAP_INTS; i += STRIDE)
+      if (HEAP[i] != i) exit(-1);
+
+    /* ...that's its own */
+    for (i = 0; i < HEAP_INTS; i += STRIDE)
+      HEAP[i] = -1;
+    exit(0);
+  }
+
+  wait(&status);
+
+  for (i = 0; i < HEAP_INTS; i += STRIDE) {
+    if (status != 0 || HEAP[i] != i) {
+      lprintf("large page test failed");
+      return -1;
+    }
+  }
+
+  if (remove_pages(HEAP)) {
+    lprintf("remove_pages failed");
+    return -1;
+  }
+
+  lprintf("large page test passed");
+  return 0;
+}
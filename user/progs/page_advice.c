@@ -0,0 +1,77 @@
+/** @file user/progs/page_advice.c
+ *
+ *  Tests page_advise(...): prefaulted pages become resident, dropped pages
+ *  give back their frames and read back as zeroes, and the region survives
+ *  it all.
+ *
+ *  @covers new_pages remove_pages page_advise
+ *  @status done
+ */
+
+#include <syscall.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <simics.h>
+#include <page_advice.h>
+
+#define HEAP ( (int *)0x40000000 )
+#define NPAGES 8
+#define STRIDE ( PAGE_SIZE/sizeof(int) )
+
+int main()
+{
+  char vec[(NPAGES + 7)/8];
+  int i;
+
+  if (new_pages(HEAP, NPAGES * PAGE_SIZE)) {
+    lprintf("new_pages failed");
+    return -1;
+  }
+
+  /* Nothing is resident until it's touched */
+  if (page_advise(HEAP, NPAGES * PAGE_SIZE, PAGE_RESIDENT, vec)
+      || vec[0] != 0) {
+    lprintf("fresh pages resident");
+    return -1;
+  }
+
+  /* Prefault the whole region */
+  if (page_advise(HEAP, NPAGES * PAGE_SIZE, PAGE_WILLNEED, NULL)
+      || page_advise(HEAP, NPAGES * PAGE_SIZE, PAGE_RESIDENT, vec)
+      || (unsigned char)vec[0] != 0xFF) {
+    lprintf("prefault failed");
+    return -1;
+  }
+  for (i = 0; i < NPAGES; ++i) HEAP[i * STRIDE] = i + 1;
+
+  /* Drop the middle half */
+  if (page_advise(HEAP + 2*STRIDE, 4 * PAGE_SIZE, PAGE_DONTNEED, NULL)
+      || page_advise(HEAP, NPAGES * PAGE_SIZE, PAGE_RESIDENT, vec)
+      || (unsigned char)vec[0] != 0xC3) {
+    lprintf("drop failed");
+    return -1;
+  }
+
+  /* Dropped pages read back as zeroes; the rest keep their contents */
+  for (i = 0; i < NPAGES; ++i) {
+    if (HEAP[i * STRIDE] != ((2 <= i && i < 6) ? 0 : i + 1)) {
+      lprintf("page %d has the wrong contents", i);
+      return -1;
+    }
+  }
+
+  /* Ranges must be page-aligned and inside one region */
+  if (!page_advise(HEAP + 1, PAGE_SIZE, PAGE_DONTNEED, NULL)
+      || !page_advise(HEAP, (NPAGES + 1) * PAGE_SIZE, PAGE_DONTNEED, NULL)) {
+    lprintf("bad range accepted");
+    return -1;
+  }
+
+  if (remove_pages(HEAP)) {
+    lprintf("remove_pages failed");
+    return -1;
+  }
+
+  lprintf("page advice test passed");
+  return 0;
+}
@@ -0,0 +1,90 @@
+/** @file user/progs/remap_pages.c
+ *
+ *  Tests remap_pages(...): regions grow and shrink in place, keeping their
+ *  contents, and move without losing them.
+ *
+ *  @covers new_pages remove_pages remap_pages
+ *  @status done
+ */
+
+#include <syscall.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <simics.h>
+#include <remap_pages.h>
+
+#define HEAP ( (int *)0x40000000 )
+#define FAR  ( (int *)0x50000000 )
+#define BLOCK ( (int *)0x40004000 )
+#define STRIDE ( PAGE_SIZE/sizeof(int) )
+
+int main()
+{
+  int i;
+
+  if (new_pages(HEAP, 2 * PAGE_SIZE)) {
+    lprintf("new_pages failed");
+    return -1;
+  }
+  HEAP[0] = 1;
+  HEAP[STRIDE] = 2;
+
+  /* Grow in place; the new pages are zeroed */
+  if (remap_pages(HEAP, 4 * PAGE_SIZE, NULL)) {
+    lprintf("grow failed");
+    return -1;
+  }
+  if (HEAP[0] != 1 || HEAP[STRIDE] != 2 || HEAP[3 * STRIDE] != 0) {
+    lprintf("grow lost data");
+    return -1;
+  }
+  HEAP[3 * STRIDE] = 4;
+
+  /* Can't grow into somebody else */
+  if (new_pages(BLOCK, PAGE_SIZE)) {
+    lprintf("new_pages failed");
+    return -1;
+  }
+  if (!remap_pages(HEAP, 8 * PAGE_SIZE, NULL)) {
+    lprintf("grew over a neighbor");
+    return -1;
+  }
+  remove_pages(BLOCK);
+
+  /* Shrink, then grow back: the tail comes back zeroed */
+  if (remap_pages(HEAP, PAGE_SIZE, NULL)
+      || remap_pages(HEAP, 4 * PAGE_SIZE, HEAP)) {
+    lprintf("shrink failed");
+    return -1;
+  }
+  if (HEAP[0] != 1 || HEAP[STRIDE] != 0 || HEAP[3 * STRIDE] != 0) {
+    lprintf("shrink kept data");
+    return -1;
+  }
+  for (i = 0; i < 4; ++i) HEAP[i * STRIDE] = i + 1;
+
+  /* Move (and grow) */
+  if (remap_pages(HEAP, 6 * PAGE_SIZE, FAR)) {
+    lprintf("move failed");
+    return -1;
+  }
+  for (i = 0; i < 6; ++i) {
+    if (FAR[i * STRIDE] != (i < 4 ? i + 1 : 0)) {
+      lprintf("move lost page %d", i);
+      return -1;
+    }
+  }
+
+  /* The old home is gone */
+  if (!remove_pages(HEAP)) {
+    lprintf("old region survived the move");
+    return -1;
+  }
+  if (remove_pages(FAR)) {
+    lprintf("remove_pages failed");
+    return -1;
+  }
+
+  lprintf("remap pages test passed");
+  return 0;
+}
@@ -0,0 +1,97 @@
+/** @file user/progs/shared_mem.c
+ *
+ *  Tests shared memory: a fork()ed child's writes through an inherited
+ *  mapping and through a second, attached mapping are visible to its
+ *  parent, and the object outlives the creator's mapping.  A task forked
+ *  before the object was created can't attach it, handle or no.
+ *
+ *  @covers fork wait sleep remove_pages shm_create shm_attach
+ *  @status done
+ */
+
+#include <syscall.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <simics.h>
+#include <shared_mem.h>
+
+#define SHARED ( (int *)0x40000000 )
+#define ALIAS  ( (int *)0x50000000 )
+#define STRIDE ( PAGE_SIZE/sizeof(int) )
+
+/* Long enough for our parent to create its object */
+#define SETTLE 10
+
+int main()
+{
+  int handle, status, snoop, mine, h;
+
+  /* Handles count up, so every one below our own object's is fair game;
+   * but none of them are ours to attach
+   */
+  if ((snoop = fork()) == 0) {
+    sleep(SETTLE);
+    mine = shm_create(SHARED, PAGE_SIZE);
+    if (mine <= 0 || shm_attach(mine, ALIAS)) exit(-1);
+    for (h = 1; h < mine; ++h) {
+      if (!shm_attach(h, ALIAS + STRIDE)) exit(-1);
+    }
+    exit(0);
+  }
+
+  handle = shm_create(SHARED, 4 * PAGE_SIZE);
+  if (handle <= 0) {
+    lprintf("shm_create failed");
+    return -1;
+  }
+  SHARED[0] = 1;
+
+  if (wait(&status) != snoop || status != 0) {
+    lprintf("another task attached our object");
+    return -1;
+  }
+
+  if (fork() == 0) {
+    /* The child's inherited mapping is the same memory... */
+    if (SHARED[0] != 1) exit(-1);
+    SHARED[0] = 2;
+
+    /* ...as is a second mapping of the object */
+    if (shm_attach(handle, ALIAS)) exit(-1);
+    if (ALIAS[0] != 2) exit(-1);
+    ALIAS[3 * STRIDE] = 3;
+    if (SHARED[3 * STRIDE] != 3) exit(-1);
+    exit(0);
+  }
+
+  wait(&status);
+  if (status != 0 || SHARED[0] != 2 || SHARED[3 * STRIDE] != 3) {
+    lprintf("shared memory test failed");
+    return -1;
+  }
+
+  /* Attach in the parent too */
+  if (shm_attach(handle, ALIAS) || ALIAS[3 * STRIDE] != 3) {
+    lprintf("attach failed");
+    return -1;
+  }
+
+  /* The object lives on in its other mapping */
+  if (remove_pages(SHARED) || ALIAS[0] != 2) {
+    lprintf("object died with its creator's mapping");
+    return -1;
+  }
+  if (remove_pages(ALIAS)) {
+    lprintf("remove_pages failed");
+    return -1;
+  }
+
+  /* ...and once it's gone, so is its handle */
+  if (!shm_attach(handle, ALIAS)) {
+    lprintf("stale handle attached");
+    return -1;
+  }
+
+  lprintf("shared memory test passed");
+  return 0;
+}
@@ -0,0 +1,73 @@
+/** @file user/progs/sparse_span.c
+ *
+ *  Tests a sparsely touched allocation spanning several page tables: a
+ *  forked child sees exactly the pages that were touched, and removing the
+ *  allocation frees all of its page tables, not just the first.
+ *
+ *  @covers new_pages remove_pages fork
+ *  @status done
+ */
+
+#include <syscall.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <simics.h>
+
+#define TOME    ( PAGE_SIZE * 1024 )
+#define BASE    ( (char *)0x40000000 + 3 * PAGE_SIZE )
+#define LEN     ( 3 * TOME )
+
+/* One page per tome the allocation touches, plus its first and last */
+#define NPAGES  6
+static const int offsets[NPAGES] = {
+  0, PAGE_SIZE, TOME, 2 * TOME - PAGE_SIZE, 2 * TOME + 7 * PAGE_SIZE,
+  LEN - PAGE_SIZE,
+};
+
+static int check(int base)
+{
+  int i;
+
+  for (i = 0; i < NPAGES; ++i) {
+    if (BASE[offsets[i]] != base + i) return -1;
+  }
+  /* Untouched pages are still zero */
+  return BASE[TOME + PAGE_SIZE] || BASE[3 * PAGE_SIZE] ? -1 : 0;
+}
+
+int main()
+{
+  int pid, status, i, round;
+
+  for (round = 0; round < 3; ++round) {
+    if (new_pages(BASE, LEN) < 0) {
+      lprintf("new_pages failed");
+      return -1;
+    }
+    for (i = 0; i < NPAGES; ++i) BASE[offsets[i]] = round + i;
+
+    pid = fork();
+    if (pid < 0) {
+      lprintf("fork failed");
+      return -1;
+    }
+    if (!pid) {
+      /* Our writes mustn't show through to the parent */
+      status = check(round);
+      for (i = 0; i < NPAGES; ++i) BASE[offsets[i]] = 0;
+      exit(status);
+    }
+    if (wait(&status) != pid || status) {
+      lprintf("child saw the wrong pages");
+      return -1;
+    }
+
+    if (check(round) || remove_pages(BASE) < 0) {
+      lprintf("parent's pages changed or remove_pages failed");
+      return -1;
+    }
+  }
+
+  lprintf("sparse_span: success");
+  return 0;
+}
@@ -0,0 +1,90 @@
+/** @file user/progs/swap_roundtrip.c
+ *
+ *  Tests the compressed page pool: we touch more memory than the machine
+ *  has free, so the oldest pages get compressed to make room, then read
+ *  everything back, which decompresses them (compressing others in turn).
+ *  Every page must come back exactly as written.
+ *
+ *  @covers new_pages
+ *  @status done
+ */
+
+#include <syscall.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <simics.h>
+
+#define BASE    ( (char *)0x40000000 )
+#define LIMIT   ( (char *)0xc0000000 )
+
+/* Pages per allocation while memory lasts */
+#define CHUNK   64
+
+/* How many pages past free memory we go; the pool holds far more */
+#define OVER    1024
+#define SPARE   ( BASE + OVER * PAGE_SIZE )
+
+#define WORDS   ( PAGE_SIZE / sizeof(int) )
+
+/* Compressible, but different on every page and not all one value */
+#define PATTERN(page,word) \
+  ( (int)(((page) - BASE) / PAGE_SIZE * 31 + ((word) & 15)) )
+
+static void fill(char *start, char *end)
+{
+  unsigned int j;
+
+  for ( ; start < end; start += PAGE_SIZE) {
+    for (j = 0; j < WORDS; ++j) ((int *)start)[j] = PATTERN(start, j);
+  }
+}
+
+static int check(char *page)
+{
+  unsigned int j;
+
+  for (j = 0; j < WORDS; ++j) {
+    if (((int *)page)[j] != PATTERN(page, j)) return -1;
+  }
+  return 0;
+}
+
+int main()
+{
+  char *end, *page;
+  int pass;
+
+  /* Free memory is checked when pages are allocated, not when they're
+   * touched, so set aside the pages we'll overcommit while we still can
+   */
+  if (new_pages(BASE, OVER * PAGE_SIZE) < 0) {
+    lprintf("new_pages failed");
+    return -1;
+  }
+
+  /* Use up free memory, then touch the spare pages; from there on each
+   * page we touch squeezes out an older one
+   */
+  for (end = SPARE; end < LIMIT; end += CHUNK * PAGE_SIZE) {
+    if (new_pages(end, CHUNK * PAGE_SIZE) < 0) break;
+    fill(end, end + CHUNK * PAGE_SIZE);
+  }
+  if (end == LIMIT) {
+    lprintf("couldn't use up free memory");
+    return -1;
+  }
+  fill(BASE, SPARE);
+
+  /* Twice, so pages swapped out by the first pass come back too */
+  for (pass = 0; pass < 2; ++pass) {
+    for (page = BASE; page < end; page += PAGE_SIZE) {
+      if (check(page)) {
+        lprintf("page %d came back wrong", (page - BASE) / PAGE_SIZE);
+        return -1;
+      }
+    }
+  }
+
+  lprintf("swap_roundtrip: success");
+  return 0;
+}